@@ -0,0 +1,51 @@
+#ifndef NISC_BENCH_BENCH_H
+#define NISC_BENCH_BENCH_H 1
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../include/nisc.h"
+
+// each benchmark is its own program, build them with `make bench OPT=-O2`
+
+static inline double bench_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// fixed seeds, so that runs compare
+static inline uint64_t bench_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// appends to a growing buffer
+struct BenchText {
+    // owned
+    char *ptr;
+    size_t len;
+    size_t cap;
+};
+
+static inline void bench_append(struct BenchText *text, const char *str, size_t len) {
+    if (text->len + len > text->cap) {
+        text->cap = text->cap ? text->cap : 4096;
+        while (text->len + len > text->cap) {
+            text->cap *= 2;
+        }
+        text->ptr = realloc(text->ptr, text->cap);
+    }
+    memcpy(text->ptr + text->len, str, len);
+    text->len += len;
+}
+
+static inline void bench_puts(struct BenchText *text, const char *str) {
+    bench_append(text, str, strlen(str));
+}
+
+#endif /* NISC_BENCH_BENCH_H */
@@ -0,0 +1,71 @@
+#include "bench.h"
+
+// random alloc, free and realloc over a fixed set of slots, 70% of the
+// requests tree sized, the rest spread over the small and large classes.
+// Every object carries its slot in its first and last byte, checked
+// before it is touched again.
+
+#define BENCH_SLOTS 20000
+#define BENCH_STEPS 5000000
+
+static size_t bench_size(uint64_t *state) {
+    unsigned pick = bench_random(state) % 100;
+    if (pick < 70) {
+        return sizeof(NisStree);
+    } else if (pick < 90) {
+        return 8 + bench_random(state) % 249;
+    } else if (pick < 98) {
+        return 257 + bench_random(state) % 768;
+    }
+    return 1025 + bench_random(state) % 16384;
+}
+
+static void bench_stamp(unsigned char *ptr, size_t size, size_t slot) {
+    ptr[0] = ptr[size - 1] = (unsigned char) slot;
+}
+
+static double bench_churn(bool reallocs) {
+    NisGc gc;
+    nis_new_gc(&gc, 256 << 20);
+    unsigned char **ptrs = calloc(BENCH_SLOTS, sizeof(unsigned char *));
+    size_t *sizes = calloc(BENCH_SLOTS, sizeof(size_t));
+    uint64_t state = 88172645463325252ull;
+    size_t bad = 0;
+    double start = bench_now();
+    for (size_t i = 0; i < BENCH_STEPS; i++) {
+        size_t k = bench_random(&state) % BENCH_SLOTS;
+        unsigned char *ptr = ptrs[k];
+        if (!ptr) {
+            sizes[k] = bench_size(&state);
+            ptrs[k] = nis_alloc(&gc, sizes[k]);
+            bench_stamp(ptrs[k], sizes[k], k);
+            continue;
+        }
+        bad += ptr[0] != (unsigned char) k || ptr[sizes[k] - 1] != (unsigned char) k;
+        if (!reallocs || bench_random(&state) % 2) {
+            nis_dealloc(&gc, ptr, sizes[k]);
+            ptrs[k] = NULL;
+        } else {
+            size_t size = bench_size(&state);
+            ptrs[k] = nis_realloc(&gc, ptr, sizes[k], size);
+            sizes[k] = size;
+            bench_stamp(ptrs[k], size, k);
+        }
+    }
+    double time = bench_now() - start;
+    if (bad) {
+        fprintf(stderr, "%zu objects overwritten\n", bad);
+        exit(1);
+    }
+    free(ptrs);
+    free(sizes);
+    nis_del_gc(&gc);
+    return time / BENCH_STEPS * 1e9;
+}
+
+int main(void) {
+    printf("churn, %d slots, %d steps\n", BENCH_SLOTS, BENCH_STEPS);
+    printf("  alloc and free       %6.1f ns/op\n", bench_churn(false));
+    printf("  with reallocs        %6.1f ns/op\n", bench_churn(true));
+    return 0;
+}
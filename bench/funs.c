@@ -0,0 +1,128 @@
+#include "bench.h"
+
+// lowering calls against many functions, where each callee is looked up
+// by name in the builder's index, and the cost of the scan over every
+// function that the index replaced, on the same names
+
+#define BENCH_CALLS 20000
+
+static void bench_source(struct BenchText *text, size_t func) {
+    uint64_t state = 1;
+    char form[64];
+    for (size_t i = 0; i < BENCH_CALLS; i++) {
+        unsigned outer = bench_random(&state) % func;
+        unsigned inner = bench_random(&state) % func;
+        bench_append(text, form, snprintf(form, sizeof form, "(f%u 1 (f%u 2))\n", outer, inner));
+    }
+}
+
+// the functions, with every other one removed and added back, so that the
+// index also holds names found through a later duplicate
+static void bench_builder(NisHlbuilder *b, NisGc *gc, size_t func) {
+    char name[32];
+    nis_new_hlbuilder(b, gc);
+    nis_hlb_make_prelude(b);
+    int32_t first = b->func;
+    for (size_t i = 0; i < func; i++) {
+        snprintf(name, sizeof name, "f%zu", i);
+        nis_hlb_addfun(b, name);
+    }
+    for (size_t i = 0; i < func; i += 2) {
+        nis_hlb_rmfun(b, first + i);
+        snprintf(name, sizeof name, "f%zu", i);
+        nis_hlb_addfun(b, name);
+    }
+}
+
+// every call must name a present function of the name it was written with
+static size_t bench_check(NisHlprog *prog, NisValue *program, size_t len) {
+    size_t bad = 0;
+    size_t form = 0;
+    NisHlfun *entry = prog->funv + prog->funent;
+    for (size_t i = 0; form < len && i + 1 < entry->insc; i += 2, form++) {
+        // the inner call comes first
+        NisValue outer = nis_value_tree(program[form])->vpair.car;
+        NisHlbc *ins = entry->insv + i + 1;
+        NisHlfun *callee = prog->funv + nis_value_int(ins->argv[0].value);
+        bad += ins->opcode != NIS_HLBC_CALL || !callee->present || callee->name != nis_value_tree(outer)->vsym;
+    }
+    return bad;
+}
+
+static double bench_lower(const struct BenchText *text, size_t func, size_t *bad) {
+    double best = 1e9;
+    for (int i = 0; i < 3; i++) {
+        NisGc gc;
+        nis_new_gc(&gc, 16 << 20);
+        NisValue *program;
+        size_t len;
+        struct NisLexer lexer;
+        nis_new_lexer(&lexer, text->ptr, text->len);
+        if (nis_parse_stream(&program, &len, &gc, &lexer)) {
+            exit(1);
+        }
+        nis_del_lexer(&lexer);
+        nis_gc_add_root(&gc, &program, &len);
+        NisHlbuilder b;
+        bench_builder(&b, &gc, func);
+        NisHlprog prog;
+        double start = bench_now();
+        if (nis_to_hlbc(&prog, &b, program, len)) {
+            exit(1);
+        }
+        double time = bench_now() - start;
+        best = time < best ? time : best;
+        *bad = bench_check(&prog, program, len);
+        nis_del_hlprog(&prog);
+        nis_gc_remove_root(&gc, &program);
+        free(program);
+        nis_del_gc(&gc);
+    }
+    return best;
+}
+
+// what nis_expr_to_hlbc did per call before the index
+static double bench_scan(const struct BenchText *text, size_t func) {
+    NisGc gc;
+    nis_new_gc(&gc, 16 << 20);
+    NisHlbuilder b;
+    bench_builder(&b, &gc, func);
+    struct NisTokens tokens;
+    if (nis_lex(&tokens, text->ptr, text->len)) {
+        exit(1);
+    }
+    size_t found = 0;
+    double start = bench_now();
+    for (size_t i = 0; i < tokens.len; i++) {
+        if (tokens.list[i].kind != NIS_TOKEN_IDENT) {
+            continue;
+        }
+        for (size_t j = 0; j < b.func; j++) {
+            if (b.funv[j].present && b.funv[j].name == tokens.list[i].vsym) {
+                found += j;
+                break;
+            }
+        }
+    }
+    double time = bench_now() - start;
+    nis_del_tokens(&tokens);
+    nis_del_hlbuilder(&b);
+    nis_del_gc(&gc);
+    // keeps the loop
+    return found == (size_t) -1 ? 0 : time;
+}
+
+int main(void) {
+    static const size_t FUNC[] = { 100, 1000, 10000 };
+    printf("lowering %d calls, best of 3     index      scan alone   misresolved\n", BENCH_CALLS);
+    for (size_t i = 0; i < sizeof FUNC / sizeof *FUNC; i++) {
+        struct BenchText text = { NULL, 0, 0 };
+        bench_source(&text, FUNC[i]);
+        size_t bad;
+        double lower = bench_lower(&text, FUNC[i], &bad);
+        printf("  %5zu functions               %6.3f s    %6.3f s    %zu\n", FUNC[i], lower, bench_scan(&text, FUNC[i]), bad);
+        free(text.ptr);
+    }
+    nis_del_symbols();
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include "bench.h"
+
+// parsing identifier-heavy input, where every identifier is checked for a
+// special form, and the cost of the strcmp chain the perfect hash replaced
+// on the same identifiers
+
+#define BENCH_SIZE (8 << 20)
+
+static const char *SPECIAL[] = {
+    "lambda", "if", "set!", "include", "include-ci", "cond", "case", "else",
+    "and", "or", "unless", "cond-expand", "let", "let*", "letrec", "letrec*",
+    "let-values", "let*-values", "begin", "do", "delay", "delay-force",
+    "force", "make-promise", "make-parameter", "parameterize", "guard",
+    "quasiquote", "unquote", "unquote-splicing", "case-lambda", "let-syntax",
+    "letrec-syntax", "syntax-rules", "syntax-error",
+};
+
+#define SPECIALC (sizeof SPECIAL / sizeof *SPECIAL)
+
+static void bench_source(struct BenchText *text, bool special) {
+    uint64_t state = 1;
+    char word[64];
+    while (text->len < BENCH_SIZE) {
+        bench_puts(text, "(");
+        for (int i = 0; i < 8; i++) {
+            uint64_t pick = bench_random(&state);
+            if (special && pick % 4 == 0) {
+                bench_puts(text, SPECIAL[pick / 4 % SPECIALC]);
+            } else {
+                bench_append(text, word, snprintf(word, sizeof word, "ident-%u", (unsigned) (pick % 5000)));
+            }
+            bench_puts(text, " ");
+        }
+        bench_puts(text, ")\n");
+    }
+}
+
+static double bench_parse(const struct BenchText *text) {
+    double best = 1e9;
+    for (int i = 0; i < 3; i++) {
+        NisGc gc;
+        nis_new_gc(&gc, 64 << 20);
+        NisValue *program;
+        size_t len;
+        struct NisLexer lexer;
+        nis_new_lexer(&lexer, text->ptr, text->len);
+        double start = bench_now();
+        if (nis_parse_stream(&program, &len, &gc, &lexer)) {
+            exit(1);
+        }
+        double time = bench_now() - start;
+        best = time < best ? time : best;
+        nis_del_lexer(&lexer);
+        free(program);
+        nis_del_gc(&gc);
+    }
+    return best;
+}
+
+// what nis_parse_one did per identifier before the table
+static double bench_chain(const struct BenchText *text) {
+    struct NisTokens tokens;
+    if (nis_lex(&tokens, text->ptr, text->len)) {
+        exit(1);
+    }
+    size_t found = 0;
+    double start = bench_now();
+    for (size_t i = 0; i < tokens.len; i++) {
+        if (tokens.list[i].kind != NIS_TOKEN_IDENT) {
+            continue;
+        }
+        const char *name = tokens.list[i].vsym->name;
+        for (size_t j = 0; j < SPECIALC; j++) {
+            if (strcmp(name, SPECIAL[j]) == 0) {
+                ++found;
+                break;
+            }
+        }
+    }
+    double time = bench_now() - start;
+    nis_del_tokens(&tokens);
+    // keeps the loop
+    return found == (size_t) -1 ? 0 : time;
+}
+
+int main(void) {
+    struct BenchText plain = { NULL, 0, 0 };
+    struct BenchText special = { NULL, 0, 0 };
+    bench_source(&plain, false);
+    bench_source(&special, true);
+    printf("parse, best of 3 on %d MB        parse    strcmp chain alone\n", BENCH_SIZE >> 20);
+    printf("  no special forms           %6.3f s    %6.3f s\n", bench_parse(&plain), bench_chain(&plain));
+    printf("  a quarter special forms    %6.3f s    %6.3f s\n", bench_parse(&special), bench_chain(&special));
+    free(plain.ptr);
+    free(special.ptr);
+    nis_del_symbols();
+    return 0;
+}
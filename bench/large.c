@@ -0,0 +1,56 @@
+#include "bench.h"
+
+// large objects only, between 1 KiB and 64 KiB: random alloc, free, grow
+// and shrink, the freed page runs coalescing and the grows extending in
+// place.  Every object carries its slot in its first and last byte,
+// checked before it is touched again.
+
+#define BENCH_STEPS 1000000
+#define BENCH_MAX (64 << 10)
+
+static void bench_large(size_t slots) {
+    NisGc gc;
+    nis_new_gc(&gc, 64 << 20);
+    unsigned char **ptrs = calloc(slots, sizeof(unsigned char *));
+    size_t *sizes = calloc(slots, sizeof(size_t));
+    uint64_t state = 88172645463325252ull;
+    size_t bad = 0;
+    double start = bench_now();
+    for (size_t i = 0; i < BENCH_STEPS; i++) {
+        size_t k = bench_random(&state) % slots;
+        unsigned char *ptr = ptrs[k];
+        if (!ptr) {
+            sizes[k] = 1025 + bench_random(&state) % 16384;
+            ptrs[k] = nis_alloc(&gc, sizes[k]);
+        } else {
+            bad += ptr[0] != (unsigned char) k || ptr[sizes[k] - 1] != (unsigned char) k;
+            unsigned pick = bench_random(&state) % 4;
+            if (pick == 0) {
+                nis_dealloc(&gc, ptr, sizes[k]);
+                ptrs[k] = NULL;
+                continue;
+            }
+            size_t size = pick == 1 ? sizes[k] / 2 + 1025 : sizes[k] * 2;
+            size = size > BENCH_MAX ? 1025 : size;
+            ptrs[k] = nis_realloc(&gc, ptr, sizes[k], size);
+            sizes[k] = size;
+        }
+        ptrs[k][0] = ptrs[k][sizes[k] - 1] = (unsigned char) k;
+    }
+    double time = bench_now() - start;
+    if (bad) {
+        fprintf(stderr, "%zu objects overwritten\n", bad);
+        exit(1);
+    }
+    printf("  %6zu slots %10.3f s %8zu KiB mapped\n", slots, time, gc.capacity >> 10);
+    free(ptrs);
+    free(sizes);
+    nis_del_gc(&gc);
+}
+
+int main(void) {
+    printf("large objects, %d steps\n", BENCH_STEPS);
+    bench_large(2000);
+    bench_large(10000);
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "bench.h"
+
+// lexing throughput with the vector scans and with the table alone, on
+// short mixed tokens and on indented code with long runs
+
+#define BENCH_SIZE (8 << 20)
+
+static const char *ATOMS[] = {
+    "(", ")", "a", "x1", "+", "42", "-3", "1.5", "'", "#\\a", "\"s\"", "foo",
+};
+
+static void bench_atoms(struct BenchText *text) {
+    uint64_t state = 1;
+    while (text->len < BENCH_SIZE) {
+        bench_puts(text, ATOMS[bench_random(&state) % (sizeof ATOMS / sizeof *ATOMS)]);
+        bench_puts(text, " ");
+    }
+}
+
+static void bench_code(struct BenchText *text) {
+    uint64_t state = 1;
+    char line[256];
+    while (text->len < BENCH_SIZE) {
+        int depth = 1 + bench_random(&state) % 6;
+        int n = snprintf(line, sizeof line,
+                         "%*s(define (compute-something-%u argument-value other-argument)\n"
+                         "%*s  (+ argument-value 1234567 \"a string literal of some length\"))\n",
+                         4 * depth, "", (unsigned) (bench_random(&state) % 100000),
+                         4 * depth, "");
+        bench_append(text, line, n);
+    }
+}
+
+static double bench_lex(const struct BenchText *text, bool vectors) {
+    nis_lex_vectors(vectors);
+    double best = 1e9;
+    for (int i = 0; i < 5; i++) {
+        struct NisTokens tokens;
+        double start = bench_now();
+        if (nis_lex(&tokens, text->ptr, text->len)) {
+            exit(1);
+        }
+        double time = bench_now() - start;
+        best = time < best ? time : best;
+        nis_del_tokens(&tokens);
+    }
+    return text->len / best / 1e6;
+}
+
+int main(void) {
+    struct BenchText atoms = { NULL, 0, 0 };
+    struct BenchText code = { NULL, 0, 0 };
+    bench_atoms(&atoms);
+    bench_code(&code);
+    printf("lex, best of 5 on %d MB       table      vectors\n", BENCH_SIZE >> 20);
+    printf("  short mixed atoms    %7.0f MB/s %7.0f MB/s\n",
+           bench_lex(&atoms, false), bench_lex(&atoms, true));
+    printf("  indented code        %7.0f MB/s %7.0f MB/s\n",
+           bench_lex(&code, false), bench_lex(&code, true));
+    free(atoms.ptr);
+    free(code.ptr);
+    nis_del_symbols();
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include "bench.h"
+
+// parse, walk and display of inputs as deep or as long as 10^6, which
+// must neither recurse on the C stack nor go quadratic
+
+#define BENCH_N 1000000
+
+static void bench_deep(struct BenchText *text) {
+    for (size_t i = 0; i < BENCH_N; i++) {
+        bench_puts(text, "(");
+    }
+    bench_puts(text, "x");
+    for (size_t i = 0; i < BENCH_N; i++) {
+        bench_puts(text, ")");
+    }
+}
+
+static void bench_long(struct BenchText *text, bool improper) {
+    char num[32];
+    bench_puts(text, "(");
+    for (size_t i = 0; i < BENCH_N; i++) {
+        bench_append(text, num, snprintf(num, sizeof num, "%zu ", i));
+    }
+    bench_puts(text, improper ? ". x)" : ")");
+}
+
+static void bench_run(const char *name, const struct BenchText *text, size_t length) {
+    NisGc gc;
+    nis_new_gc(&gc, 64 << 20);
+    NisValue *program;
+    size_t len;
+    struct NisLexer lexer;
+    nis_new_lexer(&lexer, text->ptr, text->len);
+    double start = bench_now();
+    if (nis_parse_stream(&program, &len, &gc, &lexer) || len != 1) {
+        fprintf(stderr, "%s: parse failed\n", name);
+        exit(1);
+    }
+    double parse = bench_now() - start;
+    nis_del_lexer(&lexer);
+    nis_gc_add_root(&gc, &program, &len);
+
+    start = bench_now();
+    size_t walked = nis_list_length(program);
+    double walk = bench_now() - start;
+    if (walked != length) {
+        fprintf(stderr, "%s: length %zu, expected %zu\n", name, walked, length);
+        exit(1);
+    }
+
+    size_t cap = 1 << 20;
+    char *buffer = malloc(cap);
+    start = bench_now();
+    nis_display(buffer, cap, program);
+    double display = bench_now() - start;
+    printf("  %-22s %6.3f s %6.3f s %6.3f s\n", name, parse, walk, display);
+
+    free(buffer);
+    nis_gc_remove_root(&gc, &program);
+    free(program);
+    nis_del_gc(&gc);
+}
+
+int main(void) {
+    struct BenchText deep = { NULL, 0, 0 };
+    struct BenchText proper = { NULL, 0, 0 };
+    struct BenchText improper = { NULL, 0, 0 };
+    bench_deep(&deep);
+    bench_long(&proper, false);
+    bench_long(&improper, true);
+    printf("10^6 deep or long          parse     walk  display (1 MiB)\n");
+    bench_run("depth", &deep, 1);
+    bench_run("proper list", &proper, BENCH_N);
+    // the walk goes to the end of an improper list before it gives 0
+    bench_run("improper list", &improper, 0);
+    free(deep.ptr);
+    free(proper.ptr);
+    free(improper.ptr);
+    nis_del_symbols();
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "bench.h"
+
+// collection pauses while parsing programs form by form, with the last
+// two programs kept live, stop-the-world against nis_gc_concurrent.  Each
+// form is timed with the safepoint nis_parse_stream takes before it, a
+// form alone parses in microseconds so the tail is the collector's.
+
+#define BENCH_SIZE (4 << 20)
+#define BENCH_ROUNDS 6
+#define BENCH_KEEP 2
+
+struct BenchForms {
+    struct BenchText text;
+    // where each form ends
+    size_t *ends;
+    size_t len;
+};
+
+static void bench_source(struct BenchForms *forms) {
+    uint64_t state = 7;
+    char form[256];
+    size_t cap = 0;
+    while (forms->text.len < BENCH_SIZE) {
+        unsigned n = bench_random(&state) % 100000;
+        int len = snprintf(form, sizeof form,
+                "(define (f-%u a b) (let ((x (+ a %u)) (s \"name %u\")) "
+                "(if (< x b) (list x s %u.5 'sym-%u) (quote (%u a b)))))\n",
+                n, n % 7, n, n % 13, n % 500, n);
+        bench_append(&forms->text, form, len);
+        if (forms->len == cap) {
+            cap = cap ? cap * 2 : 1024;
+            forms->ends = realloc(forms->ends, cap * sizeof(size_t));
+        }
+        forms->ends[forms->len++] = forms->text.len;
+    }
+}
+
+static int bench_compare(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static void bench_run(const char *name, const struct BenchForms *forms, bool concurrent) {
+    NisGc gc;
+    // as main.c sizes it
+    nis_new_gc(&gc, NIS_HEAP_MIN + NIS_HEAP_PER_BYTE * forms->text.len);
+    nis_gc_concurrent(&gc, concurrent);
+    size_t pausec = BENCH_ROUNDS * forms->len;
+    double *pauses = malloc(pausec * sizeof(double));
+    NisValue *programs[BENCH_KEEP] = { NULL };
+    size_t lens[BENCH_KEEP] = { 0 };
+    size_t p = 0;
+    double start = bench_now();
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        int k = round % BENCH_KEEP;
+        if (programs[k]) {
+            nis_gc_remove_root(&gc, &programs[k]);
+        }
+        programs[k] = realloc(programs[k], forms->len * sizeof(NisValue));
+        lens[k] = 0;
+        nis_gc_add_root(&gc, &programs[k], &lens[k]);
+        size_t begin = 0;
+        for (size_t i = 0; i < forms->len; i++) {
+            NisValue *form;
+            size_t len;
+            struct NisLexer lexer;
+            nis_new_lexer(&lexer, forms->text.ptr + begin, forms->ends[i] - begin);
+            double before = bench_now();
+            int status = nis_parse_stream(&form, &len, &gc, &lexer);
+            pauses[p++] = bench_now() - before;
+            if (status || len != 1) {
+                fprintf(stderr, "%s: parse failed\n", name);
+                exit(1);
+            }
+            nis_del_lexer(&lexer);
+            programs[k][lens[k]++] = form[0];
+            free(form);
+            begin = forms->ends[i];
+        }
+    }
+    nis_gc_collect(&gc);
+    double total = bench_now() - start;
+
+    qsort(pauses, pausec, sizeof(double), bench_compare);
+    printf("  %-16s %6.2f s %7.2f ms %7.2f ms %7.2f ms\n", name, total,
+           pauses[pausec * 99 / 100] * 1e3, pauses[pausec * 999 / 1000] * 1e3, pauses[pausec - 1] * 1e3);
+    for (int k = 0; k < BENCH_KEEP; k++) {
+        free(programs[k]);
+    }
+    free(pauses);
+    nis_del_gc(&gc);
+}
+
+int main(void) {
+    struct BenchForms forms = { { NULL, 0, 0 }, NULL, 0 };
+    bench_source(&forms);
+    printf("%d rounds of %zu forms, %d kept   total       p99     p99.9       max\n",
+           BENCH_ROUNDS, forms.len, BENCH_KEEP);
+    bench_run("stop-the-world", &forms, false);
+    bench_run("concurrent", &forms, true);
+    free(forms.text.ptr);
+    free(forms.ends);
+    nis_del_symbols();
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include "bench.h"
+#include "../include/nisc_priv.h"
+
+// validation throughput with the vector scans and with the scalar decoder,
+// on ASCII and on identifiers with non-ASCII letters
+
+#define BENCH_SIZE (8 << 20)
+
+static const char *WORDS[] = {
+    "(define ", "value ", "\xce\xbb-\xce\xb1 ", "\xe6\x97\xa5\xe6\x9c\xac ",
+    "na\xc3\xafve ", "\xf0\x9f\x98\x80 ", ")\n",
+};
+
+static void bench_source(struct BenchText *text, bool ascii) {
+    uint64_t state = 1;
+    size_t wordc = ascii ? 2 : sizeof WORDS / sizeof *WORDS;
+    while (text->len < BENCH_SIZE) {
+        bench_puts(text, WORDS[bench_random(&state) % wordc]);
+    }
+}
+
+static double bench_validate(const struct BenchText *text, bool vectors) {
+    nis_lex_vectors(vectors);
+    double best = 1e9;
+    for (int i = 0; i < 5; i++) {
+        double start = bench_now();
+        if (nis_scan_utf8(text->ptr, 0, text->len) != text->len) {
+            exit(1);
+        }
+        double time = bench_now() - start;
+        best = time < best ? time : best;
+    }
+    return text->len / best / 1e6;
+}
+
+int main(void) {
+    struct BenchText ascii = { NULL, 0, 0 };
+    struct BenchText mixed = { NULL, 0, 0 };
+    bench_source(&ascii, true);
+    bench_source(&mixed, false);
+    printf("UTF-8 validation, best of 5 on %d MB     scalar       vectors\n", BENCH_SIZE >> 20);
+    printf("  ASCII                          %8.0f MB/s %8.0f MB/s\n",
+           bench_validate(&ascii, false), bench_validate(&ascii, true));
+    printf("  mixed identifiers              %8.0f MB/s %8.0f MB/s\n",
+           bench_validate(&mixed, false), bench_validate(&mixed, true));
+    free(ascii.ptr);
+    free(mixed.ptr);
+    return 0;
+}
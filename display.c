@@ -1,7 +1,8 @@
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <tgmath.h>
-#include "include/nisc.h"
+#include "include/nisc_priv.h"
 
 struct DisplayParams {
     size_t count;
@@ -10,150 +11,119 @@ struct DisplayParams {
     const char *newline_char;
 };
 
-static size_t nis_display_inner_tree(char *dest, size_t len, struct DisplayParams *params, NisStree *value) {
-    switch (value->kind) {
-    case NIS_STREE_FALSE: {
-        if (params->count + 2 <= len) {
-            params->count += 2;
-            dest[0] = '#';
-            dest[1] = 'f';
-            return 2;
-        }
-    } break;
-    case NIS_STREE_TRUE: {
-        if (params->count + 2 <= len) {
-            params->count += 2;
-            dest[0] = '#';
-            dest[1] = 't';
-            return 2;
+static size_t nis_format_int(char *dest, long value) {
+    unsigned long num = value < 0 ? 0ul - (unsigned long) value : (unsigned long) value;
+    int digits = 1;
+    for (unsigned long n = num; n >= 10; n /= 10) {
+        ++digits;
+    }
+    size_t count = 0;
+    if (value < 0) {
+        dest[count++] = '-';
+    }
+    for (int i = 1; i <= digits; i++) {
+        dest[count + digits - i] = '0' + num % 10;
+        num /= 10;
+    }
+    return count + digits;
+}
+
+// shortest representation that reads back as the same double
+static size_t nis_format_float(char *dest, size_t len, double value) {
+    if (isnan(value)) {
+        return snprintf(dest, len, "+nan.0");
+    } else if (isinf(value)) {
+        return snprintf(dest, len, value < 0 ? "-inf.0" : "+inf.0");
+    }
+    int count = 0;
+    int prec;
+    for (prec = 1; prec <= 17; prec++) {
+        count = nis_c_format(dest, len, "%.*g", prec, value);
+        if (nis_c_strtod(dest) == value) {
+            break;
         }
-    } break;
+    }
+    double mag = fabs(value);
+    if (strchr(dest, 'e') && mag >= 1e-4 && mag < 1e17) {
+        int decimals = prec - 1 - (int) floor(log10(mag));
+        count = nis_c_format(dest, len, "%.*f", decimals > 0 ? decimals : 0, value);
+    }
+    if (!strpbrk(dest, ".e")) {
+        count += snprintf(dest + count, len - count, ".0");
+    }
+    return count;
+}
+
+static size_t nis_display_text(char *dest, size_t len, struct DisplayParams *params, const char *text, size_t count) {
+    if (params->count + count <= len) {
+        memcpy(dest, text, count);
+        params->count += count;
+        return count;
+    }
+    return 0;
+}
+
+static size_t nis_display_int(char *dest, size_t len, struct DisplayParams *params, long value) {
+    char buffer[32];
+    size_t count = nis_format_int(buffer, value);
+    return nis_display_text(dest, len, params, buffer, count);
+}
+
+static const char *const SPECIAL_NAMES[] = {
+    [NIS_VALUE_LAMBDA] = "lambda",
+    [NIS_VALUE_IF] = "if",
+    [NIS_VALUE_SET] = "set!",
+    [NIS_VALUE_INCLUDE] = "include",
+    [NIS_VALUE_INCLUDE_CI] = "include-ci",
+    [NIS_VALUE_COND] = "cond",
+    [NIS_VALUE_CASE] = "case",
+    [NIS_VALUE_ELSE] = "else",
+    [NIS_VALUE_AND] = "and",
+    [NIS_VALUE_OR] = "or",
+    [NIS_VALUE_UNLESS] = "unless",
+    [NIS_VALUE_COND_EXPAND] = "cond-expand",
+    [NIS_VALUE_LET] = "let",
+    [NIS_VALUE_LET_STAR] = "let*",
+    [NIS_VALUE_LETREC] = "letrec",
+    [NIS_VALUE_LETREC_STAR] = "letrec*",
+    [NIS_VALUE_LET_VALUES] = "let-values",
+    [NIS_VALUE_LET_VALUES_STAR] = "let*-values",
+    [NIS_VALUE_BEGIN] = "begin",
+    [NIS_VALUE_DO] = "do",
+    [NIS_VALUE_LET_LOOP] = "let",
+    [NIS_VALUE_DELAY] = "delay",
+    [NIS_VALUE_DELAY_FORCE] = "delay-force",
+    [NIS_VALUE_FORCE] = "force",
+    [NIS_VALUE_MAKE_PROMISE] = "make-promise",
+    [NIS_VALUE_MAKE_PARAMETER] = "make-parameter",
+    [NIS_VALUE_PARAMETERIZE] = "parameterize",
+    [NIS_VALUE_GUARD] = "guard",
+    [NIS_VALUE_QUOTE] = "quote",
+    [NIS_VALUE_QUASIQUOTE] = "quasiquote",
+    [NIS_VALUE_UNQUOTE] = "unquote",
+    [NIS_VALUE_UNQUOTE_SPLICING] = "unquote-splicing",
+    [NIS_VALUE_CASE_LAMBDA] = "case-lambda",
+    [NIS_VALUE_LET_SYNTAX] = "let-syntax",
+    [NIS_VALUE_LETREC_SYNTAX] = "letrec-syntax",
+    [NIS_VALUE_SYNTAX_RULES] = "syntax-rules",
+    [NIS_VALUE_SYNTAX_ERROR] = "syntax-error",
+};
+
+// trees other than pairs and vectors
+static size_t nis_display_tree_leaf(char *dest, size_t len, struct DisplayParams *params, NisStree *value) {
+    switch (value->kind) {
     case NIS_STREE_INT: {
-        int digits;
-        if (value->vint) {
-            digits = floor(log10(labs(value->vint)) + 1.0);
-        } else {
-            digits = 1;
-        }
-        if (params->count + digits <= len) {
-            params->count += digits;
-            long num = value->vint;
-            if (num < 0) {
-                num = -num;
-                dest[0] = '-';
-                ++dest;
-                ++params->count;
-            }
-            for (int i = 1; i <= digits; i++) {
-                dest[digits - i] = '0' + num % 10;
-                num /= 10;
-            }
-            return digits;
-        }
+        return nis_display_int(dest, len, params, value->vint);
     } break;
     case NIS_STREE_FLOAT: {
-        // TODO
-    } break;
-    case NIS_STREE_NIL: {
-        if (params->count + 2 <= len) {
-            dest[0] = '(';
-            dest[1] = ')';
-            params->count += 2;
-            return 2;
-        }
-    } break;
-    case NIS_STREE_PAIR: {
-        if (nis_list_eh(value)) {
-            size_t count = 0;
-            if (params->count + 1 <= len) {
-                dest[0] = '(';
-                ++dest;
-                ++params->count;
-                ++count;
-            }
-            for (NisStree *list = value, *car = list->vpair.car;
-                 list->kind != NIS_STREE_NIL;
-                 list = list->vpair.cdr, car = list->vpair.car) {
-                size_t c = nis_display_inner_tree(dest, len, params, car);
-                dest += c;
-                count += c;
-                if (params->count + 1 <= len) {
-                    dest[0] = ' ';
-                    ++params->count;
-                    ++dest;
-                    ++count;
-                }
-            }
-            if (count > 2) {
-                dest[-1] = ')';
-            } else if (count == 2 && params->count + 1 <= len) {
-                dest[0] = ')';
-                ++params->count;
-                ++dest;
-                ++count;
-            }
-            return count;
-        } else {
-            size_t count = 0;
-            if (params->count + 1 <= len) {
-                dest[0] = '(';
-                ++dest;
-                ++params->count;
-                ++count;
-            }
-            size_t c = nis_display_inner_tree(dest, len, params, value->vpair.car);
-            dest += c;
-            count += c;
-            if (params->count + 3 <= len) {
-                dest[0] = ' ';
-                dest[1] = '.';
-                dest[2] = ' ';
-                dest += 3;
-                params->count += 3;
-                count += 3;
-            }
-            c = nis_display_inner_tree(dest, len, params, value->vpair.cdr);
-            dest += c;
-            count += c;
-            if (params->count + 1 <= len) {
-                dest[0] = ')';
-                ++dest;
-                ++params->count;
-                ++count;
-            }
+        char buffer[32];
+        size_t count = nis_format_float(buffer, sizeof(buffer), value->vfloat);
+        if (params->count + count <= len) {
+            memcpy(dest, buffer, count);
+            params->count += count;
             return count;
         }
     } break;
-    case NIS_STREE_VECTOR: {
-        size_t count = 0;
-        if (params->count + 2 <= len) {
-            dest[0] = '#';
-            dest[1] = '(';
-            dest += 2;
-            params->count += 2;
-            count += 2;
-        }
-        for (size_t i = 0; i < value->vvec.len; i++) {
-            size_t c = nis_display_inner_tree(dest, len, params, value->vvec.ptr[i]);
-            dest += c;
-            count += c;
-            if (params->count + 1 <= len) {
-                dest[0] = ' ';
-                ++params->count;
-                ++dest;
-                ++count;
-            }
-        }
-        if (count > 2) {
-            dest[-1] = ')';
-        } else if (count == 2 && params->count + 1 <= len) {
-            dest[0] = ')';
-            ++params->count;
-            ++dest;
-            ++count;
-        }
-        return count;
-    } break;
     case NIS_STREE_BYTE_VECTOR: {
         size_t count = 0;
         if (params->count + 4 <= len) {
@@ -199,16 +169,34 @@ static size_t nis_display_inner_tree(char *dest, size_t len, struct DisplayParam
         }
         return count;
     } break;
-    case NIS_STREE_ATOM: {
-        const char *atom;
-        if (value->flags & NIS_FLAG_INLINE) {
-            atom = value->vinline;
-        } else {
-            atom = value->vatom;
+    case NIS_STREE_STRING: {
+        const char *str = value->vstr.ptr;
+        size_t strlen = 2;
+        for (size_t i = 0; i < value->vstr.len; i++) {
+            char ch = str[i];
+            strlen += 1 + (ch == '"' || ch == '\\' || ch == '\n' || ch == '\t');
         }
-        size_t atomlen = strlen(atom);
+        if (params->count + strlen <= len) {
+            size_t j = 0;
+            dest[j++] = '"';
+            for (size_t i = 0; i < value->vstr.len; i++) {
+                char ch = str[i];
+                switch (ch) {
+                case '"': case '\\': dest[j++] = '\\'; dest[j++] = ch; break;
+                case '\n': dest[j++] = '\\'; dest[j++] = 'n'; break;
+                case '\t': dest[j++] = '\\'; dest[j++] = 't'; break;
+                default: dest[j++] = ch; break;
+                }
+            }
+            dest[j++] = '"';
+            params->count += strlen;
+            return strlen;
+        }
+    } break;
+    case NIS_STREE_ATOM: {
+        size_t atomlen = value->vsym->len;
         if (params->count + atomlen <= len) {
-            memcpy(dest, atom, atomlen);
+            memcpy(dest, value->vsym->name, atomlen);
             params->count += atomlen;
             return atomlen;
         }
@@ -217,165 +205,204 @@ static size_t nis_display_inner_tree(char *dest, size_t len, struct DisplayParam
     return 0;
 }
 
-static void nis_display_inner(char *dest, size_t len, struct DisplayParams *params, NisValue *value) {
-    switch (value->kind) {
-    case NIS_VALUE_FALSE: {
-        if (params->count + 2 <= len) {
-            params->count += 2;
-            dest[0] = '#';
-            dest[1] = 'f';
+// everything but pairs and vectors
+static size_t nis_display_leaf(char *dest, size_t len, struct DisplayParams *params, NisValue value) {
+    int kind = nis_value_kind(value);
+    switch (kind) {
+    case NIS_VALUE_FALSE:
+        return nis_display_text(dest, len, params, "#f", 2);
+    case NIS_VALUE_TRUE:
+        return nis_display_text(dest, len, params, "#t", 2);
+    case NIS_VALUE_NIL:
+        return nis_display_text(dest, len, params, "()", 2);
+    case NIS_VALUE_INT:
+        return nis_display_int(dest, len, params, nis_value_int(value));
+    case NIS_VALUE_TREE:
+        return nis_display_tree_leaf(dest, len, params, nis_value_tree(value));
+    default:
+        return nis_display_text(dest, len, params, SPECIAL_NAMES[kind], strlen(SPECIAL_NAMES[kind]));
+    }
+}
+
+enum {
+    NIS_DISPLAY_LIST,
+    NIS_DISPLAY_DOTTED_CAR,
+    NIS_DISPLAY_DOTTED_CDR,
+    NIS_DISPLAY_VECTOR,
+};
+
+// a pair or vector that is being printed
+struct DisplayFrame {
+    int kind;
+    // the rest of the list, or the pair or vector
+    NisValue value;
+    size_t index;
+    // characters written for this frame, children included
+    size_t count;
+};
+
+#define NIS_DISPLAY_FRAMES 32
+
+// the separator after a child `count` characters long
+static size_t nis_display_after(char *dest, size_t len, struct DisplayParams *params, struct DisplayFrame *frame, size_t count) {
+    frame->count += count;
+    switch (frame->kind) {
+    case NIS_DISPLAY_LIST:
+    case NIS_DISPLAY_VECTOR: {
+        if (params->count + 1 <= len) {
+            dest[0] = ' ';
+            ++params->count;
+            ++frame->count;
+            return 1;
         }
     } break;
-    case NIS_VALUE_TRUE: {
-        if (params->count + 2 <= len) {
-            params->count += 2;
-            dest[0] = '#';
-            dest[1] = 't';
+    case NIS_DISPLAY_DOTTED_CAR: {
+        if (params->count + 3 <= len) {
+            dest[0] = ' ';
+            dest[1] = '.';
+            dest[2] = ' ';
+            params->count += 3;
+            frame->count += 3;
+            return 3;
         }
     } break;
-    case NIS_VALUE_INT: {
-        int digits;
-        if (value->vint) {
-            digits = floor(log10(labs(value->vint)) + 1.0);
+    case NIS_DISPLAY_DOTTED_CDR: {
+        if (params->count + 1 <= len) {
+            dest[0] = ')';
+            ++params->count;
+            ++frame->count;
+            return 1;
+        }
+    } break;
+    }
+    return 0;
+}
+
+// turns the trailing space of a list or vector into `)`
+static size_t nis_display_close(char *dest, size_t len, struct DisplayParams *params, struct DisplayFrame *frame) {
+    if (frame->count > 2) {
+        dest[-1] = ')';
+    } else if (frame->count == 2 && params->count + 1 <= len) {
+        dest[0] = ')';
+        ++params->count;
+        ++frame->count;
+        return 1;
+    }
+    return 0;
+}
+
+// iterative so that deep nesting cannot overflow the C stack, the frames
+// live on the stack until the nesting gets deeper than NIS_DISPLAY_FRAMES
+static size_t nis_display_inner(char *dest, size_t len, struct DisplayParams *params, NisValue value) {
+    struct DisplayFrame local[NIS_DISPLAY_FRAMES];
+    struct DisplayFrame *frames = local;
+    size_t cap = NIS_DISPLAY_FRAMES;
+    size_t depth = 0;
+    char *begin = dest;
+    // a cdr reached through a dotted pair is never a proper list, this
+    // saves walking the rest of the chain again at every pair
+    bool improper = false;
+
+    for (;;) {
+        // enter `value`
+        NisStree *tree = nis_tree_eh(value) ? nis_value_tree(value) : NULL;
+        if (tree && (tree->kind == NIS_STREE_PAIR || tree->kind == NIS_STREE_VECTOR)) {
+            if (depth == cap) {
+                cap *= 2;
+                if (frames == local) {
+                    frames = malloc(cap * sizeof(struct DisplayFrame));
+                    memcpy(frames, local, sizeof(local));
+                } else {
+                    frames = realloc(frames, cap * sizeof(struct DisplayFrame));
+                }
+            }
+            struct DisplayFrame *frame = frames + depth++;
+            frame->value = value;
+            frame->index = 0;
+            frame->count = 0;
+            if (tree->kind == NIS_STREE_VECTOR) {
+                frame->kind = NIS_DISPLAY_VECTOR;
+                if (params->count + 2 <= len) {
+                    dest[0] = '#';
+                    dest[1] = '(';
+                    dest += 2;
+                    params->count += 2;
+                    frame->count += 2;
+                }
+            } else {
+                frame->kind = !improper && nis_list_eh(tree) ? NIS_DISPLAY_LIST : NIS_DISPLAY_DOTTED_CAR;
+                if (params->count + 1 <= len) {
+                    dest[0] = '(';
+                    ++dest;
+                    ++params->count;
+                    ++frame->count;
+                }
+            }
         } else {
-            digits = 1;
+            size_t c = nis_display_leaf(dest, len, params, value);
+            dest += c;
+            if (depth == 0) {
+                break;
+            }
+            dest += nis_display_after(dest, len, params, frames + depth - 1, c);
         }
-        if (params->count + digits <= len) {
-            params->count += digits;
-            long num = value->vint;
-            int sign = 0;
-            if (num < 0) {
-                num = -num;
-                dest[0] = '-';
-                sign = 1;
-                ++params->count;
+
+        // pick the next child, closing every frame that is done
+        bool next = false;
+        while (depth > 0 && !next) {
+            struct DisplayFrame *frame = frames + depth - 1;
+            NisStree *tree = nis_tree_eh(frame->value) ? nis_value_tree(frame->value) : NULL;
+            improper = false;
+            next = true;
+            switch (frame->kind) {
+            case NIS_DISPLAY_LIST: {
+                if (tree) {
+                    value = tree->vpair.car;
+                    frame->value = tree->vpair.cdr;
+                    continue;
+                }
+                dest += nis_display_close(dest, len, params, frame);
+            } break;
+            case NIS_DISPLAY_VECTOR: {
+                if (frame->index < tree->vvec.len) {
+                    value = tree->vvec.ptr[frame->index++];
+                    continue;
+                }
+                dest += nis_display_close(dest, len, params, frame);
+            } break;
+            case NIS_DISPLAY_DOTTED_CAR: {
+                if (frame->index == 0) {
+                    frame->index = 1;
+                    value = tree->vpair.car;
+                } else {
+                    frame->kind = NIS_DISPLAY_DOTTED_CDR;
+                    value = tree->vpair.cdr;
+                    improper = true;
+                }
+                continue;
             }
-            for (int i = 1; i <= digits; i++) {
-                dest[sign + digits - i] = '0' + num % 10;
-                num /= 10;
+            case NIS_DISPLAY_DOTTED_CDR:
+                break;
             }
+            next = false;
+
+            // the frame is closed, it counts as a child of its parent
+            size_t c = frame->count;
+            --depth;
+            if (depth == 0) {
+                break;
+            }
+            dest += nis_display_after(dest, len, params, frames + depth - 1, c);
         }
-    } break;
-    case NIS_VALUE_FLOAT: {
-        // TODO
-    } break;
-    case NIS_VALUE_TREE: {
-        nis_display_inner_tree(dest, len, params, value->vtree);
-    } break;
-#define DISPLAY_SPECIAL(x) if (params->count + strlen(x) <= len) strcpy(dest, x);
-    case NIS_VALUE_LAMBDA: {
-        DISPLAY_SPECIAL("lambda")
-    } break;
-    case NIS_VALUE_IF: {
-        DISPLAY_SPECIAL("if")
-    } break;
-    case NIS_VALUE_SET: {
-        DISPLAY_SPECIAL("set!")
-    } break;
-    case NIS_VALUE_INCLUDE: {
-        DISPLAY_SPECIAL("include")
-    } break;
-    case NIS_VALUE_INCLUDE_CI: {
-        DISPLAY_SPECIAL("include-ci")
-    } break;
-    case NIS_VALUE_COND: {
-        DISPLAY_SPECIAL("cond")
-    } break;
-    case NIS_VALUE_CASE: {
-        DISPLAY_SPECIAL("case")
-    } break;
-    case NIS_VALUE_ELSE: {
-        DISPLAY_SPECIAL("else")
-    } break;
-    case NIS_VALUE_AND: {
-        DISPLAY_SPECIAL("and")
-    } break;
-    case NIS_VALUE_OR: {
-        DISPLAY_SPECIAL("or")
-    } break;
-    case NIS_VALUE_UNLESS: {
-        DISPLAY_SPECIAL("unless")
-    } break;
-    case NIS_VALUE_COND_EXPAND: {
-        DISPLAY_SPECIAL("cond-expand")
-    } break;
-    case NIS_VALUE_LET: {
-        DISPLAY_SPECIAL("let")
-    } break;
-    case NIS_VALUE_LET_STAR: {
-        DISPLAY_SPECIAL("let*")
-    } break;
-    case NIS_VALUE_LETREC: {
-        DISPLAY_SPECIAL("letrec")
-    } break;
-    case NIS_VALUE_LETREC_STAR: {
-        DISPLAY_SPECIAL("letrec*")
-    } break;
-    case NIS_VALUE_LET_VALUES: {
-        DISPLAY_SPECIAL("let-values")
-    } break;
-    case NIS_VALUE_LET_VALUES_STAR: {
-        DISPLAY_SPECIAL("let*-values")
-    } break;
-    case NIS_VALUE_BEGIN: {
-        DISPLAY_SPECIAL("begin")
-    } break;
-    case NIS_VALUE_DO: {
-        DISPLAY_SPECIAL("do")
-    } break;
-    case NIS_VALUE_LET_LOOP: {
-        DISPLAY_SPECIAL("let")
-    } break;
-    case NIS_VALUE_DELAY: {
-        DISPLAY_SPECIAL("delay")
-    } break;
-    case NIS_VALUE_DELAY_FORCE: {
-        DISPLAY_SPECIAL("delay-force")
-    } break;
-    case NIS_VALUE_FORCE: {
-        DISPLAY_SPECIAL("force")
-    } break;
-    case NIS_VALUE_MAKE_PROMISE: {
-        DISPLAY_SPECIAL("make-promise")
-    } break;
-    case NIS_VALUE_MAKE_PARAMETER: {
-        DISPLAY_SPECIAL("make-parameter")
-    } break;
-    case NIS_VALUE_PARAMETERIZE: {
-        DISPLAY_SPECIAL("parameterize")
-    } break;
-    case NIS_VALUE_GUARD: {
-        DISPLAY_SPECIAL("guard")
-    } break;
-    case NIS_VALUE_QUOTE: {
-        DISPLAY_SPECIAL("quote")
-    } break;
-    case NIS_VALUE_QUASIQUOTE: {
-        DISPLAY_SPECIAL("quasiquote")
-    } break;
-    case NIS_VALUE_UNQUOTE: {
-        DISPLAY_SPECIAL("unquote")
-    } break;
-    case NIS_VALUE_UNQUOTE_SPLICING: {
-        DISPLAY_SPECIAL("unquote-splicing")
-    } break;
-    case NIS_VALUE_CASE_LAMBDA: {
-        DISPLAY_SPECIAL("case-lambda")
-    } break;
-    case NIS_VALUE_LET_SYNTAX: {
-        DISPLAY_SPECIAL("let-syntax")
-    } break;
-    case NIS_VALUE_LETREC_SYNTAX: {
-        DISPLAY_SPECIAL("letrec-syntax")
-    } break;
-    case NIS_VALUE_SYNTAX_RULES: {
-        DISPLAY_SPECIAL("syntax-rules")
-    } break;
-    case NIS_VALUE_SYNTAX_ERROR: {
-        DISPLAY_SPECIAL("syntax-error")
-    } break;
+        if (!next) {
+            break;
+        }
+    }
+
+    if (frames != local) {
+        free(frames);
     }
-#undef DISPLAY_SPECIAL
+    return dest - begin;
 }
 
 size_t nis_display(char *dest, size_t len, NisValue *value) {
@@ -385,7 +412,7 @@ size_t nis_display(char *dest, size_t len, NisValue *value) {
         .indent_char = " ",
         .newline_char = "\n",
     };
-    nis_display_inner(dest, len - 1, &params, value);
+    nis_display_inner(dest, len - 1, &params, *value);
     dest[params.count] = 0;
     return params.count;
 }
@@ -402,7 +429,7 @@ size_t nis_hlbc_display(char *dest, size_t len, NisHlprog *prog) {
         end = false;
         NisHlfun *fun = prog->funv + i;
         DISPLAY_STR("(define (");
-        DISPLAY_STR(fun->name);
+        DISPLAY_STR(fun->name->name);
         DISPLAY_STR(")");
         for (size_t j = 0; j < fun->insc; j++) {
             NisHlbc *ins = fun->insv + j;
@@ -540,10 +567,7 @@ size_t nis_hlbc_display(char *dest, size_t len, NisHlprog *prog) {
             if (ins->target >= 0) {
                 DISPLAY_STR(" @");
                 params.count = count;
-                NisValue pseudo;
-                pseudo.kind = NIS_VALUE_INT;
-                pseudo.vint = ins->target;
-                nis_display_inner(dest + count, len, &params, &pseudo);
+                nis_display_int(dest + count, len, &params, ins->target);
                 count = params.count;
             }
             
@@ -553,23 +577,17 @@ size_t nis_hlbc_display(char *dest, size_t len, NisHlprog *prog) {
                 switch (arg->kind) {
                 case NIS_HLBC_ARG_VALUE: {
                     params.count = count;
-                    nis_display_inner(dest + count, len, &params, &arg->value);
+                    nis_display_inner(dest + count, len, &params, arg->value);
                 } break;
                 case NIS_HLBC_ARG_REGISTER: {
                     DISPLAY_STR("%");
                     params.count = count;
-                    NisValue pseudo;
-                    pseudo.kind = NIS_VALUE_INT;
-                    pseudo.vint = arg->ssreg;
-                    nis_display_inner(dest + count, len, &params, &pseudo);
+                    nis_display_int(dest + count, len, &params, arg->ssreg);
                 } break;
                 case NIS_HLBC_ARG_PROPER: {
                     DISPLAY_STR("%");
                     params.count = count;
-                    NisValue pseudo;
-                    pseudo.kind = NIS_VALUE_INT;
-                    pseudo.vint = -1 - arg->ssarg;
-                    nis_display_inner(dest + count, len, &params, &pseudo);
+                    nis_display_int(dest + count, len, &params, -1 - arg->ssarg);
                 } break;
                 }
                 count = params.count;
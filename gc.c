@@ -1,269 +1,1849 @@
+#define _DEFAULT_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
 #include "include/nisc.h"
 
-void nis_new_gc(NisGc *dest, size_t capacity) {
-    dest->buffer = malloc(capacity);
-    dest->len = sizeof(struct NisAllocFrame);
-    dest->capacity = capacity;
-    dest->prev = dest->buffer;
-    dest->prev->next = NULL;
-    dest->prev->len = capacity;
-
-    dest->nil = nis_alloc(dest, sizeof(NisStree));
-    dest->nil->kind = NIS_STREE_NIL;
-    dest->nil->flags = 0;
-    dest->nil->next = NULL;
-    
-    dest->t = nis_alloc(dest, sizeof(NisStree));
-    dest->t->kind = NIS_STREE_TRUE;
-    dest->t->flags = 0;
-    dest->t->next = NULL;
-    
-    dest->f = nis_alloc(dest, sizeof(NisStree));
-    dest->f->kind = NIS_STREE_FALSE;
-    dest->f->flags = 0;
-    dest->f->next = NULL;
-
-    dest->last = NULL;
-    dest->allocated = 0;
-    dest->threshold = capacity / sizeof(NisStree) >> 3;
+// chunk lengths are rounded to this, a huge page when those are asked for
+#ifdef NIS_HUGEPAGES
+#define NIS_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define NIS_CHUNK_ALIGN NIS_HUGE_PAGE_SIZE
+#else
+#define NIS_CHUNK_ALIGN (64 * 1024)
+#endif
+// shorter free runs are kept resident
+#define NIS_RELEASE_MIN (256 * 1024)
+
+static const uint32_t CLASS_SIZES[NIS_SIZE_CLASSES] = {
+    8, 16, 24, 32, 40, 48, 56, 64, 72, 80, 88, 96, 104, 112, 120, 128,
+    160, 192, 224, 256, 320, 384, 448, 512, 640, 768, 896, 1024,
+};
+
+static const uint32_t CELL_SIZES[NIS_CELLS] = { 16, 24, 32 };
+
+// the smallest cell that holds the header and the union member of a kind
+static const unsigned char TREE_CELLS[] = {
+    [NIS_STREE_INT] = NIS_CELL_16,
+    [NIS_STREE_FLOAT] = NIS_CELL_16,
+    [NIS_STREE_ATOM] = NIS_CELL_16,
+    [NIS_STREE_PAIR] = NIS_CELL_24,
+    [NIS_STREE_STRING] = NIS_CELL_24,
+    [NIS_STREE_VECTOR] = NIS_CELL_32,
+    [NIS_STREE_BYTE_VECTOR] = NIS_CELL_32,
+};
+
+static inline size_t nis_tree_size(int kind) {
+    return CELL_SIZES[TREE_CELLS[kind]];
 }
 
-void nis_del_gc(NisGc *dest) {
-    free(dest->buffer);
+// `size` must be in 1..NIS_SMALL_MAX
+static inline unsigned nis_size_class(size_t size) {
+    if (size <= 128) {
+        return (size - 1) / 8;
+    }
+    unsigned log = 63 - __builtin_clzll(size - 1);
+    return 16 + (log - 7) * 4 + (((size - 1) >> (log - 2)) & 3);
 }
 
-void *nis_alloc(NisGc *gc, size_t size) {
-    if (size == 0) {
+// `chunks` must be ordered by address
+static struct NisChunk *nis_search_chunks(struct NisChunk *chunks, size_t chunkc, const void *ptr) {
+    size_t lo = 0;
+    size_t hi = chunkc;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        struct NisChunk *chunk = chunks + mid;
+        if ((const char *) ptr < chunk->base) {
+            hi = mid;
+        } else if ((const char *) ptr >= chunk->base + chunk->len) {
+            lo = mid + 1;
+        } else {
+            return chunk;
+        }
+    }
+    return NULL;
+}
+
+// finds the chunk holding `ptr`, NULL if it is not on this heap
+static inline struct NisChunk *nis_find_chunk(NisGc *gc, const void *ptr) {
+    return nis_search_chunks(gc->chunks, gc->chunkc, ptr);
+}
+
+static inline struct NisPage *nis_chunk_page(struct NisChunk *chunk, const void *ptr) {
+    return chunk->pages + ((const char *) ptr - chunk->base) / NIS_PAGE_SIZE;
+}
+
+// `ptr` must be on this heap
+static inline struct NisPage *nis_page(NisGc *gc, const void *ptr) {
+    return nis_chunk_page(nis_find_chunk(gc, ptr), ptr);
+}
+
+static void *nis_alloc_pages(NisGc *gc, size_t size, struct NisChunk **chunkp);
+static void nis_dealloc_pages(struct NisChunk *chunk, void *ptr, size_t size);
+
+static inline bool nis_page_free_eh(struct NisChunk *chunk, size_t j) {
+    return chunk->freemap[j / 64] >> j % 64 & 1;
+}
+
+// sets or clears the free bits of pages `j` to `j + n`
+static void nis_set_free(struct NisChunk *chunk, size_t j, size_t n, bool on) {
+    while (n) {
+        size_t k = 64 - j % 64 < n ? 64 - j % 64 : n;
+        uint64_t mask = (k == 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << k) - 1) << j % 64;
+        if (on) {
+            chunk->freemap[j / 64] |= mask;
+        } else {
+            chunk->freemap[j / 64] &= ~mask;
+        }
+        j += k;
+        n -= k;
+    }
+}
+
+// tags pages `j` to `j + n`, whose free bits are set, as one free run.  The
+// first and last page carry its length, so a neighbour finds either end
+// without a walk.
+static inline void nis_free_run(struct NisChunk *chunk, size_t j, size_t n) {
+    chunk->pages[j].sizeclass = NIS_PAGE_FREE;
+    chunk->pages[j].run = n;
+    chunk->pages[j + n - 1].sizeclass = NIS_PAGE_FREE;
+    chunk->pages[j + n - 1].run = n;
+}
+
+// the first free page from `j` on, the page count if there is none
+static size_t nis_next_free(struct NisChunk *chunk, size_t j) {
+    size_t pagec = chunk->len / NIS_PAGE_SIZE;
+    size_t words = (pagec + 63) / 64;
+    size_t w = j / 64;
+    if (w >= words) {
+        return pagec;
+    }
+    uint64_t bits = chunk->freemap[w] & ~(uint64_t) 0 << j % 64;
+    while (!bits) {
+        if (++w == words) {
+            return pagec;
+        }
+        bits = chunk->freemap[w];
+    }
+    return w * 64 + __builtin_ctzll(bits);
+}
+
+static void *nis_map(size_t len) {
+#ifdef NIS_HUGEPAGES
+    // map one huge page more than needed and trim both ends so the chunk
+    // starts on a huge page boundary
+    char *ptr = mmap(NULL, len + NIS_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
         return NULL;
     }
-    
-    size = nis_align_up(size, 8);
-    if (gc->len + size >= gc->capacity) {
+    char *base = (char *) nis_align_up((uintptr_t) ptr, NIS_HUGE_PAGE_SIZE);
+    if (base > ptr) {
+        munmap(ptr, base - ptr);
+    }
+    munmap(base + len, ptr + NIS_HUGE_PAGE_SIZE - base);
+    madvise(base, len, MADV_HUGEPAGE);
+    return base;
+#else
+    void *ptr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return ptr == MAP_FAILED ? NULL : ptr;
+#endif
+}
+
+// puts `chunk` in address order among the chunks of the heap
+static struct NisChunk *nis_insert_chunk(NisGc *gc, const struct NisChunk *chunk) {
+    size_t i = gc->chunkc;
+    while (i > 0 && gc->chunks[i - 1].base > chunk->base) {
+        --i;
+    }
+    gc->chunks = realloc(gc->chunks, (gc->chunkc + 1) * sizeof(struct NisChunk));
+    memmove(gc->chunks + i + 1, gc->chunks + i, (gc->chunkc - i) * sizeof(struct NisChunk));
+    ++gc->chunkc;
+    gc->capacity += chunk->len;
+    gc->chunks[i] = *chunk;
+
+    // the sweep cursors stay on the chunk they were on
+    for (unsigned cell = 0; cell < NIS_CELLS; cell++) {
+        if (i <= gc->cells[cell].sweepchunk) {
+            ++gc->cells[cell].sweepchunk;
+        }
+    }
+    return gc->chunks + i;
+}
+
+// maps a chunk of at least `len` bytes and adds it to the heap
+static struct NisChunk *nis_add_chunk(NisGc *gc, size_t len) {
+    len = nis_align_up(len, NIS_CHUNK_ALIGN);
+    char *base = nis_map(len);
+    if (!base) {
+        fprintf(stderr, "nisc:%s:%d: error: out of memory\n", __FILE__, __LINE__);
+        exit(1);
+    }
+
+    struct NisChunk mapped;
+    struct NisChunk *chunk = &mapped;
+    chunk->base = base;
+    chunk->len = len;
+    chunk->freepages = len / NIS_PAGE_SIZE;
+    chunk->freemap = calloc((chunk->freepages + 63) / 64, sizeof(uint64_t));
+    chunk->pages = malloc(chunk->freepages * sizeof(struct NisPage));
+    for (size_t j = 0; j < chunk->freepages; j++) {
+        chunk->pages[j].sizeclass = NIS_PAGE_FREE;
+        chunk->pages[j].epoch = 0;
+        chunk->pages[j].freec = 0;
+        chunk->pages[j].run = 0;
+    }
+    chunk->used = calloc(chunk->freepages * NIS_TREE_WORDS, sizeof(uint64_t));
+    chunk->marks = calloc(chunk->freepages * NIS_TREE_WORDS, sizeof(uint64_t));
+    chunk->owns = calloc(chunk->freepages * NIS_TREE_WORDS, sizeof(uint64_t));
+    chunk->spans = calloc(chunk->freepages, sizeof(NisView *));
+    nis_set_free(chunk, 0, chunk->freepages, true);
+    nis_free_run(chunk, 0, chunk->freepages);
+    return nis_insert_chunk(gc, chunk);
+}
+
+void nis_new_gc(NisGc *dest, size_t capacity) {
+    dest->chunks = NULL;
+    dest->chunkc = 0;
+    for (unsigned cell = 0; cell < NIS_CELLS; cell++) {
+        dest->cells[cell].page = NULL;
+        dest->cells[cell].used = NULL;
+        dest->cells[cell].marks = NULL;
+        dest->cells[cell].slot = 0;
+        dest->cells[cell].sweepchunk = 0;
+        dest->cells[cell].sweeppage = 0;
+    }
+    dest->epoch = 0;
+    dest->len = 0;
+    dest->capacity = 0;
+    for (size_t i = 0; i < NIS_SIZE_CLASSES; i++) {
+        dest->classes[i].free = NULL;
+        dest->classes[i].cursor = NULL;
+        dest->classes[i].limit = NULL;
+        dest->classes[i].pagec = 0;
+        dest->classes[i].live = 0;
+    }
+    nis_add_chunk(dest, capacity);
+
+    dest->nursery = nis_map(NIS_NURSERY_SIZE);
+    // the smallest cell is 16 bytes, and a span too
+    dest->nurseryspans = nis_map(NIS_NURSERY_SIZE);
+    if (!dest->nursery || !dest->nurseryspans) {
         fprintf(stderr, "nisc:%s:%d: error: out of memory\n", __FILE__, __LINE__);
         exit(1);
     }
+    dest->nurserylen = 0;
+    dest->minors = 0;
+    dest->remembered = NULL;
+    dest->rememberedc = 0;
+    dest->rememberedcap = 0;
+
+    dest->allocated = 0;
+    dest->threshold = dest->capacity >> 3;
+    dest->concurrent = false;
+    dest->cycle = NULL;
+
+
+    dest->roots = NULL;
+    dest->rootc = 0;
+    dest->weaks = NULL;
+    dest->weakc = 0;
+    dest->tables = NULL;
+    dest->tablec = 0;
+    dest->images = NULL;
+    dest->imagec = 0;
+
+    memset(&dest->counters, 0, sizeof dest->counters);
+}
+
+static void nis_gc_finish_mark(NisGc *gc);
+static void nis_finish_sweep(NisGc *heap);
+
+void nis_del_gc(NisGc *dest) {
+    if (dest->cycle) {
+        nis_gc_finish_mark(dest);
+    }
+    free(dest->roots);
+    free(dest->weaks);
+    free(dest->tables);
+    for (size_t i = 0; i < dest->imagec; i++) {
+        munmap(dest->images[i].base, dest->images[i].len);
+    }
+    free(dest->images);
+    free(dest->remembered);
+    if (dest->nursery) {
+        munmap(dest->nursery, NIS_NURSERY_SIZE);
+        munmap(dest->nurseryspans, NIS_NURSERY_SIZE);
+    }
+    for (size_t i = 0; i < dest->chunkc; i++) {
+        free(dest->chunks[i].pages);
+        free(dest->chunks[i].used);
+        free(dest->chunks[i].marks);
+        free(dest->chunks[i].owns);
+        free(dest->chunks[i].freemap);
+        for (size_t j = 0; j < dest->chunks[i].len / NIS_PAGE_SIZE; j++) {
+            free(dest->chunks[i].spans[j]);
+        }
+        free(dest->chunks[i].spans);
+        munmap(dest->chunks[i].base, dest->chunks[i].len);
+    }
+    free(dest->chunks);
+}
+
+static void nis_add_counters(struct NisGcCounters *sum, const struct NisGcCounters *counters) {
+    for (size_t i = 0; i < NIS_STREE_KINDS; i++) {
+        sum->trees[i] += counters->trees[i];
+    }
+    sum->promoted += counters->promoted;
+    for (size_t i = 0; i <= NIS_SIZE_CLASSES; i++) {
+        sum->allocs[i] += counters->allocs[i];
+        sum->allocbytes[i] += counters->allocbytes[i];
+    }
+    // regions fill up side by side, so their peaks add up
+    sum->peak += counters->peak;
+    sum->majors += counters->majors;
+    sum->minorns += counters->minorns;
+    sum->minormax = counters->minormax > sum->minormax ? counters->minormax : sum->minormax;
+    sum->majorns += counters->majorns;
+    sum->majormax = counters->majormax > sum->majormax ? counters->majormax : sum->majormax;
+}
+
+// a region that registered nothing has NULL lists, which memcpy must not get
+static void nis_add_roots(struct NisGcRoot **dest, size_t *len, const struct NisGcRoot *roots, size_t rootc) {
+    if (rootc == 0) {
+        return;
+    }
+    *dest = realloc(*dest, (*len + rootc) * sizeof(struct NisGcRoot));
+    memcpy(*dest + *len, roots, rootc * sizeof(struct NisGcRoot));
+    *len += rootc;
+}
+
+// moves the chunks, free lists and registrations of `region`, a heap that
+// another thread allocated from on its own, into `gc`, which allocates
+// from them and sweeps them like its own from then on.  `region` must have
+// an empty nursery and is used up.
+void nis_gc_adopt(NisGc *gc, NisGc *region) {
+    // a mark in the background only knows the chunks it started with
+    if (gc->cycle) {
+        nis_gc_finish_mark(gc);
+    }
+    if (region->cycle) {
+        nis_gc_finish_mark(region);
+    }
+    // the marks left on unswept pages would read as live to the next mark
+    // of `gc`, and all that is left counts as allocated since its last one
+    nis_finish_sweep(region);
+    for (size_t i = 0; i < region->chunkc; i++) {
+        struct NisChunk *chunk = region->chunks + i;
+        for (size_t j = 0; j < chunk->len / NIS_PAGE_SIZE; j++) {
+            chunk->pages[j].epoch = gc->epoch;
+        }
+        nis_insert_chunk(gc, chunk);
+    }
+    free(region->chunks);
+
+    for (size_t i = 0; i < NIS_SIZE_CLASSES; i++) {
+        struct NisSizeClass *class = gc->classes + i;
+        struct NisSizeClass *from = region->classes + i;
+        // the rest of the newest page goes on the free list
+        for (char *ptr = from->cursor; ptr && ptr + CLASS_SIZES[i] <= from->limit; ptr += CLASS_SIZES[i]) {
+            *(void **) ptr = from->free;
+            from->free = ptr;
+        }
+        if (from->free) {
+            void **tail = from->free;
+            while (*tail) {
+                tail = *tail;
+            }
+            *tail = class->free;
+            class->free = from->free;
+        }
+        class->pagec += from->pagec;
+        class->live += from->live;
+    }
+    gc->len += region->len;
+    gc->allocated += region->allocated;
+    gc->minors += region->minors;
+    nis_add_counters(&gc->counters, &region->counters);
+
+    nis_add_roots(&gc->roots, &gc->rootc, region->roots, region->rootc);
+    nis_add_roots(&gc->weaks, &gc->weakc, region->weaks, region->weakc);
+    if (region->tablec) {
+        gc->tables = realloc(gc->tables, (gc->tablec + region->tablec) * sizeof(NisWeakTable *));
+        memcpy(gc->tables + gc->tablec, region->tables, region->tablec * sizeof(NisWeakTable *));
+        gc->tablec += region->tablec;
+    }
+    if (region->imagec) {
+        gc->images = realloc(gc->images, (gc->imagec + region->imagec) * sizeof(struct NisGcImage));
+        memcpy(gc->images + gc->imagec, region->images, region->imagec * sizeof(struct NisGcImage));
+        gc->imagec += region->imagec;
+    }
+
+    free(region->roots);
+    free(region->weaks);
+    free(region->tables);
+    free(region->images);
+    free(region->remembered);
+    munmap(region->nursery, NIS_NURSERY_SIZE);
+    munmap(region->nurseryspans, NIS_NURSERY_SIZE);
+}
+
+void nis_gc_add_root(NisGc *gc, NisValue **values, size_t *len) {
+    gc->roots = realloc(gc->roots, (gc->rootc + 1) * sizeof(struct NisGcRoot));
+    gc->roots[gc->rootc].values = values;
+    gc->roots[gc->rootc].len = len;
+    ++gc->rootc;
+}
+
+void nis_gc_remove_root(NisGc *gc, NisValue **values) {
+    for (size_t i = gc->rootc; i-- > 0;) {
+        if (gc->roots[i].values == values) {
+            gc->roots[i] = gc->roots[--gc->rootc];
+            return;
+        }
+    }
+}
+
+void nis_gc_add_weak(NisGc *gc, NisValue **values, size_t *len) {
+    gc->weaks = realloc(gc->weaks, (gc->weakc + 1) * sizeof(struct NisGcRoot));
+    gc->weaks[gc->weakc].values = values;
+    gc->weaks[gc->weakc].len = len;
+    ++gc->weakc;
+}
+
+void nis_gc_remove_weak(NisGc *gc, NisValue **values) {
+    for (size_t i = gc->weakc; i-- > 0;) {
+        if (gc->weaks[i].values == values) {
+            gc->weaks[i] = gc->weaks[--gc->weakc];
+            return;
+        }
+    }
+}
+
+void nis_gc_add_image(NisGc *gc, void *base, size_t len, NisStree *trees, size_t treec) {
+    gc->images = realloc(gc->images, (gc->imagec + 1) * sizeof(struct NisGcImage));
+    gc->images[gc->imagec].base = base;
+    gc->images[gc->imagec].len = len;
+    gc->images[gc->imagec].trees = trees;
+    gc->images[gc->imagec].treec = treec;
+    ++gc->imagec;
+}
+
+#define NIS_WEAK_TABLE_SIZE 16
+
+void nis_new_weak_table(NisWeakTable *dest, NisGc *gc) {
+    dest->cap = NIS_WEAK_TABLE_SIZE;
+    dest->slots = calloc(dest->cap, sizeof(struct NisWeakEntry));
+    dest->count = 0;
+    dest->young = 0;
+    gc->tables = realloc(gc->tables, (gc->tablec + 1) * sizeof(NisWeakTable *));
+    gc->tables[gc->tablec++] = dest;
+}
+
+// `gc` is the heap the table was made on
+void nis_del_weak_table(NisWeakTable *table, NisGc *gc) {
+    for (size_t i = gc->tablec; i-- > 0;) {
+        if (gc->tables[i] == table) {
+            gc->tables[i] = gc->tables[--gc->tablec];
+            break;
+        }
+    }
+    free(table->slots);
+}
+
+struct MarkStack {
+    // owned
+    NisStree **trees;
+    size_t len;
+    size_t cap;
+};
+
+static inline void nis_stack_push(struct MarkStack *stack, NisStree *tree) {
+    if (stack->len == stack->cap) {
+        stack->cap = stack->cap ? 2 * stack->cap : 256;
+        stack->trees = realloc(stack->trees, stack->cap * sizeof(NisStree *));
+    }
+    stack->trees[stack->len++] = tree;
+}
 
-    struct NisAllocFrame **prev = &gc->prev;
-    struct NisAllocFrame *frame = gc->prev;
-    while (frame) {
-        if (frame->len >= size) {
-            if (frame->len - size < sizeof(struct NisAllocFrame)) {
-                void *ptr = frame;
-                *prev = frame->next;
-                return ptr;
+struct Marker {
+    struct MarkStack stack;
+    // borrowed
+    NisGc *gc;
+    struct NisChunk *chunk;
+    size_t live;
+};
+
+static inline size_t nis_tree_index(struct NisChunk *chunk, const NisStree *tree) {
+    size_t offset = (const char *) tree - chunk->base;
+    size_t j = offset / NIS_PAGE_SIZE;
+    size_t slot;
+    // one case per cell size, so the compiler divides by constants
+    switch (chunk->pages[j].sizeclass - NIS_PAGE_TREES) {
+    case NIS_CELL_16:
+        slot = offset % NIS_PAGE_SIZE / 16;
+        break;
+    case NIS_CELL_24:
+        slot = offset % NIS_PAGE_SIZE / 24;
+        break;
+    default:
+        slot = offset % NIS_PAGE_SIZE / 32;
+        break;
+    }
+    return j * NIS_TREE_WORDS * 64 + slot;
+}
+
+static inline void nis_mark_push(struct Marker *marker, NisValue value) {
+    if (!nis_tree_eh(value)) {
+        return;
+    }
+    NisStree *tree = nis_value_tree(value);
+    struct NisChunk *chunk = marker->chunk;
+    if ((const char *) tree < chunk->base || (const char *) tree >= chunk->base + chunk->len) {
+        chunk = nis_find_chunk(marker->gc, tree);
+        if (!chunk) {
+            return;
+        }
+        marker->chunk = chunk;
+    }
+    size_t index = nis_tree_index(chunk, tree);
+    uint64_t bit = (uint64_t) 1 << index % 64;
+    if (chunk->marks[index / 64] & bit) {
+        return;
+    }
+    chunk->marks[index / 64] |= bit;
+    marker->live += nis_tree_size(tree->kind);
+    if (tree->kind == NIS_STREE_PAIR || tree->kind == NIS_STREE_VECTOR) {
+        nis_stack_push(&marker->stack, tree);
+    }
+}
+
+static void nis_mark_roots(struct Marker *marker, NisGc *heap) {
+    for (size_t i = 0; i < heap->rootc; i++) {
+        NisValue *values = *heap->roots[i].values;
+        size_t len = *heap->roots[i].len;
+        for (size_t j = 0; j < len; j++) {
+            nis_mark_push(marker, values[j]);
+        }
+    }
+    // image trees are in no chunk, the mark never gets past them but
+    // starts again at their fields
+    for (size_t i = 0; i < heap->imagec; i++) {
+        struct NisGcImage *image = heap->images + i;
+        for (size_t j = 0; j < image->treec; j++) {
+            nis_stack_push(&marker->stack, image->trees + j);
+        }
+    }
+}
+
+// the bits are set on push, so only trees with fields are ever pushed and
+// the objects themselves are only read
+static void nis_mark(struct Marker *marker) {
+    struct MarkStack *stack = &marker->stack;
+    while (stack->len) {
+        NisStree *tree = stack->trees[--stack->len];
+        switch (tree->kind) {
+        case NIS_STREE_PAIR: {
+            nis_mark_push(marker, tree->vpair.cdr);
+            nis_mark_push(marker, tree->vpair.car);
+        } break;
+        case NIS_STREE_VECTOR: {
+            for (size_t i = 0; i < tree->vvec.len; i++) {
+                nis_mark_push(marker, tree->vvec.ptr[i]);
+            }
+        } break;
+        }
+    }
+}
+
+// where the span of `tree` is kept, the array of its page is made on
+// first use
+static NisView *nis_span_slot(NisGc *gc, struct NisChunk *chunk, const NisStree *tree) {
+    if (nis_young_eh(gc, tree)) {
+        return gc->nurseryspans + ((const char *) tree - gc->nursery) / 16;
+    }
+    size_t index = nis_tree_index(chunk, tree);
+    NisView **spans = chunk->spans + index / (NIS_TREE_WORDS * 64);
+    if (!*spans) {
+        *spans = malloc(NIS_TREE_SLOTS * sizeof(NisView));
+    }
+    return *spans + index % (NIS_TREE_WORDS * 64);
+}
+
+void nis_set_span(NisGc *gc, NisStree *tree, const NisView *span) {
+    *nis_span_slot(gc, nis_young_eh(gc, tree) ? NULL : nis_find_chunk(gc, tree), tree) = *span;
+    tree->flags |= NIS_FLAG_SPAN;
+}
+
+bool nis_span(NisView *dest, NisGc *gc, const NisStree *tree) {
+    if (!(tree->flags & NIS_FLAG_SPAN)) {
+        return false;
+    }
+    struct NisChunk *chunk = NULL;
+    if (!nis_young_eh(gc, tree)) {
+        chunk = nis_find_chunk(gc, tree);
+    }
+    *dest = *nis_span_slot(gc, chunk, tree);
+    return true;
+}
+
+// frees the memory a dead tree owns, the tree's slot is freed by clearing
+// its `used` bit
+static void nis_free_tree(NisGc *heap, NisStree *tree) {
+    switch (tree->kind) {
+    case NIS_STREE_STRING: {
+        if (tree->flags & NIS_FLAG_OWNED) {
+            nis_dealloc(heap, (char *) tree->vstr.ptr, tree->vstr.len);
+        }
+    } break;
+    case NIS_STREE_VECTOR: {
+        nis_dealloc(heap, tree->vvec.ptr, tree->vvec.cap * sizeof(NisValue));
+    } break;
+    case NIS_STREE_BYTE_VECTOR: {
+        nis_dealloc(heap, tree->vbvec.ptr, tree->vbvec.cap);
+    } break;
+    }
+}
+
+// frees the unmarked trees of page `j` and clears its marks, returns the
+// number of trees left.  Only dead trees that own memory are touched.
+static size_t nis_sweep_page(NisGc *heap, struct NisChunk *chunk, size_t j) {
+    char *page = chunk->base + j * NIS_PAGE_SIZE;
+    size_t size = CELL_SIZES[chunk->pages[j].sizeclass - NIS_PAGE_TREES];
+    uint64_t *used = chunk->used + j * NIS_TREE_WORDS;
+    uint64_t *marks = chunk->marks + j * NIS_TREE_WORDS;
+    uint64_t *owns = chunk->owns + j * NIS_TREE_WORDS;
+    size_t live = 0;
+    for (size_t w = 0; w < NIS_TREE_WORDS; w++) {
+        uint64_t dead = used[w] & ~marks[w];
+        for (uint64_t bits = dead & owns[w]; bits; bits &= bits - 1) {
+            size_t slot = w * 64 + __builtin_ctzll(bits);
+            nis_free_tree(heap, (NisStree *) (page + slot * size));
+        }
+        heap->len -= __builtin_popcountll(dead) * size;
+        used[w] = marks[w];
+        owns[w] &= marks[w];
+        marks[w] = 0;
+        live += __builtin_popcountll(used[w]);
+    }
+    chunk->pages[j].epoch = heap->epoch;
+    return live;
+}
+
+// sweeps from the sweep cursor of `cell` until a page of that cell size
+// with a free slot turns up, pages left empty go back to their chunk
+static bool nis_sweep_next(NisGc *heap, unsigned cell) {
+    struct NisTreeClass *class = heap->cells + cell;
+    size_t slots = NIS_PAGE_SIZE / CELL_SIZES[cell];
+    while (class->sweepchunk < heap->chunkc) {
+        struct NisChunk *chunk = heap->chunks + class->sweepchunk;
+        while (class->sweeppage < chunk->len / NIS_PAGE_SIZE) {
+            size_t j = class->sweeppage++;
+            struct NisPage *page = chunk->pages + j;
+            if (page->sizeclass != NIS_PAGE_TREES + cell) {
+                continue;
+            }
+            size_t live = 0;
+            if (page->epoch != heap->epoch) {
+                live = nis_sweep_page(heap, chunk, j);
+                if (live == 0) {
+                    free(chunk->spans[j]);
+                    chunk->spans[j] = NULL;
+                    page->sizeclass = NIS_PAGE_FREE;
+                    nis_dealloc_pages(chunk, chunk->base + j * NIS_PAGE_SIZE, NIS_PAGE_SIZE);
+                    continue;
+                }
+            } else if (heap->cycle) {
+                // all was swept before the mark began, the cursor goes
+                // round once more only to fill the gaps
+                for (size_t w = 0; w < NIS_TREE_WORDS; w++) {
+                    live += __builtin_popcountll(chunk->used[j * NIS_TREE_WORDS + w]);
+                }
             } else {
-                void *ptr = frame;
-                struct NisAllocFrame *nextptr = (void *) ((char *) ptr + size);
-                struct NisAllocFrame *nextnext = frame->next;
-                size_t nextlen = frame->len - size;
-                *prev = nextptr;
-                frame = nextptr;
-                frame->next = nextnext;
-                frame->len = nextlen;
-                return ptr;
+                continue;
+            }
+            if (live < slots) {
+                class->page = chunk->base + j * NIS_PAGE_SIZE;
+                class->used = chunk->used + j * NIS_TREE_WORDS;
+                class->marks = chunk->marks + j * NIS_TREE_WORDS;
+                class->slot = 0;
+                return true;
             }
         }
-        prev = &frame->next;
-        frame = frame->next;
+        ++class->sweepchunk;
+        class->sweeppage = 0;
     }
-    
-    fprintf(stderr, "nisc:%s:%d: error: out of memory\n", __FILE__, __LINE__);
-    exit(1);
+    return false;
 }
 
-void nis_dealloc(NisGc *gc, void *ptr, size_t size) {
-    size = nis_align_up(size, 8);
-    
-    struct NisAllocFrame **prev = &gc->prev;
-    struct NisAllocFrame *frame = gc->prev;
-    while (frame) {
-        if (frame == ptr) {
-            fprintf(stderr, "nisc:%s:%d: error: double free\n", __FILE__, __LINE__);
-            exit(1);
-        } else if ((size_t) frame > (size_t) ptr) {
-            frame = *prev;
-            if ((char *) frame + frame->len == ptr) {
-                frame->len += size;
+static void nis_finish_sweep(NisGc *heap) {
+    for (unsigned cell = 0; cell < NIS_CELLS; cell++) {
+        while (nis_sweep_next(heap, cell)) {
+        }
+        heap->cells[cell].page = NULL;
+    }
+}
+
+// starts every sweep cursor over at the first page
+static void nis_rewind_sweep(NisGc *heap) {
+    for (unsigned cell = 0; cell < NIS_CELLS; cell++) {
+        heap->cells[cell].page = NULL;
+        heap->cells[cell].sweepchunk = 0;
+        heap->cells[cell].sweeppage = 0;
+    }
+}
+
+static NisStree *nis_alloc_tree(NisGc *gc, int kind) {
+    unsigned cell = TREE_CELLS[kind];
+    struct NisTreeClass *class = gc->cells + cell;
+    size_t size = CELL_SIZES[cell];
+    size_t slots = NIS_PAGE_SIZE / size;
+    for (;;) {
+        if (class->page) {
+            for (size_t w = class->slot / 64; w < NIS_TREE_WORDS; w++) {
+                uint64_t free = ~class->used[w];
+                if (w == class->slot / 64) {
+                    free &= ~(uint64_t) 0 << class->slot % 64;
+                }
+                if (!free) {
+                    continue;
+                }
+                size_t slot = w * 64 + __builtin_ctzll(free);
+                if (slot >= slots) {
+                    break;
+                }
+                class->used[w] |= (uint64_t) 1 << slot % 64;
+                if (gc->cycle) {
+                    // born marked, the mark never looks at it
+                    __atomic_fetch_or(class->marks + w, (uint64_t) 1 << slot % 64, __ATOMIC_RELAXED);
+                }
+                class->slot = slot + 1;
+                gc->len += size;
+                gc->allocated += size;
+                return (NisStree *) (class->page + slot * size);
+            }
+        }
+        if (!nis_sweep_next(gc, cell)) {
+            // everything is swept and full, start a fresh page, whose bits
+            // were all cleared when it was last swept or mapped
+            struct NisChunk *chunk;
+            char *page = nis_alloc_pages(gc, NIS_PAGE_SIZE, &chunk);
+            size_t j = (page - chunk->base) / NIS_PAGE_SIZE;
+            chunk->pages[j].sizeclass = NIS_PAGE_TREES + cell;
+            chunk->pages[j].epoch = gc->epoch;
+            class->page = page;
+            class->used = chunk->used + j * NIS_TREE_WORDS;
+            class->marks = chunk->marks + j * NIS_TREE_WORDS;
+            class->slot = 0;
+        }
+    }
+}
+
+// gives size-class pages without live objects back to their chunk, and
+// the memory of long free runs, whole chunks included, back to the kernel
+// once `keep` bytes of free pages are left resident
+static void nis_trim(NisGc *heap, size_t keep) {
+    // counting means walking the free lists, which only pays off for
+    // classes where much of the memory is unused
+    bool counted = false;
+    for (unsigned i = 0; i < NIS_SIZE_CLASSES; i++) {
+        struct NisSizeClass *class = heap->classes + i;
+        size_t perpage = NIS_PAGE_SIZE / CLASS_SIZES[i];
+        size_t unused = class->pagec * perpage - class->live;
+        if (unused * CLASS_SIZES[i] < NIS_RELEASE_MIN || unused < class->pagec * perpage / 4) {
+            continue;
+        }
+        counted = true;
+
+        for (void *ptr = class->free; ptr; ptr = *(void **) ptr) {
+            ++nis_page(heap, ptr)->freec;
+        }
+        if (class->cursor) {
+            nis_page(heap, class->cursor - 1)->freec += (class->limit - class->cursor) / CLASS_SIZES[i];
+        }
+        void **link = &class->free;
+        while (*link) {
+            if (nis_page(heap, *link)->freec == perpage) {
+                *link = *(void **) *link;
+            } else {
+                link = *link;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < heap->chunkc; i++) {
+        struct NisChunk *chunk = heap->chunks + i;
+        for (size_t j = 0; counted && j < chunk->len / NIS_PAGE_SIZE; j++) {
+            struct NisPage *page = chunk->pages + j;
+            if (page->sizeclass < NIS_SIZE_CLASSES
+                && page->freec == NIS_PAGE_SIZE / CLASS_SIZES[page->sizeclass]) {
+                char *ptr = chunk->base + j * NIS_PAGE_SIZE;
+                struct NisSizeClass *class = heap->classes + page->sizeclass;
+                if (class->cursor > ptr && class->cursor <= ptr + NIS_PAGE_SIZE) {
+                    class->cursor = NULL;
+                    class->limit = NULL;
+                }
+                --class->pagec;
+                page->sizeclass = NIS_PAGE_FREE;
+                nis_dealloc_pages(chunk, ptr, NIS_PAGE_SIZE);
+            }
+            page->freec = 0;
+        }
+
+        // first fit reuses low addresses first, so those stay resident
+        size_t pagec = chunk->len / NIS_PAGE_SIZE;
+        for (size_t j = nis_next_free(chunk, 0); j < pagec; j = nis_next_free(chunk, j + chunk->pages[j].run)) {
+            char *start = chunk->base + j * NIS_PAGE_SIZE;
+            size_t len = (size_t) chunk->pages[j].run * NIS_PAGE_SIZE;
+            size_t skip = nis_align_up(keep, NIS_PAGE_SIZE);
+            if (len <= skip) {
+                keep -= keep < len ? keep : len;
+                continue;
+            }
+            if (len - skip >= NIS_RELEASE_MIN) {
+                madvise(start + skip, len - skip, MADV_DONTNEED);
+            }
+            keep = 0;
+        }
+    }
+}
+
+static uint64_t nis_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// adds the pause that began at `start`
+static void nis_pause(uint64_t *total, uint64_t *max, uint64_t start) {
+    uint64_t ns = nis_now() - start;
+    *total += ns;
+    if (ns > *max) {
+        *max = ns;
+    }
+}
+
+static inline void nis_note_peak(NisGc *gc) {
+    if (gc->len + gc->nurserylen > gc->counters.peak) {
+        gc->counters.peak = gc->len + gc->nurserylen;
+    }
+}
+
+void nis_gc_remember(NisGc *gc, NisStree *tree) {
+    if (gc->rememberedc == gc->rememberedcap) {
+        gc->rememberedcap = gc->rememberedcap ? 2 * gc->rememberedcap : 64;
+        gc->remembered = realloc(gc->remembered, gc->rememberedcap * sizeof(NisStree *));
+    }
+    gc->remembered[gc->rememberedc++] = tree;
+    tree->flags |= NIS_FLAG_REMEMBERED;
+}
+
+// the heap copy of `tree`, made on first sight
+static NisValue nis_promote(NisGc *gc, struct MarkStack *scan, NisValue value) {
+    if (!nis_tree_eh(value) || !nis_young_eh(gc, nis_value_tree(value))) {
+        return value;
+    }
+    NisStree *tree = nis_value_tree(value);
+    if (!(tree->flags & NIS_FLAG_FORWARDED)) {
+        NisStree *copy = nis_alloc_tree(gc, tree->kind);
+        memcpy(copy, tree, nis_tree_size(tree->kind));
+        ++gc->counters.promoted;
+        tree->flags |= NIS_FLAG_FORWARDED;
+        tree->vforward = copy;
+        if (copy->flags & NIS_FLAG_SPAN) {
+            *nis_span_slot(gc, nis_find_chunk(gc, copy), copy) = *nis_span_slot(gc, NULL, tree);
+        }
+        if (copy->kind == NIS_STREE_PAIR) {
+            nis_stack_push(scan, copy);
+        }
+    }
+    nis_stree(&value, gc, tree->vforward);
+    return value;
+}
+
+static void nis_promote_fields(NisGc *gc, struct MarkStack *scan, NisStree *tree) {
+    // the young values replaced were born after any mark in the
+    // background began, so need no log, but the mark may read the fields
+    switch (tree->kind) {
+    case NIS_STREE_PAIR: {
+        __atomic_store_n(&tree->vpair.car.bits, nis_promote(gc, scan, tree->vpair.car).bits, __ATOMIC_RELEASE);
+        __atomic_store_n(&tree->vpair.cdr.bits, nis_promote(gc, scan, tree->vpair.cdr).bits, __ATOMIC_RELEASE);
+    } break;
+    case NIS_STREE_VECTOR: {
+        for (size_t i = 0; i < tree->vvec.len; i++) {
+            __atomic_store_n(&tree->vvec.ptr[i].bits, nis_promote(gc, scan, tree->vvec.ptr[i]).bits, __ATOMIC_RELEASE);
+        }
+    } break;
+    }
+}
+
+// which collection found the trees weak values point at dead
+enum NisWeakPass {
+    NIS_WEAK_MINOR,
+    NIS_WEAK_MAJOR,
+    NIS_WEAK_RELEASE,
+};
+
+// where `tree` is after the collection, NULL if it died
+static NisStree *nis_weak_survivor(NisGc *gc, int pass, NisStree *tree, const char *from, const char *to) {
+    switch (pass) {
+    case NIS_WEAK_MINOR:
+        if (!nis_young_eh(gc, tree)) {
+            return tree;
+        }
+        return tree->flags & NIS_FLAG_FORWARDED ? tree->vforward : NULL;
+    case NIS_WEAK_MAJOR: {
+        // young trees were born after the mark began
+        struct NisChunk *chunk = nis_young_eh(gc, tree) ? NULL : nis_find_chunk(gc, tree);
+        if (!chunk) {
+            return tree;
+        }
+        size_t index = nis_tree_index(chunk, tree);
+        return chunk->marks[index / 64] >> index % 64 & 1 ? tree : NULL;
+    }
+    default:
+        return (const char *) tree >= from && (const char *) tree < to ? NULL : tree;
+    }
+}
+
+// puts the survivors in a new array, sized for them
+static void nis_weak_rebuild(NisGc *gc, NisWeakTable *table, int pass, const char *from, const char *to) {
+    size_t count = 0;
+    for (size_t i = 0; i < table->cap; i++) {
+        struct NisWeakEntry *entry = table->slots + i;
+        if (entry->tree) {
+            entry->tree = nis_weak_survivor(gc, pass, entry->tree, from, to);
+            count += entry->tree != NULL;
+        }
+    }
+    size_t cap = NIS_WEAK_TABLE_SIZE;
+    while (2 * (count + 1) > cap) {
+        cap *= 2;
+    }
+    struct NisWeakEntry *slots = calloc(cap, sizeof(struct NisWeakEntry));
+    table->young = 0;
+    for (size_t i = 0; i < table->cap; i++) {
+        struct NisWeakEntry *entry = table->slots + i;
+        if (entry->tree) {
+            size_t j = entry->hash & (cap - 1);
+            while (slots[j].tree) {
+                j = (j + 1) & (cap - 1);
+            }
+            slots[j] = *entry;
+            table->young += nis_young_eh(gc, entry->tree);
+        }
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->cap = cap;
+    table->count = count;
+}
+
+// sets the weak values of `heap` whose trees died to #f and moves the
+// rest along, tables are only rebuilt when they may hold a dead tree
+static void nis_clear_weak(NisGc *gc, NisGc *heap, int pass, const char *from, const char *to) {
+    NisValue dead;
+    nis_false(&dead, gc);
+    for (size_t i = 0; i < heap->weakc; i++) {
+        NisValue *values = *heap->weaks[i].values;
+        size_t len = *heap->weaks[i].len;
+        for (size_t j = 0; j < len; j++) {
+            if (!nis_tree_eh(values[j])) {
+                continue;
+            }
+            NisStree *tree = nis_weak_survivor(gc, pass, nis_value_tree(values[j]), from, to);
+            if (!tree) {
+                values[j] = dead;
             } else {
-                frame->next = ptr;
-                frame = frame->next;
-                frame->len = size;
+                nis_stree(values + j, gc, tree);
+            }
+        }
+    }
+    for (size_t i = 0; i < heap->tablec; i++) {
+        if (pass == NIS_WEAK_MAJOR || heap->tables[i]->young) {
+            nis_weak_rebuild(gc, heap->tables[i], pass, from, to);
+        }
+    }
+}
+
+NisStree *nis_weak_find(NisGc *gc, NisWeakTable *table, uint32_t hash,
+                        bool (*eq)(const NisStree *tree, const void *arg), const void *arg) {
+    size_t i = hash & (table->cap - 1);
+    while (table->slots[i].tree) {
+        struct NisWeakEntry *entry = table->slots + i;
+        if (entry->hash == hash && eq(entry->tree, arg)) {
+            NisValue value;
+            nis_stree(&value, gc, entry->tree);
+            nis_gc_keep(gc, value);
+            return entry->tree;
+        }
+        i = (i + 1) & (table->cap - 1);
+    }
+    return NULL;
+}
+
+static void nis_weak_grow(NisWeakTable *table) {
+    size_t cap = table->cap * 2;
+    struct NisWeakEntry *slots = calloc(cap, sizeof(struct NisWeakEntry));
+    for (size_t i = 0; i < table->cap; i++) {
+        struct NisWeakEntry *entry = table->slots + i;
+        if (entry->tree) {
+            size_t j = entry->hash & (cap - 1);
+            while (slots[j].tree) {
+                j = (j + 1) & (cap - 1);
+            }
+            slots[j] = *entry;
+        }
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->cap = cap;
+}
+
+void nis_weak_add(NisGc *gc, NisWeakTable *table, uint32_t hash, NisStree *tree) {
+    if (2 * (table->count + 1) > table->cap) {
+        nis_weak_grow(table);
+    }
+    size_t i = hash & (table->cap - 1);
+    while (table->slots[i].tree) {
+        i = (i + 1) & (table->cap - 1);
+    }
+    table->slots[i].hash = hash;
+    table->slots[i].tree = tree;
+    ++table->count;
+    table->young += nis_young_eh(gc, tree);
+    tree->flags |= NIS_FLAG_WEAK;
+}
+
+// copies what the roots and the remembered set reach, so the work is in
+// the survivors and the dead are dropped with the nursery
+void nis_gc_minor(NisGc *gc) {
+    uint64_t start = nis_now();
+    struct MarkStack scan = { NULL, 0, 0 };
+    for (size_t i = 0; i < gc->rootc; i++) {
+        NisValue *values = *gc->roots[i].values;
+        size_t len = *gc->roots[i].len;
+        for (size_t j = 0; j < len; j++) {
+            values[j] = nis_promote(gc, &scan, values[j]);
+        }
+    }
+    for (size_t i = 0; i < gc->rememberedc; i++) {
+        gc->remembered[i]->flags &= ~NIS_FLAG_REMEMBERED;
+        nis_promote_fields(gc, &scan, gc->remembered[i]);
+    }
+    gc->rememberedc = 0;
+    while (scan.len) {
+        nis_promote_fields(gc, &scan, scan.trees[--scan.len]);
+    }
+    free(scan.trees);
+    nis_clear_weak(gc, gc, NIS_WEAK_MINOR, NULL, NULL);
+    gc->nurserylen = 0;
+    ++gc->minors;
+    nis_pause(&gc->counters.minorns, &gc->counters.minormax, start);
+}
+
+void nis_gc_mark_region(NisGc *gc, struct NisGcMark *dest) {
+    dest->nurserylen = gc->nurserylen;
+    dest->minors = gc->minors;
+}
+
+static inline bool nis_released_eh(NisValue value, const char *from, const char *to) {
+    return nis_tree_eh(value)
+        && (const char *) nis_value_tree(value) >= from
+        && (const char *) nis_value_tree(value) < to;
+}
+
+#ifdef NIS_GC_VERIFY
+static void nis_verify_push(struct MarkStack *stack, NisValue value) {
+    if (nis_tree_eh(value) && !(nis_value_tree(value)->flags & NIS_FLAG_VISITED)) {
+        nis_value_tree(value)->flags |= NIS_FLAG_VISITED;
+        nis_stack_push(stack, nis_value_tree(value));
+    }
+}
+
+// traces everything the roots reach, young and old, for values between
+// `from` and `to`.  The reached trees stay flagged in `stack` until
+// nis_verify_unvisit, so that the release can tell them from garbage.
+static void nis_verify_release(NisGc *gc, struct MarkStack *visited, const char *from, const char *to) {
+    struct MarkStack stack = { NULL, 0, 0 };
+    size_t escaped = 0;
+    for (size_t i = 0; i < gc->rootc; i++) {
+        NisValue *values = *gc->roots[i].values;
+        size_t len = *gc->roots[i].len;
+        for (size_t j = 0; j < len; j++) {
+            escaped += nis_released_eh(values[j], from, to);
+            nis_verify_push(&stack, values[j]);
+        }
+    }
+    // the stack keeps what was visited below `len`, to clear the flags
+    size_t len = 0;
+    while (len < stack.len) {
+        NisStree *tree = stack.trees[len++];
+        if ((const char *) tree >= from && (const char *) tree < to) {
+            continue;
+        }
+        switch (tree->kind) {
+        case NIS_STREE_PAIR: {
+            escaped += nis_released_eh(tree->vpair.car, from, to);
+            escaped += nis_released_eh(tree->vpair.cdr, from, to);
+            nis_verify_push(&stack, tree->vpair.car);
+            nis_verify_push(&stack, tree->vpair.cdr);
+        } break;
+        case NIS_STREE_VECTOR: {
+            for (size_t i = 0; i < tree->vvec.len; i++) {
+                escaped += nis_released_eh(tree->vvec.ptr[i], from, to);
+                nis_verify_push(&stack, tree->vvec.ptr[i]);
+            }
+        } break;
+        }
+    }
+    *visited = stack;
+    if (escaped) {
+        fprintf(stderr,
+                "nisc:%s:%d: error: %zu values point into a released region\n",
+                __FILE__,
+                __LINE__,
+                escaped);
+        exit(1);
+    }
+}
+
+static void nis_verify_unvisit(struct MarkStack *visited) {
+    for (size_t i = 0; i < visited->len; i++) {
+        visited->trees[i]->flags &= ~NIS_FLAG_VISITED;
+    }
+    free(visited->trees);
+}
+#endif
+
+// sets the fields of `tree` that hold a value between `from` and `to` to
+// `nil`, and counts them
+static size_t nis_clear_released(NisStree *tree, NisValue nil, const char *from, const char *to) {
+    size_t cleared = 0;
+    switch (tree->kind) {
+    case NIS_STREE_PAIR: {
+        if (nis_released_eh(tree->vpair.car, from, to)) {
+            __atomic_store_n(&tree->vpair.car.bits, nil.bits, __ATOMIC_RELEASE);
+            ++cleared;
+        }
+        if (nis_released_eh(tree->vpair.cdr, from, to)) {
+            __atomic_store_n(&tree->vpair.cdr.bits, nil.bits, __ATOMIC_RELEASE);
+            ++cleared;
+        }
+    } break;
+    case NIS_STREE_VECTOR: {
+        for (size_t j = 0; j < tree->vvec.len; j++) {
+            if (nis_released_eh(tree->vvec.ptr[j], from, to)) {
+                __atomic_store_n(&tree->vvec.ptr[j].bits, nil.bits, __ATOMIC_RELEASE);
+                ++cleared;
             }
+        }
+    } break;
+    }
+    return cleared;
+}
+
+bool nis_gc_release_region(NisGc *gc, const struct NisGcMark *mark) {
+    if (gc->minors != mark->minors) {
+        return false;
+    }
+    const char *from = gc->nursery + mark->nurserylen;
+    const char *to = gc->nursery + gc->nurserylen;
+#ifdef NIS_GC_VERIFY
+    struct MarkStack visited;
+    nis_verify_release(gc, &visited, from, to);
+#endif
+    // a phase must not store its trees into live old ones.  The next minor
+    // collection reads the fields of every remembered tree, so they are
+    // cleared rather than left for it to follow; builds with NIS_GC_VERIFY
+    // stop when one of them is still reachable.  Old trees the phase
+    // filled itself once the nursery was full are its own garbage, left
+    // to the next collection.  The values were young, so a mark in the
+    // background needs no log.
+    NisValue nil;
+    nis_nil(&nil, gc);
+#ifdef NIS_GC_VERIFY
+    size_t stale = 0;
+#endif
+    for (size_t i = 0; i < gc->rememberedc; i++) {
+        NisStree *tree = gc->remembered[i];
+        size_t cleared = nis_clear_released(tree, nil, from, to);
+#ifdef NIS_GC_VERIFY
+        stale += tree->flags & NIS_FLAG_VISITED ? cleared : 0;
+#else
+        (void) cleared;
+#endif
+    }
+#ifdef NIS_GC_VERIFY
+    nis_verify_unvisit(&visited);
+    if (stale) {
+        fprintf(stderr,
+                "nisc:%s:%d: error: %zu live old fields point into a released region\n",
+                __FILE__,
+                __LINE__,
+                stale);
+        exit(1);
+    }
+#endif
+    nis_clear_weak(gc, gc, NIS_WEAK_RELEASE, from, to);
+    gc->nurserylen = mark->nurserylen;
+    return true;
+}
+
+// the marks are complete, so sweeping starts over against them
+static void nis_gc_end_mark(NisGc *gc, size_t live) {
+    ++gc->counters.majors;
+    nis_clear_weak(gc, gc, NIS_WEAK_MAJOR, NULL, NULL);
+    ++gc->epoch;
+    nis_rewind_sweep(gc);
+
+    // collect again once the heap has grown by as much as survived, but
+    // not more often than at the initial threshold
+    size_t base = gc->capacity >> 3;
+    gc->threshold = 2 * live > base ? 2 * live : base;
+    // what gets allocated before the next collection stays resident
+    nis_trim(gc, gc->threshold);
+}
+
+// the mark and sweep only know the heap, and the marks of the last
+// collection must all be consumed first
+static void nis_gc_begin_mark(NisGc *gc) {
+    nis_note_peak(gc);
+    nis_gc_minor(gc);
+    nis_finish_sweep(gc);
+}
+
+void nis_gc_collect(NisGc *gc) {
+    if (gc->cycle) {
+        nis_gc_finish_mark(gc);
+        return;
+    }
+    uint64_t start = nis_now();
+    nis_gc_begin_mark(gc);
+
+    struct Marker marker = { { NULL, 0, 0 }, gc, gc->chunks, 0 };
+    nis_mark_roots(&marker, gc);
+    nis_mark(&marker);
+    free(marker.stack.trees);
+    gc->allocated = marker.live;
+    nis_gc_end_mark(gc, marker.live);
+    nis_pause(&gc->counters.majorns, &gc->counters.majormax, start);
+}
+
+// the log is handed to the marker in batches of this many trees
+#define NIS_LOG_BATCH 256
+
+// a mark on its own thread while the mutator goes on.  Trees allocated
+// meanwhile are born marked, and values overwritten meanwhile are logged
+// with nis_gc_store, so all that was reachable when the mark began is
+// marked (snapshot at the beginning).
+struct NisMarkCycle {
+    pthread_t thread;
+    bool threaded;
+    // owned, the chunks of the heap when the mark began,
+    // ordered by address.  Later chunks only hold trees born marked.
+    struct NisChunk *chunks;
+    size_t chunkc;
+
+    // marker-owned until it is joined
+    struct MarkStack stack;
+    size_t live;
+
+    pthread_mutex_t lock;
+    // guarded by `lock`, logged trees for the marker, and whether it ran
+    // dry and takes no more
+    struct MarkStack handed;
+    bool done;
+
+    // mutator-owned, logged trees not handed over yet
+    struct MarkStack log;
+    // `allocated` when the mark began
+    size_t allocated;
+};
+
+// like nis_mark_push, but the mutator sets bits of the same words and
+// writes the fields read
+static inline void nis_cycle_push(struct NisMarkCycle *cycle, NisValue value) {
+    if (!nis_tree_eh(value)) {
+        return;
+    }
+    NisStree *tree = nis_value_tree(value);
+    struct NisChunk *chunk = nis_search_chunks(cycle->chunks, cycle->chunkc, tree);
+    if (!chunk) {
+        return;
+    }
+    size_t index = nis_tree_index(chunk, tree);
+    uint64_t bit = (uint64_t) 1 << index % 64;
+    uint64_t *word = chunk->marks + index / 64;
+    if (__atomic_load_n(word, __ATOMIC_RELAXED) & bit) {
+        return;
+    }
+    if (__atomic_fetch_or(word, bit, __ATOMIC_RELAXED) & bit) {
+        return;
+    }
+    cycle->live += nis_tree_size(tree->kind);
+    if (tree->kind == NIS_STREE_PAIR || tree->kind == NIS_STREE_VECTOR) {
+        nis_stack_push(&cycle->stack, tree);
+    }
+}
+
+static void nis_cycle_mark(struct NisMarkCycle *cycle) {
+    struct MarkStack *stack = &cycle->stack;
+    while (stack->len) {
+        NisStree *tree = stack->trees[--stack->len];
+        switch (tree->kind) {
+        case NIS_STREE_PAIR: {
+            NisValue cdr = { __atomic_load_n(&tree->vpair.cdr.bits, __ATOMIC_ACQUIRE) };
+            NisValue car = { __atomic_load_n(&tree->vpair.car.bits, __ATOMIC_ACQUIRE) };
+            nis_cycle_push(cycle, cdr);
+            nis_cycle_push(cycle, car);
+        } break;
+        case NIS_STREE_VECTOR: {
+            for (size_t i = 0; i < tree->vvec.len; i++) {
+                NisValue value = { __atomic_load_n(&tree->vvec.ptr[i].bits, __ATOMIC_ACQUIRE) };
+                nis_cycle_push(cycle, value);
+            }
+        } break;
+        }
+    }
+}
+
+static void nis_cycle_take(struct NisMarkCycle *cycle, struct MarkStack *trees) {
+    for (size_t i = 0; i < trees->len; i++) {
+        NisValue value = { (uintptr_t) trees->trees[i] };
+        nis_cycle_push(cycle, value);
+    }
+    trees->len = 0;
+}
+
+static void *nis_mark_thread(void *arg) {
+    struct NisMarkCycle *cycle = arg;
+    struct MarkStack handed = { NULL, 0, 0 };
+    bool done = false;
+    while (!done) {
+        nis_cycle_mark(cycle);
+        pthread_mutex_lock(&cycle->lock);
+        struct MarkStack swap = cycle->handed;
+        cycle->handed = handed;
+        handed = swap;
+        done = cycle->done = handed.len == 0;
+        pthread_mutex_unlock(&cycle->lock);
+        nis_cycle_take(cycle, &handed);
+    }
+    free(handed.trees);
+    return NULL;
+}
+
+static void nis_gc_start_mark(NisGc *gc) {
+    uint64_t start = nis_now();
+    nis_gc_begin_mark(gc);
+
+    struct NisMarkCycle *cycle = malloc(sizeof(struct NisMarkCycle));
+    cycle->chunkc = gc->chunkc;
+    cycle->chunks = malloc(cycle->chunkc * sizeof(struct NisChunk));
+    memcpy(cycle->chunks, gc->chunks, gc->chunkc * sizeof(struct NisChunk));
+    cycle->stack = (struct MarkStack) { NULL, 0, 0 };
+    cycle->live = 0;
+    pthread_mutex_init(&cycle->lock, NULL);
+    cycle->handed = (struct MarkStack) { NULL, 0, 0 };
+    cycle->done = false;
+    cycle->log = (struct MarkStack) { NULL, 0, 0 };
+    cycle->allocated = gc->allocated;
+
+    // the roots are only read now, whatever they hold later was reachable
+    // now or is born marked
+    for (size_t i = 0; i < gc->rootc; i++) {
+        NisValue *values = *gc->roots[i].values;
+        size_t len = *gc->roots[i].len;
+        for (size_t j = 0; j < len; j++) {
+            nis_cycle_push(cycle, values[j]);
+        }
+    }
+    for (size_t i = 0; i < gc->imagec; i++) {
+        struct NisGcImage *image = gc->images + i;
+        for (size_t j = 0; j < image->treec; j++) {
+            nis_stack_push(&cycle->stack, image->trees + j);
+        }
+    }
+
+    gc->cycle = cycle;
+    // sweeping is done, the cursors now find room on swept pages
+    nis_rewind_sweep(gc);
+    cycle->threaded = pthread_create(&cycle->thread, NULL, nis_mark_thread, cycle) == 0;
+    if (!cycle->threaded) {
+        nis_mark_thread(cycle);
+    }
+    nis_pause(&gc->counters.majorns, &gc->counters.majormax, start);
+}
+
+// waits for the marker and marks what was logged since it ran dry
+static void nis_gc_finish_mark(NisGc *gc) {
+    uint64_t start = nis_now();
+    struct NisMarkCycle *cycle = gc->cycle;
+    if (cycle->threaded) {
+        pthread_join(cycle->thread, NULL);
+    }
+    nis_cycle_take(cycle, &cycle->handed);
+    nis_cycle_take(cycle, &cycle->log);
+    nis_cycle_mark(cycle);
+
+    gc->cycle = NULL;
+    gc->allocated = cycle->live + gc->allocated - cycle->allocated;
+    size_t live = cycle->live;
+    pthread_mutex_destroy(&cycle->lock);
+    free(cycle->log.trees);
+    free(cycle->handed.trees);
+    free(cycle->stack.trees);
+    free(cycle->chunks);
+    free(cycle);
+    nis_gc_end_mark(gc, live);
+    nis_pause(&gc->counters.majorns, &gc->counters.majormax, start);
+}
+
+void nis_gc_log(NisGc *gc, NisStree *owner, NisValue old) {
+    // the nursery was empty when the mark began, so young trees are not
+    // part of it
+    if (!nis_young_eh(gc, owner)) {
+        nis_gc_keep(gc, old);
+    }
+}
+
+// a tree only reached through weak values may not be marked, but once the
+// mutator holds it again it must survive the mark
+void nis_gc_keep(NisGc *gc, NisValue value) {
+    struct NisMarkCycle *cycle = gc->cycle;
+    if (!cycle || !nis_tree_eh(value) || nis_young_eh(gc, nis_value_tree(value))) {
+        return;
+    }
+    nis_stack_push(&cycle->log, nis_value_tree(value));
+    if (cycle->log.len < NIS_LOG_BATCH) {
+        return;
+    }
+    // once the marker is done the log waits for nis_gc_finish_mark
+    pthread_mutex_lock(&cycle->lock);
+    if (!cycle->done) {
+        for (size_t i = 0; i < cycle->log.len; i++) {
+            nis_stack_push(&cycle->handed, cycle->log.trees[i]);
+        }
+        cycle->log.len = 0;
+    }
+    pthread_mutex_unlock(&cycle->lock);
+}
+
+void nis_gc_concurrent(NisGc *gc, bool on) {
+    if (!on && gc->cycle) {
+        nis_gc_finish_mark(gc);
+    }
+    gc->concurrent = on;
+}
+
+void nis_gc_safepoint(NisGc *gc) {
+    nis_note_peak(gc);
+    if (gc->cycle) {
+        // the mutator only waits for a marker that falls a whole
+        // threshold behind
+        pthread_mutex_lock(&gc->cycle->lock);
+        bool done = gc->cycle->done;
+        pthread_mutex_unlock(&gc->cycle->lock);
+        if (done || gc->allocated - gc->cycle->allocated >= gc->threshold) {
+            nis_gc_finish_mark(gc);
             return;
         }
-        prev = &frame->next;
-        frame = frame->next;
+    } else if (gc->allocated >= gc->threshold) {
+        if (gc->concurrent) {
+            nis_gc_start_mark(gc);
+        } else {
+            nis_gc_collect(gc);
+        }
+        return;
+    }
+    if (gc->nurserylen >= NIS_NURSERY_SIZE / 2) {
+        nis_gc_minor(gc);
     }
-    
-    fprintf(stderr, "nisc:%s:%d: error: invalid free\n", __FILE__, __LINE__);
-    exit(1);
 }
 
-void *nis_realloc(NisGc *gc, void *ptr, size_t oldsize, size_t newsize) {
-    oldsize = nis_align_up(oldsize, 8);
-    newsize = nis_align_up(newsize, 8);
+static void nis_add_stats(struct NisGcStats *dest, NisGc *heap) {
+    nis_add_counters(&dest->counters, &heap->counters);
+    dest->minors += heap->minors;
+    dest->len += heap->len;
+    dest->capacity += heap->capacity;
+
+    for (size_t i = 0; i < NIS_SIZE_CLASSES; i++) {
+        const struct NisSizeClass *class = heap->classes + i;
+        dest->classpages[i] += class->pagec;
+        dest->classbytes[i] += class->live * CLASS_SIZES[i];
+        for (void *ptr = class->free; ptr; ptr = *(void **) ptr) {
+            ++dest->classfree[i];
+        }
+    }
+    for (size_t i = 0; i < heap->chunkc; i++) {
+        struct NisChunk *chunk = heap->chunks + i;
+        size_t pagec = chunk->len / NIS_PAGE_SIZE;
+        for (size_t j = 0; j < pagec; j++) {
+            unsigned char sizeclass = chunk->pages[j].sizeclass;
+            if (sizeclass < NIS_PAGE_TREES || sizeclass >= NIS_PAGE_TREES + NIS_CELLS) {
+                continue;
+            }
+            ++dest->cellpages[sizeclass - NIS_PAGE_TREES];
+            for (size_t w = 0; w < NIS_TREE_WORDS; w++) {
+                dest->cellsused[sizeclass - NIS_PAGE_TREES] += __builtin_popcountll(chunk->used[j * NIS_TREE_WORDS + w]);
+            }
+        }
+        dest->freepages += chunk->freepages;
+        for (size_t j = nis_next_free(chunk, 0); j < pagec; j = nis_next_free(chunk, j)) {
+            size_t run = chunk->pages[j].run;
+            ++dest->freeruns;
+            dest->longestrun = run > dest->longestrun ? run : dest->longestrun;
+            j += run;
+        }
+    }
+}
 
-    if (newsize == oldsize) {
+void nis_gc_stats(struct NisGcStats *dest, NisGc *gc) {
+    nis_note_peak(gc);
+    memset(dest, 0, sizeof *dest);
+    nis_add_stats(dest, gc);
+    for (size_t i = 0; i < NIS_STREE_KINDS; i++) {
+        dest->treebytes[i] = dest->counters.trees[i] * nis_tree_size(i);
+    }
+    for (size_t i = 0; i < NIS_SIZE_CLASSES; i++) {
+        dest->classsize[i] = CLASS_SIZES[i];
+    }
+    for (size_t i = 0; i < NIS_CELLS; i++) {
+        dest->cellsize[i] = CELL_SIZES[i];
+    }
+}
+
+// takes `n` pages from the front of the free run at `j`
+static void nis_take_pages(struct NisChunk *chunk, size_t j, size_t n) {
+    size_t run = chunk->pages[j].run;
+    nis_set_free(chunk, j, n, false);
+    if (run > n) {
+        nis_free_run(chunk, j + n, run - n);
+    }
+    chunk->freepages -= n;
+}
+
+// first fit over the free runs of one chunk, `size` is a multiple of
+// NIS_PAGE_SIZE.  Runs are found in the free map, so free memory is never
+// touched.
+static void *nis_chunk_alloc_pages(struct NisChunk *chunk, size_t size) {
+    size_t n = size / NIS_PAGE_SIZE;
+    size_t pagec = chunk->len / NIS_PAGE_SIZE;
+    for (size_t j = nis_next_free(chunk, 0); j < pagec; j = nis_next_free(chunk, j + chunk->pages[j].run)) {
+        if (chunk->pages[j].run >= n) {
+            nis_take_pages(chunk, j, n);
+            return chunk->base + j * NIS_PAGE_SIZE;
+        }
+    }
+    return NULL;
+}
+
+// maps a new chunk when no chunk has room, each new chunk at least
+// doubles the heap
+static void *nis_alloc_pages(NisGc *gc, size_t size, struct NisChunk **chunkp) {
+    for (size_t i = 0; i < gc->chunkc; i++) {
+        struct NisChunk *chunk = gc->chunks + i;
+        if (chunk->freepages * NIS_PAGE_SIZE < size) {
+            continue;
+        }
+        void *ptr = nis_chunk_alloc_pages(chunk, size);
+        if (ptr) {
+            *chunkp = chunk;
+            return ptr;
+        }
+    }
+
+    struct NisChunk *chunk = nis_add_chunk(gc, size > gc->capacity ? size : gc->capacity);
+    *chunkp = chunk;
+    return nis_chunk_alloc_pages(chunk, size);
+}
+
+// merges the run with both neighbours, whose ends are next to it
+static void nis_dealloc_pages(struct NisChunk *chunk, void *ptr, size_t size) {
+    size_t j = ((char *) ptr - chunk->base) / NIS_PAGE_SIZE;
+    size_t n = size / NIS_PAGE_SIZE;
+    if (nis_page_free_eh(chunk, j)) {
+        fprintf(stderr, "nisc:%s:%d: error: double free\n", __FILE__, __LINE__);
+        exit(1);
+    }
+    nis_set_free(chunk, j, n, true);
+    chunk->freepages += n;
+
+    size_t start = j;
+    size_t end = j + n;
+    if (start > 0 && nis_page_free_eh(chunk, start - 1)) {
+        start -= chunk->pages[start - 1].run;
+    }
+    if (end < chunk->len / NIS_PAGE_SIZE && nis_page_free_eh(chunk, end)) {
+        end += chunk->pages[end].run;
+    }
+    nis_free_run(chunk, start, end - start);
+}
+
+static void *nis_alloc_large(NisGc *gc, size_t size) {
+    size = nis_align_up(size, NIS_PAGE_SIZE);
+    struct NisChunk *chunk;
+    void *ptr = nis_alloc_pages(gc, size, &chunk);
+    struct NisPage *page = nis_chunk_page(chunk, ptr);
+    page->sizeclass = NIS_PAGE_LARGE;
+    page->run = size / NIS_PAGE_SIZE;
+    return ptr;
+}
+
+static void *nis_alloc_small(NisGc *gc, unsigned sizeclass) {
+    struct NisSizeClass *class = gc->classes + sizeclass;
+    ++class->live;
+    void *ptr = class->free;
+    if (ptr) {
+        class->free = *(void **) ptr;
         return ptr;
-    } else if (newsize > oldsize) {
-        struct NisAllocFrame *frame = gc->prev;
-        while (frame) {
-            struct NisAllocFrame *next = frame->next;
-            if ((char *) ptr + oldsize == (char *) next) {
-                if (oldsize + next->len >= newsize) {
-                    if (oldsize + next->len == newsize) {
-                        frame->next = next->next;
-                    } else {
-                        size_t len = next->len - (newsize - oldsize);
-                        frame->next = next + (newsize - oldsize);
-                        frame->next->next = next->next;
-                        frame->next->len = len;
-                    }
-                    return ptr;
-                } else {
-                    void *oldptr = ptr;
-                    void *newptr = nis_alloc(gc, newsize);
-                    memcpy(newptr, oldptr, oldsize);
-                    nis_dealloc(gc, oldptr, oldsize);
-                    return newptr;
-                }
+    }
+
+    size_t size = CLASS_SIZES[sizeclass];
+    if (class->cursor + size > class->limit) {
+        struct NisChunk *chunk;
+        char *page = nis_alloc_pages(gc, NIS_PAGE_SIZE, &chunk);
+        nis_chunk_page(chunk, page)->sizeclass = sizeclass;
+        ++class->pagec;
+        class->cursor = page;
+        class->limit = page + NIS_PAGE_SIZE / size * size;
+    }
+    ptr = class->cursor;
+    class->cursor += size;
+    return ptr;
+}
+
+void *nis_alloc(NisGc *gc, size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+    if (size <= NIS_SMALL_MAX) {
+        unsigned sizeclass = nis_size_class(size);
+        gc->len += CLASS_SIZES[sizeclass];
+        ++gc->counters.allocs[sizeclass];
+        gc->counters.allocbytes[sizeclass] += size;
+        return nis_alloc_small(gc, sizeclass);
+    }
+    gc->len += nis_align_up(size, NIS_PAGE_SIZE);
+    ++gc->counters.allocs[NIS_SIZE_CLASSES];
+    gc->counters.allocbytes[NIS_SIZE_CLASSES] += size;
+    return nis_alloc_large(gc, size);
+}
+
+void nis_dealloc(NisGc *gc, void *ptr, size_t size) {
+    if (!ptr) {
+        return;
+    }
+    struct NisChunk *chunk = nis_find_chunk(gc, ptr);
+    if (!chunk) {
+        fprintf(stderr, "nisc:%s:%d: error: invalid free\n", __FILE__, __LINE__);
+        exit(1);
+    }
+
+    struct NisPage *page = nis_chunk_page(chunk, ptr);
+    if (size <= NIS_SMALL_MAX) {
+        unsigned sizeclass = nis_size_class(size);
+        if (page->sizeclass != sizeclass) {
+            fprintf(stderr, "nisc:%s:%d: error: invalid free\n", __FILE__, __LINE__);
+            exit(1);
+        }
+        struct NisSizeClass *class = gc->classes + sizeclass;
+        *(void **) ptr = class->free;
+        class->free = ptr;
+        --class->live;
+        gc->len -= CLASS_SIZES[sizeclass];
+    } else {
+        size = nis_align_up(size, NIS_PAGE_SIZE);
+        if (page->sizeclass != NIS_PAGE_LARGE
+            || (size_t) page->run * NIS_PAGE_SIZE != size
+            || ((char *) ptr - chunk->base) % NIS_PAGE_SIZE != 0) {
+            fprintf(stderr, "nisc:%s:%d: error: invalid free\n", __FILE__, __LINE__);
+            exit(1);
+        }
+        page->sizeclass = NIS_PAGE_FREE;
+        page->run = 0;
+        nis_dealloc_pages(chunk, ptr, size);
+        gc->len -= size;
+    }
+}
+
+// tries to take the free pages right after a large object, which start
+// a free run if there are any
+static bool nis_grow_large(NisGc *gc, void *ptr, size_t oldsize, size_t newsize) {
+    struct NisChunk *chunk = nis_find_chunk(gc, ptr);
+    size_t j = ((char *) ptr - chunk->base) / NIS_PAGE_SIZE;
+    size_t next = j + oldsize / NIS_PAGE_SIZE;
+    size_t extra = (newsize - oldsize) / NIS_PAGE_SIZE;
+    if (next >= chunk->len / NIS_PAGE_SIZE
+        || !nis_page_free_eh(chunk, next)
+        || chunk->pages[next].run < extra) {
+        return false;
+    }
+    nis_take_pages(chunk, next, extra);
+    chunk->pages[j].run = newsize / NIS_PAGE_SIZE;
+    gc->len += newsize - oldsize;
+    return true;
+}
+
+void *nis_realloc(NisGc *gc, void *ptr, size_t oldsize, size_t newsize) {
+    if (!ptr) {
+        return nis_alloc(gc, newsize);
+    }
+    if (newsize == 0) {
+        nis_dealloc(gc, ptr, oldsize);
+        return NULL;
+    }
+
+    if (oldsize <= NIS_SMALL_MAX && newsize <= NIS_SMALL_MAX) {
+        if (nis_size_class(oldsize) == nis_size_class(newsize)) {
+            return ptr;
+        }
+    } else if (oldsize > NIS_SMALL_MAX && newsize > NIS_SMALL_MAX) {
+        size_t oldpages = nis_align_up(oldsize, NIS_PAGE_SIZE);
+        size_t newpages = nis_align_up(newsize, NIS_PAGE_SIZE);
+        if (newpages <= oldpages) {
+            if (newpages < oldpages) {
+                struct NisChunk *chunk = nis_find_chunk(gc, ptr);
+                nis_chunk_page(chunk, ptr)->run = newpages / NIS_PAGE_SIZE;
+                nis_dealloc_pages(chunk, (char *) ptr + newpages, oldpages - newpages);
+                gc->len -= oldpages - newpages;
             }
-            frame = next;
+            return ptr;
         }
+        if (nis_grow_large(gc, ptr, oldpages, newpages)) {
+            return ptr;
+        }
+    }
+
+    void *newptr = nis_alloc(gc, newsize);
+    memcpy(newptr, ptr, oldsize < newsize ? oldsize : newsize);
+    nis_dealloc(gc, ptr, oldsize);
+    return newptr;
+}
+
+// trees that own memory start on the heap, the sweep is what frees it.
+// Others land here when the nursery is full and own nothing, their dead
+// slots are freed without being looked at.
+static NisStree *nis_new_old_tree(NisGc *gc, int kind) {
+    ++gc->counters.trees[kind];
+    NisStree *tree = nis_alloc_tree(gc, kind);
+    tree->kind = kind;
+    tree->flags = 0;
+    if (kind == NIS_STREE_VECTOR || kind == NIS_STREE_BYTE_VECTOR || kind == NIS_STREE_STRING) {
+        struct NisChunk *chunk = nis_find_chunk(gc, tree);
+        size_t index = nis_tree_index(chunk, tree);
+        chunk->owns[index / 64] |= (uint64_t) 1 << index % 64;
     }
-    
-    fprintf(stderr, "nisc:%s:%d: error: invalid free\n", __FILE__, __LINE__);
-    exit(1);
+    return tree;
+}
+
+// once the nursery is full trees go to the heap until a safepoint empties
+// it
+static inline NisStree *nis_new_tree(NisGc *gc, int kind) {
+    size_t size = nis_tree_size(kind);
+    if (gc->nurserylen + size > NIS_NURSERY_SIZE) {
+        return nis_new_old_tree(gc, kind);
+    }
+    ++gc->counters.trees[kind];
+    NisStree *tree = (NisStree *) (gc->nursery + gc->nurserylen);
+    gc->nurserylen += size;
+    tree->kind = kind;
+    tree->flags = 0;
+    return tree;
 }
 
 void nis_false(NisValue *dest, NisGc *gc) {
     (void) gc;
-    dest->kind = NIS_VALUE_FALSE;
+    dest->bits = NIS_IMMEDIATE(NIS_VALUE_FALSE);
 }
 
 void nis_true(NisValue *dest, NisGc *gc) {
     (void) gc;
-    dest->kind = NIS_VALUE_TRUE;
+    dest->bits = NIS_IMMEDIATE(NIS_VALUE_TRUE);
 }
 
 void nis_int(NisValue *dest, NisGc *gc, long value) {
-    (void) gc;
-    dest->kind = NIS_VALUE_INT;
-    dest->vint = value;
+    if (value >= NIS_FIXNUM_MIN && value <= NIS_FIXNUM_MAX) {
+        dest->bits = (uintptr_t) value << 1 | NIS_TAG_FIXNUM;
+        return;
+    }
+    NisStree *tree = nis_new_tree(gc, NIS_STREE_INT);
+    tree->vint = value;
+    nis_stree(dest, gc, tree);
 }
 
 void nis_float(NisValue *dest, NisGc *gc, double value) {
-    (void) gc;
-    dest->kind = NIS_VALUE_FLOAT;
-    dest->vfloat = value;
+    NisStree *tree = nis_new_tree(gc, NIS_STREE_FLOAT);
+    tree->vfloat = value;
+    nis_stree(dest, gc, tree);
 }
 
 void nis_stree(NisValue *dest, NisGc *gc, NisStree *value) {
     (void) gc;
-    dest->kind = NIS_VALUE_TREE;
-    dest->vtree = value;
+    dest->bits = (uintptr_t) value;
 }
 
 void nis_nil(NisValue *dest, NisGc *gc) {
-    dest->kind = NIS_VALUE_TREE;
-    dest->vtree = gc->nil;
+    (void) gc;
+    dest->bits = NIS_IMMEDIATE(NIS_VALUE_NIL);
 }
 
 void nis_pair(NisValue *dest, NisGc *gc, NisValue *car, NisValue *cdr) {
-    dest->kind = NIS_VALUE_TREE;
-    NisStree *tree = nis_alloc(gc, sizeof(NisStree));
-    tree->kind = NIS_STREE_PAIR;
-    tree->flags = 0;
-    tree->next = gc->last;
-    tree->vpair.car = nis_value_to_stree(gc, car);
-    tree->vpair.cdr = nis_value_to_stree(gc, cdr);
-    dest->vtree = tree;
-    gc->last = tree;
+    NisStree *tree = nis_new_tree(gc, NIS_STREE_PAIR);
+    tree->vpair.car = *car;
+    tree->vpair.cdr = *cdr;
+    // `tree` itself is old when the nursery was full
+    nis_gc_write(gc, tree, *car);
+    nis_gc_write(gc, tree, *cdr);
+    nis_stree(dest, gc, tree);
 }
 
 void nis_vector(NisValue *dest, NisGc *gc) {
-    dest->kind = NIS_VALUE_TREE;
-    NisStree *tree = nis_alloc(gc, sizeof(NisStree));
-    tree->kind = NIS_STREE_PAIR;
-    tree->flags = 0;
-    tree->next = gc->last;
+    NisStree *tree = nis_new_old_tree(gc, NIS_STREE_VECTOR);
     tree->vvec.ptr = NULL;
     tree->vvec.len = 0;
     tree->vvec.cap = 0;
-    dest->vtree = tree;
-    gc->last = tree;
+    nis_stree(dest, gc, tree);
 }
 
 void nis_byte_vector(NisValue *dest, NisGc *gc) {
-    dest->kind = NIS_VALUE_TREE;
-    NisStree *tree = nis_alloc(gc, sizeof(NisStree));
-    tree->kind = NIS_STREE_PAIR;
-    tree->flags = 0;
-    tree->next = gc->last;
+    NisStree *tree = nis_new_old_tree(gc, NIS_STREE_BYTE_VECTOR);
     tree->vbvec.ptr = NULL;
     tree->vbvec.len = 0;
     tree->vbvec.cap = 0;
-    dest->vtree = tree;
-    gc->last = tree;
-}
-
-void nis_atom(NisValue *dest, NisGc *gc, const char *value) {
-    size_t len = strlen(value);
-    
-    dest->kind = NIS_VALUE_TREE;
-    NisStree *tree = nis_alloc(gc, sizeof(NisStree));
-    if (len < 24) {
-        tree->kind = NIS_STREE_ATOM;
-        tree->flags = NIS_FLAG_INLINE;
-        tree->next = gc->last;
-        strcpy((char *) tree->vinline, value);
-    } else {
-        tree->kind = NIS_STREE_ATOM;
-        tree->flags = NIS_FLAG_INLINE;
-        tree->next = gc->last;
-        tree->vatom = nis_alloc(gc, len + 1);
-        strcpy((char *) tree->vatom, value);
+    nis_stree(dest, gc, tree);
+}
+
+void nis_atom(NisValue *dest, NisGc *gc, const NisSymbol *value) {
+    NisStree *tree = nis_new_tree(gc, NIS_STREE_ATOM);
+    tree->vsym = value;
+    nis_stree(dest, gc, tree);
+}
+
+void nis_string(NisValue *dest, NisGc *gc, const char *value, size_t len) {
+    NisStree *tree = nis_new_tree(gc, NIS_STREE_STRING);
+    tree->vstr.ptr = value;
+    tree->vstr.len = len;
+    nis_stree(dest, gc, tree);
+}
+
+void nis_string_copy(NisValue *dest, NisGc *gc, const char *value, size_t len) {
+    char *copy = NULL;
+    if (len) {
+        copy = nis_alloc(gc, len);
+        memcpy(copy, value, len);
     }
-    dest->vtree = tree;
-    gc->last = tree;
+    NisStree *tree = nis_new_old_tree(gc, NIS_STREE_STRING);
+    tree->flags |= NIS_FLAG_OWNED;
+    tree->vstr.ptr = copy;
+    tree->vstr.len = len;
+    nis_stree(dest, gc, tree);
 }
 
 void nis_special(NisValue *dest, NisGc *gc, int value) {
     (void) gc;
-    dest->kind = value;
-}
-
-NisStree *nis_value_to_stree(NisGc *gc, NisValue *value) {
-    switch (value->kind) {
-    case NIS_VALUE_TRUE:
-        return gc->t;
-    case NIS_VALUE_FALSE:
-        return gc->f;
-    case NIS_VALUE_INT: {
-        NisStree *tree = nis_alloc(gc, sizeof(NisStree));
-        tree->kind = NIS_STREE_INT;
-        tree->flags = 0;
-        tree->next = gc->last;
-        tree->vint = value->vint;
-        gc->last = tree;
-        return tree;
-    }
-    case NIS_VALUE_FLOAT: {
-        NisStree *tree = nis_alloc(gc, sizeof(NisStree));
-        tree->kind = NIS_STREE_FLOAT;
-        tree->flags = 0;
-        tree->next = gc->last;
-        tree->vfloat = value->vfloat;
-        gc->last = tree;
-        return tree;
-    }
-    case NIS_VALUE_TREE:
-        return value->vtree;
-    default:
-        fprintf(stderr, "nisc:%s:%d: error: undefined value\n", __FILE__, __LINE__);
-        exit(-1);
-    }
+    dest->bits = NIS_IMMEDIATE(value);
 }
@@ -12,6 +12,10 @@ void nis_new_hlbuilder(NisHlbuilder *dest, NisGc *gc) {
     dest->func = 0;
     dest->funv = malloc(dest->funs * sizeof(NisHlfun));
     dest->funent = -1;
+    dest->indexcap = 32;
+    dest->indexc = 0;
+    dest->index = malloc(dest->indexcap * sizeof(int32_t));
+    memset(dest->index, -1, dest->indexcap * sizeof(int32_t));
 }
 
 void nis_build_hlbuilder(NisHlprog *dest, NisHlbuilder *b) {
@@ -20,6 +24,100 @@ void nis_build_hlbuilder(NisHlprog *dest, NisHlbuilder *b) {
     dest->func = b->func;
     dest->funv = realloc(b->funv, b->func * sizeof(NisHlfun));
     dest->funent = b->funent;
+    free(b->index);
+    b->index = NULL;
+}
+
+// instructions still in the mapping of an image are left to it
+static void nis_del_funs(NisHlfun *funv, size_t func) {
+    for (size_t i = 0; i < func; i++) {
+        NisHlfun *fun = funv + i;
+        if (!fun->present || !fun->inss) {
+            continue;
+        }
+        for (size_t j = 0; j < fun->insc; j++) {
+            nis_hlb_del_ins(fun->insv + j);
+        }
+        free(fun->insv);
+    }
+    free(funv);
+}
+
+void nis_del_hlbuilder(NisHlbuilder *b) {
+    nis_del_funs(b->funv, b->func);
+    free(b->index);
+}
+
+void nis_del_hlprog(NisHlprog *prog) {
+    nis_del_funs(prog->funv, prog->func);
+}
+
+// the slot of `name` in the index, or the empty slot it would go in
+static size_t nis_hlb_slot(const NisHlbuilder *b, const NisSymbol *name) {
+    size_t i = name->hash & (b->indexcap - 1);
+    while (b->index[i] >= 0 && b->funv[b->index[i]].name != name) {
+        i = (i + 1) & (b->indexcap - 1);
+    }
+    return i;
+}
+
+static void nis_hlb_grow_index(NisHlbuilder *b) {
+    int32_t *old = b->index;
+    size_t oldcap = b->indexcap;
+    b->indexcap *= 2;
+    b->index = malloc(b->indexcap * sizeof(int32_t));
+    memset(b->index, -1, b->indexcap * sizeof(int32_t));
+    for (size_t i = 0; i < oldcap; i++) {
+        if (old[i] >= 0) {
+            b->index[nis_hlb_slot(b, b->funv[old[i]].name)] = old[i];
+        }
+    }
+    free(old);
+}
+
+// an earlier function of the same name keeps its slot
+static void nis_hlb_index(NisHlbuilder *b, int32_t funref) {
+    if (2 * (b->indexc + 1) > b->indexcap) {
+        nis_hlb_grow_index(b);
+    }
+    size_t i = nis_hlb_slot(b, b->funv[funref].name);
+    if (b->index[i] < 0) {
+        b->index[i] = funref;
+        ++b->indexc;
+    }
+}
+
+static void nis_hlb_unindex(NisHlbuilder *b, int32_t funref) {
+    size_t mask = b->indexcap - 1;
+    size_t i = nis_hlb_slot(b, b->funv[funref].name);
+    if (b->index[i] != funref) {
+        return;
+    }
+    // the rest of the run moves up where it can, so that no probe stops
+    // at the hole before reaching its name
+    for (size_t j = (i + 1) & mask; b->index[j] >= 0; j = (j + 1) & mask) {
+        size_t home = b->funv[b->index[j]].name->hash & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            b->index[i] = b->index[j];
+            i = j;
+        }
+    }
+    b->index[i] = -1;
+    --b->indexc;
+}
+
+int32_t nis_hlb_findfun(NisHlbuilder *b, const NisSymbol *name) {
+    return b->index[nis_hlb_slot(b, name)];
+}
+
+void nis_hlb_reindex(NisHlbuilder *b) {
+    memset(b->index, -1, b->indexcap * sizeof(int32_t));
+    b->indexc = 0;
+    for (size_t i = 0; i < b->func; i++) {
+        if (b->funv[i].present) {
+            nis_hlb_index(b, i);
+        }
+    }
 }
 
 void nis_hlb_entry(NisHlbuilder *b, int32_t funref) {
@@ -31,18 +129,40 @@ void nis_hlb_del_ins(NisHlbc *ins) {
 }
 
 int32_t nis_hlb_addfun(NisHlbuilder *b, const char *name) {
+    if (b->func == b->funs) {
+        b->funs *= 2;
+        b->funv = realloc(b->funv, b->funs * sizeof(NisHlfun));
+    }
     b->funv[b->func].present = 1;
-    b->funv[b->func].name = name;
+    b->funv[b->func].name = nis_intern_str(name);
     b->funv[b->func].inss = 16;
     b->funv[b->func].insc = 0;
     b->funv[b->func].insv = malloc(b->funv[b->func].inss * sizeof(NisHlbc));
     int32_t funref = b->func;
     ++b->func;
+    nis_hlb_index(b, funref);
     return funref;
 }
 
+// a function loaded from an image gets instructions of its own
+static void nis_hlb_own(NisHlfun *fun) {
+    if (fun->inss) {
+        return;
+    }
+    const NisHlbc *insv = fun->insv;
+    fun->inss = fun->insc > 16 ? fun->insc : 16;
+    fun->insv = malloc(fun->inss * sizeof(NisHlbc));
+    for (size_t i = 0; i < fun->insc; i++) {
+        fun->insv[i] = insv[i];
+        fun->insv[i].argv = malloc(insv[i].argc * sizeof(NisHlarg));
+        if (insv[i].argc) {
+            memcpy(fun->insv[i].argv, insv[i].argv, insv[i].argc * sizeof(NisHlarg));
+        }
+    }
+}
+
 void nis_hlb_rmfun(NisHlbuilder *b, int32_t funref) {
-    if ((size_t) funref > b->func) {
+    if (funref < 0 || (size_t) funref >= b->func) {
         fprintf(stderr,
                 "nisc:%s:%d: error: "
                 "index out of bounds, "
@@ -59,23 +179,37 @@ void nis_hlb_rmfun(NisHlbuilder *b, int32_t funref) {
         return;
     }
 
-    for (size_t i = 0; i < fun->insc; i++) {
+    // instructions still in an image are left to it
+    for (size_t i = 0; fun->inss && i < fun->insc; i++) {
         nis_hlb_del_ins(fun->insv + i);
     }
+    if (fun->inss) {
+        free(fun->insv);
+    }
+    fun->insv = NULL;
+    fun->present = 0;
 
-    free(fun->insv);
+    // a later function of the same name is found from now on
+    nis_hlb_unindex(b, funref);
+    for (size_t i = funref + 1; i < b->func; i++) {
+        if (b->funv[i].present && b->funv[i].name == fun->name) {
+            nis_hlb_index(b, i);
+            break;
+        }
+    }
 }
 
 static NisHlbc *nis_hlb_prepare_build(NisHlbuilder *b) {
     NisHlfun *fun = b->funv + b->funref;
+    nis_hlb_own(fun);
+    if (fun->insc == fun->inss) {
+        fun->inss *= 2;
+        fun->insv = realloc(fun->insv, fun->inss * sizeof(NisHlbc));
+    }
     if ((size_t)  b->insref < fun->insc) {
-        if (fun->insc == fun->inss) {
-            fun->inss *= 2;
-            fun->insv = realloc(fun->insv, fun->inss * sizeof(NisHlbc));
-        }
         NisHlbc *ins = fun->insv + b->insref;
         size_t size = fun->insc - b->insref;
-        memmove(ins + 1, ins, size);
+        memmove(ins + 1, ins, size * sizeof(NisHlbc));
     } else if ((size_t)  b->insref > fun->insc) {
         fprintf(stderr,
                 "nisc:%s:%d: error: "
@@ -222,56 +356,41 @@ void nis_hlb_make_prelude(NisHlbuilder *b) {
 }
 
 static int nis_expr_to_hlbc(NisHlarg *dest, NisHlbuilder *b, NisValue *expr) {
-    if (expr->kind == NIS_VALUE_TREE) {
-        NisValue *origval = expr;
-        NisStree *tmp = expr->vtree;
-        NisStree *expr = tmp;
-        switch (expr->kind) {
+    if (nis_value_kind(*expr) == NIS_VALUE_TREE) {
+        NisStree *tree = nis_value_tree(*expr);
+        switch (tree->kind) {
         case NIS_STREE_PAIR: {
-            if (nis_list_eh(expr)) {
-                NisStree *car = expr->vpair.car;
-                NisStree *cdr = expr->vpair.cdr;
-                switch (car->kind) {
-                case NIS_STREE_ATOM: {
-                    NisStree *args = cdr;
-                    size_t capacity = 4;
-                    NisHlarg *argv = malloc(capacity * sizeof(NisHlarg));
-                    size_t argc = 0;
-                    const char *funname;
-                    if (car->flags & NIS_FLAG_INLINE) {
-                        funname = car->vinline;
-                    } else {
-                        funname = car->vatom;
-                    }
-                    int32_t funref = -1;
-                    for (size_t i = 0; i < b->func; i++) {
-                        if (b->funv[i].present && strcmp(b->funv[i].name, funname) == 0) {
-                            funref = i;
-                            break;
-                        }
+            if (nis_list_eh(tree)) {
+                NisValue car = tree->vpair.car;
+                NisValue cdr = tree->vpair.cdr;
+                switch (nis_value_kind(car)) {
+                case NIS_VALUE_TREE: {
+                    if (nis_value_tree(car)->kind != NIS_STREE_ATOM) {
+                        // TODO: computed calls
+                        return 0;
                     }
+                    const NisSymbol *funname = nis_value_tree(car)->vsym;
+                    int32_t funref = nis_hlb_findfun(b, funname);
                     if (funref < 0) {
                         fprintf(stderr,
                                 "nisc:%s:%d: error: undefined function: %s\n",
                                 __FILE__,
                                 __LINE__,
-                                funname);
+                                funname->name);
                         return 1;
                     }
+                    size_t capacity = 4;
+                    NisHlarg *argv = malloc(capacity * sizeof(NisHlarg));
+                    size_t argc = 0;
                     argv[argc].kind = NIS_HLBC_ARG_VALUE;
-                    argv[argc].value.kind = NIS_VALUE_INT;
-                    argv[argc].value.flags = 0;
-                    argv[argc].value.vint = funref;
+                    nis_int(&argv[argc].value, b->gc, funref);
                     ++argc;
-                    for (NisStree *car = args->vpair.car;
-                         args->kind != NIS_STREE_NIL;
-                         args = args->vpair.cdr, car = args->vpair.car) {
+                    for (NisValue args = cdr; !nis_nil_eh(args); args = nis_value_tree(args)->vpair.cdr) {
                         if (argc == capacity) {
                             capacity *= 2;
                             argv = realloc(argv, capacity * sizeof(NisHlarg));
                         }
-                        NisValue val;
-                        nis_stree(&val, b->gc, car);
+                        NisValue val = nis_value_tree(args)->vpair.car;
                         nis_expr_to_hlbc(argv + argc, b, &val);
                         ++argc;
                     }
@@ -293,7 +412,7 @@ static int nis_expr_to_hlbc(NisHlarg *dest, NisHlbuilder *b, NisValue *expr) {
         }
         default:
             dest->kind = NIS_HLBC_ARG_VALUE;
-            dest->value = *origval;
+            dest->value = *expr;
             return 0;
         }
     } else {
@@ -311,8 +430,14 @@ int nis_to_hlbc(NisHlprog *dest, NisHlbuilder *b, NisValue *program, size_t prog
     b->insref = 0;
     nis_hlb_entry(b, funref);
 
+    // instructions keep pointers into `program`, which must not move once
+    // lowering starts
+    nis_gc_minor(b->gc);
+
     NisHlarg result;
     for (size_t i = 0; i < proglen; i++) {
+        // `program` must be rooted by the caller
+        nis_gc_safepoint(b->gc);
         NisValue *expr = program + i;
         status |= nis_expr_to_hlbc(&result, b, expr);
     }
@@ -0,0 +1,641 @@
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "include/nisc.h"
+
+// an image is one file that is mapped as a whole.  Pointers in it are
+// offsets from its start, each listed in the relocations so that loading
+// only adds the address of the mapping, and symbols are interned again by
+// name.  Trees come first, those with fields before the rest, then what
+// they point at, then the functions.
+
+#define NIS_IMAGE_MAGIC "nisimg1"
+
+struct ImageHeader {
+    char magic[8];
+    // catches an image written by a build with other struct layouts
+    uint32_t layout;
+    int32_t funent;
+    uint64_t len;
+    // NisStree[treec], the first `fieldc` are pairs and vectors
+    uint64_t trees;
+    uint64_t treec;
+    uint64_t fieldc;
+    // NisValue[valuec]
+    uint64_t values;
+    uint64_t valuec;
+    // NisHlfun[func]
+    uint64_t funv;
+    uint64_t func;
+    int64_t regcnt;
+    // uint64_t[relocc], offsets of words that hold an offset
+    uint64_t relocs;
+    uint64_t relocc;
+    // struct ImageSymbol[symc], each name once
+    uint64_t syms;
+    uint64_t symc;
+    // struct ImageSymbolRef[refc]
+    uint64_t refs;
+    uint64_t refc;
+};
+
+struct ImageSymbol {
+    uint64_t name;
+    uint64_t len;
+};
+
+struct ImageSymbolRef {
+    // where the interned pointer goes
+    uint64_t slot;
+    uint64_t sym;
+};
+
+#define NIS_IMAGE_LAYOUT                                                \
+    ((uint32_t) (sizeof(NisStree) << 24 | sizeof(NisHlfun) << 16        \
+                 | sizeof(NisHlbc) << 8 | sizeof(NisHlarg)))
+
+struct ImageWriter {
+    // owned
+    char *buf;
+    size_t len;
+    size_t cap;
+    uint64_t *relocs;
+    size_t relocc;
+    size_t reloccap;
+    struct ImageSymbol *syms;
+    size_t symc;
+    size_t symcap;
+    struct ImageSymbolRef *refs;
+    size_t refc;
+    size_t refcap;
+    // owned, by symbol id, the index in `syms` + 1
+    size_t *symids;
+    size_t symidc;
+
+    // owned, the trees reached, in the order they are written
+    NisStree **trees;
+    size_t treec;
+    size_t treecap;
+    // owned, from tree addresses to their index in `trees`
+    struct ImageSlot {
+        const NisStree *tree;
+        size_t index;
+    } *slots;
+    size_t slotcap;
+};
+
+static size_t nis_image_reserve(struct ImageWriter *w, size_t size) {
+    size_t offset = nis_align_up(w->len, 8);
+    while (offset + size > w->cap) {
+        w->cap = w->cap ? 2 * w->cap : 64 * 1024;
+        w->buf = realloc(w->buf, w->cap);
+    }
+    memset(w->buf + w->len, 0, offset + size - w->len);
+    w->len = offset + size;
+    return offset;
+}
+
+// the word at `slot` holds the offset `target`
+static void nis_image_reloc(struct ImageWriter *w, size_t slot, size_t target) {
+    if (w->relocc == w->reloccap) {
+        w->reloccap = w->reloccap ? 2 * w->reloccap : 256;
+        w->relocs = realloc(w->relocs, w->reloccap * sizeof(uint64_t));
+    }
+    w->relocs[w->relocc++] = slot;
+    uint64_t offset = target;
+    memcpy(w->buf + slot, &offset, sizeof offset);
+}
+
+// copies `len` bytes from `ptr`, the word at `slot` points at the copy
+static void nis_image_bytes(struct ImageWriter *w, size_t slot, const void *ptr, size_t len) {
+    if (!len) {
+        return;
+    }
+    size_t offset = nis_image_reserve(w, len);
+    memcpy(w->buf + offset, ptr, len);
+    nis_image_reloc(w, slot, offset);
+}
+
+static void nis_image_symbol(struct ImageWriter *w, size_t slot, const NisSymbol *symbol) {
+    if (symbol->id >= w->symidc) {
+        size_t symidc = w->symidc ? w->symidc : 64;
+        while (symbol->id >= symidc) {
+            symidc *= 2;
+        }
+        w->symids = realloc(w->symids, symidc * sizeof(size_t));
+        memset(w->symids + w->symidc, 0, (symidc - w->symidc) * sizeof(size_t));
+        w->symidc = symidc;
+    }
+    if (!w->symids[symbol->id]) {
+        if (w->symc == w->symcap) {
+            w->symcap = w->symcap ? 2 * w->symcap : 64;
+            w->syms = realloc(w->syms, w->symcap * sizeof(struct ImageSymbol));
+        }
+        struct ImageSymbol *sym = w->syms + w->symc++;
+        sym->len = symbol->len;
+        sym->name = nis_image_reserve(w, symbol->len);
+        memcpy(w->buf + sym->name, symbol->name, symbol->len);
+        w->symids[symbol->id] = w->symc;
+    }
+    if (w->refc == w->refcap) {
+        w->refcap = w->refcap ? 2 * w->refcap : 256;
+        w->refs = realloc(w->refs, w->refcap * sizeof(struct ImageSymbolRef));
+    }
+    w->refs[w->refc].slot = slot;
+    w->refs[w->refc].sym = w->symids[symbol->id] - 1;
+    ++w->refc;
+}
+
+static inline size_t nis_image_hash(const NisStree *tree) {
+    return ((uintptr_t) tree >> 3) * 0x9e3779b97f4a7c15u >> 16;
+}
+
+static void nis_image_grow(struct ImageWriter *w) {
+    size_t cap = w->slotcap ? 2 * w->slotcap : 1024;
+    struct ImageSlot *slots = calloc(cap, sizeof(struct ImageSlot));
+    for (size_t i = 0; i < w->slotcap; i++) {
+        if (w->slots[i].tree) {
+            size_t j = nis_image_hash(w->slots[i].tree) & (cap - 1);
+            while (slots[j].tree) {
+                j = (j + 1) & (cap - 1);
+            }
+            slots[j] = w->slots[i];
+        }
+    }
+    free(w->slots);
+    w->slots = slots;
+    w->slotcap = cap;
+}
+
+// the index of `tree` in `w->trees`, which it is added to on first sight
+static size_t nis_image_tree(struct ImageWriter *w, const NisStree *tree) {
+    if (2 * (w->treec + 1) > w->slotcap) {
+        nis_image_grow(w);
+    }
+    size_t i = nis_image_hash(tree) & (w->slotcap - 1);
+    while (w->slots[i].tree) {
+        if (w->slots[i].tree == tree) {
+            return w->slots[i].index;
+        }
+        i = (i + 1) & (w->slotcap - 1);
+    }
+    if (w->treec == w->treecap) {
+        w->treecap = w->treecap ? 2 * w->treecap : 256;
+        w->trees = realloc(w->trees, w->treecap * sizeof(NisStree *));
+    }
+    w->slots[i].tree = tree;
+    w->slots[i].index = w->treec;
+    w->trees[w->treec] = (NisStree *) tree;
+    return w->treec++;
+}
+
+static void nis_image_reach(struct ImageWriter *w, NisValue value) {
+    if (nis_tree_eh(value)) {
+        nis_image_tree(w, nis_value_tree(value));
+    }
+}
+
+static inline bool nis_image_fields_eh(const NisStree *tree) {
+    return tree->kind == NIS_STREE_PAIR || tree->kind == NIS_STREE_VECTOR;
+}
+
+// writes `value` to the word at `slot`, trees by the offsets in `offsets`
+static void nis_image_value(struct ImageWriter *w, size_t slot, NisValue value, const size_t *offsets) {
+    if (nis_tree_eh(value)) {
+        nis_image_reloc(w, slot, offsets[nis_image_tree(w, nis_value_tree(value))]);
+    } else {
+        memcpy(w->buf + slot, &value, sizeof value);
+    }
+}
+
+static void nis_image_copy_tree(struct ImageWriter *w, size_t offset, const NisStree *tree, const size_t *offsets) {
+    NisStree *copy = (NisStree *) (w->buf + offset);
+    // spans, marks and ownership all belong to the heap it came from
+    copy->kind = tree->kind;
+    copy->flags = 0;
+    switch (tree->kind) {
+    case NIS_STREE_INT:
+        copy->vint = tree->vint;
+        break;
+    case NIS_STREE_FLOAT:
+        copy->vfloat = tree->vfloat;
+        break;
+    case NIS_STREE_PAIR:
+        nis_image_value(w, offset + offsetof(NisStree, vpair.car), tree->vpair.car, offsets);
+        nis_image_value(w, offset + offsetof(NisStree, vpair.cdr), tree->vpair.cdr, offsets);
+        break;
+    case NIS_STREE_VECTOR: {
+        copy->vvec.len = copy->vvec.cap = tree->vvec.len;
+        if (tree->vvec.len) {
+            size_t ptr = nis_image_reserve(w, tree->vvec.len * sizeof(NisValue));
+            nis_image_reloc(w, offset + offsetof(NisStree, vvec.ptr), ptr);
+            for (size_t i = 0; i < tree->vvec.len; i++) {
+                nis_image_value(w, ptr + i * sizeof(NisValue), tree->vvec.ptr[i], offsets);
+            }
+        }
+    } break;
+    case NIS_STREE_BYTE_VECTOR:
+        copy->vbvec.len = copy->vbvec.cap = tree->vbvec.len;
+        nis_image_bytes(w, offset + offsetof(NisStree, vbvec.ptr), tree->vbvec.ptr, tree->vbvec.len);
+        break;
+    case NIS_STREE_ATOM:
+        nis_image_symbol(w, offset + offsetof(NisStree, vsym), tree->vsym);
+        break;
+    case NIS_STREE_STRING:
+        copy->vstr.len = tree->vstr.len;
+        nis_image_bytes(w, offset + offsetof(NisStree, vstr.ptr), tree->vstr.ptr, tree->vstr.len);
+        break;
+    }
+}
+
+static void nis_del_image_writer(struct ImageWriter *w) {
+    free(w->buf);
+    free(w->relocs);
+    free(w->syms);
+    free(w->refs);
+    free(w->symids);
+    free(w->trees);
+    free(w->slots);
+}
+
+int nis_dump_image(const char *path, NisHlbuilder *b, NisValue *values, size_t len) {
+    struct ImageWriter w = { 0 };
+
+    // finds every tree first, the values written later need their offsets
+    for (size_t i = 0; i < len; i++) {
+        nis_image_reach(&w, values[i]);
+    }
+    for (size_t i = 0; i < b->func; i++) {
+        NisHlfun *fun = b->funv + i;
+        for (size_t j = 0; fun->present && j < fun->insc; j++) {
+            for (size_t k = 0; k < fun->insv[j].argc; k++) {
+                if (fun->insv[j].argv[k].kind == NIS_HLBC_ARG_VALUE) {
+                    nis_image_reach(&w, fun->insv[j].argv[k].value);
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < w.treec; i++) {
+        NisStree *tree = w.trees[i];
+        if (tree->kind == NIS_STREE_PAIR) {
+            nis_image_reach(&w, tree->vpair.car);
+            nis_image_reach(&w, tree->vpair.cdr);
+        } else if (tree->kind == NIS_STREE_VECTOR) {
+            for (size_t j = 0; j < tree->vvec.len; j++) {
+                nis_image_reach(&w, tree->vvec.ptr[j]);
+            }
+        }
+    }
+
+    size_t header = nis_image_reserve(&w, sizeof(struct ImageHeader));
+    size_t trees = nis_image_reserve(&w, w.treec * sizeof(NisStree));
+    size_t *offsets = malloc((w.treec + 1) * sizeof(size_t));
+    size_t fieldc = 0;
+    for (size_t i = 0; i < w.treec; i++) {
+        fieldc += nis_image_fields_eh(w.trees[i]);
+    }
+    size_t field = 0;
+    size_t leaf = fieldc;
+    for (size_t i = 0; i < w.treec; i++) {
+        size_t index = nis_image_fields_eh(w.trees[i]) ? field++ : leaf++;
+        offsets[i] = trees + index * sizeof(NisStree);
+    }
+    for (size_t i = 0; i < w.treec; i++) {
+        nis_image_copy_tree(&w, offsets[i], w.trees[i], offsets);
+    }
+
+    size_t valuev = nis_image_reserve(&w, len * sizeof(NisValue));
+    for (size_t i = 0; i < len; i++) {
+        nis_image_value(&w, valuev + i * sizeof(NisValue), values[i], offsets);
+    }
+
+    // removed functions keep their place, funrefs are indices
+    size_t funv = nis_image_reserve(&w, b->func * sizeof(NisHlfun));
+    for (size_t i = 0; i < b->func; i++) {
+        NisHlfun *fun = b->funv + i;
+        size_t slot = funv + i * sizeof(NisHlfun);
+        if (!fun->present) {
+            continue;
+        }
+        ((NisHlfun *) (w.buf + slot))->present = true;
+        ((NisHlfun *) (w.buf + slot))->insc = fun->insc;
+        nis_image_symbol(&w, slot + offsetof(NisHlfun, name), fun->name);
+        size_t insv = nis_image_reserve(&w, fun->insc * sizeof(NisHlbc));
+        if (fun->insc) {
+            nis_image_reloc(&w, slot + offsetof(NisHlfun, insv), insv);
+        }
+        for (size_t j = 0; j < fun->insc; j++) {
+            NisHlbc *ins = fun->insv + j;
+            size_t at = insv + j * sizeof(NisHlbc);
+            NisHlbc *copy = (NisHlbc *) (w.buf + at);
+            copy->opcode = ins->opcode;
+            copy->flags = ins->flags;
+            copy->target = ins->target;
+            copy->argc = ins->argc;
+            size_t argv = nis_image_reserve(&w, ins->argc * sizeof(NisHlarg));
+            if (ins->argc) {
+                nis_image_reloc(&w, at + offsetof(NisHlbc, argv), argv);
+            }
+            for (size_t k = 0; k < ins->argc; k++) {
+                NisHlarg *arg = ins->argv + k;
+                size_t argat = argv + k * sizeof(NisHlarg);
+                NisHlarg *argcopy = (NisHlarg *) (w.buf + argat);
+                argcopy->kind = arg->kind;
+                argcopy->flags = arg->flags;
+                if (arg->kind == NIS_HLBC_ARG_VALUE) {
+                    nis_image_value(&w, argat + offsetof(NisHlarg, value), arg->value, offsets);
+                } else {
+                    argcopy->value = arg->value;
+                }
+            }
+        }
+    }
+    free(offsets);
+
+    size_t syms = nis_image_reserve(&w, w.symc * sizeof(struct ImageSymbol));
+    memcpy(w.buf + syms, w.syms, w.symc * sizeof(struct ImageSymbol));
+    size_t refs = nis_image_reserve(&w, w.refc * sizeof(struct ImageSymbolRef));
+    memcpy(w.buf + refs, w.refs, w.refc * sizeof(struct ImageSymbolRef));
+    size_t relocs = nis_image_reserve(&w, w.relocc * sizeof(uint64_t));
+    memcpy(w.buf + relocs, w.relocs, w.relocc * sizeof(uint64_t));
+
+    struct ImageHeader *head = (struct ImageHeader *) (w.buf + header);
+    memcpy(head->magic, NIS_IMAGE_MAGIC, sizeof head->magic);
+    head->layout = NIS_IMAGE_LAYOUT;
+    head->funent = b->funent;
+    head->len = w.len;
+    head->trees = trees;
+    head->treec = w.treec;
+    head->fieldc = fieldc;
+    head->values = valuev;
+    head->valuec = len;
+    head->funv = funv;
+    head->func = b->func;
+    head->regcnt = b->regcnt;
+    head->relocs = relocs;
+    head->relocc = w.relocc;
+    head->syms = syms;
+    head->symc = w.symc;
+    head->refs = refs;
+    head->refc = w.refc;
+
+    int status = 0;
+    FILE *file = fopen(path, "wb");
+    if (!file || fwrite(w.buf, 1, w.len, file) != w.len) {
+        status = errno;
+    }
+    if (file && fclose(file) && !status) {
+        status = errno;
+    }
+    nis_del_image_writer(&w);
+    if (status) {
+        fprintf(stderr, "nisc:%s:%d: error: %s: %s\n", __FILE__, __LINE__, path, strerror(status));
+    }
+    return status;
+}
+
+static int nis_image_error(const char *path, int err) {
+    fprintf(stderr, "nisc:%s:%d: error: %s: %s\n", __FILE__, __LINE__, path, strerror(err));
+    return err;
+}
+
+static int nis_bad_image(const char *path) {
+    fprintf(stderr, "nisc:%s:%d: error: not an image of this build: %s\n", __FILE__, __LINE__, path);
+    return 1;
+}
+
+static inline bool nis_image_span_eh(const struct ImageHeader *head, uint64_t offset, uint64_t count, size_t size) {
+    return offset <= head->len && count <= (head->len - offset) / size;
+}
+
+// a word the loader patches, a relocation or a symbol ref
+static inline bool nis_image_slot_eh(const struct ImageHeader *head, uint64_t slot) {
+    return slot >= sizeof(struct ImageHeader) && slot % sizeof(uintptr_t) == 0
+        && slot <= head->syms - sizeof(uintptr_t);
+}
+
+// a relocated pointer to `count` bytes, or to `count` words and structs,
+// which the writer always aligns
+static inline bool nis_image_bytes_eh(const struct ImageHeader *head, const char *base, const void *ptr, uint64_t count) {
+    return count == 0 || nis_image_span_eh(head, (uintptr_t) ptr - (uintptr_t) base, count, 1);
+}
+
+static inline bool nis_image_array_eh(const struct ImageHeader *head, const char *base, const void *ptr, uint64_t count, size_t size) {
+    uint64_t offset = (uintptr_t) ptr - (uintptr_t) base;
+    return count == 0 || (offset % sizeof(uint64_t) == 0 && nis_image_span_eh(head, offset, count, size));
+}
+
+// a tree value must be one of the trees of the image
+static inline bool nis_image_value_eh(const struct ImageHeader *head, const char *base, NisValue value) {
+    if (!nis_tree_eh(value)) {
+        return true;
+    }
+    uint64_t offset = (uintptr_t) nis_value_tree(value) - (uintptr_t) base - head->trees;
+    return offset < head->treec * sizeof(NisStree) && offset % sizeof(NisStree) == 0;
+}
+
+// what the loader and the builder follow once the pointers are relocated
+static bool nis_image_valid_eh(const struct ImageHeader *head, const char *base) {
+    const NisStree *trees = (const NisStree *) (base + head->trees);
+    for (size_t i = 0; i < head->treec; i++) {
+        const NisStree *tree = trees + i;
+        bool fields = tree->kind == NIS_STREE_PAIR || tree->kind == NIS_STREE_VECTOR;
+        if (tree->kind >= NIS_STREE_KINDS || fields != (i < head->fieldc)) {
+            return false;
+        }
+        switch (tree->kind) {
+        case NIS_STREE_ATOM:
+            if (!tree->vsym) {
+                return false;
+            }
+            break;
+        case NIS_STREE_PAIR:
+            if (!nis_image_value_eh(head, base, tree->vpair.car) || !nis_image_value_eh(head, base, tree->vpair.cdr)) {
+                return false;
+            }
+            break;
+        case NIS_STREE_VECTOR:
+            if (tree->vvec.cap != tree->vvec.len
+                || !nis_image_array_eh(head, base, tree->vvec.ptr, tree->vvec.len, sizeof(NisValue))) {
+                return false;
+            }
+            for (size_t j = 0; j < tree->vvec.len; j++) {
+                if (!nis_image_value_eh(head, base, tree->vvec.ptr[j])) {
+                    return false;
+                }
+            }
+            break;
+        case NIS_STREE_BYTE_VECTOR:
+            if (!nis_image_bytes_eh(head, base, tree->vbvec.ptr, tree->vbvec.len)) {
+                return false;
+            }
+            break;
+        case NIS_STREE_STRING:
+            if (!nis_image_bytes_eh(head, base, tree->vstr.ptr, tree->vstr.len)) {
+                return false;
+            }
+            break;
+        }
+    }
+    const NisValue *values = (const NisValue *) (base + head->values);
+    for (size_t i = 0; i < head->valuec; i++) {
+        if (!nis_image_value_eh(head, base, values[i])) {
+            return false;
+        }
+    }
+    if (head->funent < -1 || head->funent >= (int64_t) head->func) {
+        return false;
+    }
+    const NisHlfun *funv = (const NisHlfun *) (base + head->funv);
+    for (size_t i = 0; i < head->func; i++) {
+        // read as a byte, a bool holds nothing but 0 and 1
+        unsigned char present;
+        memcpy(&present, &funv[i].present, 1);
+        if (present > 1) {
+            return false;
+        } else if (!present) {
+            continue;
+        }
+        if (!funv[i].name || !nis_image_array_eh(head, base, funv[i].insv, funv[i].insc, sizeof(NisHlbc))) {
+            return false;
+        }
+        for (size_t j = 0; j < funv[i].insc; j++) {
+            const NisHlbc *ins = funv[i].insv + j;
+            if (!nis_image_array_eh(head, base, ins->argv, ins->argc, sizeof(NisHlarg))) {
+                return false;
+            }
+            for (size_t k = 0; k < ins->argc; k++) {
+                if (ins->argv[k].kind == NIS_HLBC_ARG_VALUE && !nis_image_value_eh(head, base, ins->argv[k].value)) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+int nis_load_image(NisHlbuilder *dest, NisValue **values, size_t *len, NisGc *gc, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return nis_image_error(path, errno);
+    }
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) < 0) {
+        int err = errno;
+        close(fd);
+        return nis_image_error(path, err);
+    }
+    if ((size_t) statbuf.st_size < sizeof(struct ImageHeader)) {
+        close(fd);
+        return nis_bad_image(path);
+    }
+    // private, so the relocations and later stores never reach the file
+    char *base = mmap(NULL, statbuf.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    int err = errno;
+    close(fd);
+    if (base == MAP_FAILED) {
+        return nis_image_error(path, err);
+    }
+
+    const struct ImageHeader *head = (const struct ImageHeader *) base;
+    if (memcmp(head->magic, NIS_IMAGE_MAGIC, sizeof head->magic) != 0
+        || head->layout != NIS_IMAGE_LAYOUT
+        || head->len != (uint64_t) statbuf.st_size
+        || !nis_image_span_eh(head, head->relocs, head->relocc, sizeof(uint64_t))
+        || !nis_image_span_eh(head, head->syms, head->symc, sizeof(struct ImageSymbol))
+        || !nis_image_span_eh(head, head->refs, head->refc, sizeof(struct ImageSymbolRef))
+        || !nis_image_span_eh(head, head->trees, head->treec, sizeof(NisStree))
+        || !nis_image_span_eh(head, head->values, head->valuec, sizeof(NisValue))
+        || !nis_image_span_eh(head, head->funv, head->func, sizeof(NisHlfun))
+        || (head->relocs | head->syms | head->refs | head->trees | head->values | head->funv) % sizeof(uint64_t)
+        || head->syms < sizeof(struct ImageHeader)
+        || head->fieldc > head->treec) {
+        munmap(base, statbuf.st_size);
+        return nis_bad_image(path);
+    }
+
+    // patched words lie between the header and the tables, so that no
+    // patch can move the tables or the header read after it
+    const uint64_t *relocs = (const uint64_t *) (base + head->relocs);
+    for (size_t i = 0; i < head->relocc; i++) {
+        if (!nis_image_slot_eh(head, relocs[i])) {
+            munmap(base, statbuf.st_size);
+            return nis_bad_image(path);
+        }
+        uintptr_t *slot = (uintptr_t *) (base + relocs[i]);
+        if (*slot >= head->len) {
+            munmap(base, statbuf.st_size);
+            return nis_bad_image(path);
+        }
+        *slot += (uintptr_t) base;
+    }
+    // a symbol slot that no ref fills stays NULL, and is refused below
+    NisStree *trees = (NisStree *) (base + head->trees);
+    for (size_t i = 0; i < head->treec; i++) {
+        if (trees[i].kind == NIS_STREE_ATOM) {
+            trees[i].vsym = NULL;
+        }
+    }
+    NisHlfun *funv = (NisHlfun *) (base + head->funv);
+    for (size_t i = 0; i < head->func; i++) {
+        funv[i].name = NULL;
+    }
+    // each name is interned once, the refs only copy the pointer
+    const struct ImageSymbol *syms = (const struct ImageSymbol *) (base + head->syms);
+    const NisSymbol **symbols = malloc(head->symc * sizeof(NisSymbol *));
+    for (size_t i = 0; i < head->symc; i++) {
+        if (!nis_image_span_eh(head, syms[i].name, syms[i].len, 1)) {
+            free(symbols);
+            munmap(base, statbuf.st_size);
+            return nis_bad_image(path);
+        }
+        symbols[i] = nis_intern(base + syms[i].name, syms[i].len);
+    }
+    const struct ImageSymbolRef *refs = (const struct ImageSymbolRef *) (base + head->refs);
+    for (size_t i = 0; i < head->refc; i++) {
+        if (!nis_image_slot_eh(head, refs[i].slot) || refs[i].sym >= head->symc) {
+            free(symbols);
+            munmap(base, statbuf.st_size);
+            return nis_bad_image(path);
+        }
+        memcpy(base + refs[i].slot, symbols + refs[i].sym, sizeof(NisSymbol *));
+    }
+    free(symbols);
+    if (!nis_image_valid_eh(head, base)) {
+        munmap(base, statbuf.st_size);
+        return nis_bad_image(path);
+    }
+
+    // the builder grows its function table, so only that is copied out of
+    // the mapping.  Instructions stay in it until the builder first changes
+    // their function, see NisHlfun.
+    nis_new_hlbuilder(dest, gc);
+    while (dest->funs < head->func) {
+        dest->funs *= 2;
+    }
+    dest->funv = realloc(dest->funv, dest->funs * sizeof(NisHlfun));
+    dest->func = head->func;
+    dest->funent = head->funent;
+    dest->regcnt = head->regcnt;
+    for (size_t i = 0; i < head->func; i++) {
+        NisHlfun *fun = dest->funv + i;
+        fun->present = funv[i].present;
+        fun->name = funv[i].name;
+        fun->insc = fun->present ? funv[i].insc : 0;
+        fun->inss = 0;
+        fun->insv = fun->insc ? funv[i].insv : NULL;
+    }
+    nis_hlb_reindex(dest);
+
+    *len = head->valuec;
+    *values = malloc(*len * sizeof(NisValue));
+    memcpy(*values, base + head->values, *len * sizeof(NisValue));
+    nis_gc_add_image(gc, base, head->len, (NisStree *) (base + head->trees), head->fieldc);
+    return 0;
+}
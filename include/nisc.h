@@ -1,16 +1,28 @@
 #ifndef NISC_H
 #define NISC_H 1
 
+#include <limits.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include "riscv.h"
 
-#define NIS_FLAG_MARK 0x1
 #define NIS_FLAG_INLINE 0x2
-
+#define NIS_FLAG_OWNED 0x4
+// an old tree on the remembered set
+#define NIS_FLAG_REMEMBERED 0x8
+// a nursery tree that was moved, `vforward` is the new address
+#define NIS_FLAG_FORWARDED 0x10
+// a tree with a source span, see nis_span.  The span is kept beside the
+// tree's cell and only valid while this is set.
+#define NIS_FLAG_SPAN 0x20
+// only set while a NIS_GC_VERIFY build checks a released region
+#define NIS_FLAG_VISITED 0x40
+
+// a tree that is or was a key of a NisWeakTable
 #define NIS_FLAG_WEAK 0x1
 
+typedef struct NisSymbol NisSymbol;
 typedef struct NisToken NisToken;
 typedef struct NisView NisView;
 typedef struct NisValue NisValue;
@@ -19,6 +31,7 @@ typedef struct NisPair NisPair;
 typedef struct NisVector NisVector;
 typedef struct NisByteVector NisByteVector;
 typedef struct NisGc NisGc;
+typedef struct NisWeakTable NisWeakTable;
 typedef struct NisHlbc NisHlbc;
 typedef struct NisHlarg NisHlarg;
 typedef struct NisHlfun NisHlfun;
@@ -31,6 +44,7 @@ enum {
     NIS_TOKEN_CHAR,
     NIS_TOKEN_INT,
     NIS_TOKEN_FLOAT,
+    NIS_TOKEN_STRING,
     NIS_TOKEN_DOT,
     NIS_TOKEN_SINGLE_QUOTE,
     NIS_TOKEN_U8PARENL,
@@ -50,6 +64,7 @@ enum {
     NIS_TOKEN_INLINE,
     NIS_TOKEN_LABEL,
     NIS_TOKEN_REFERENCE,
+    NIS_TOKEN_ESCAPED,
 };
 
 struct NisView {
@@ -58,6 +73,14 @@ struct NisView {
     size_t len;
 };
 
+struct NisSymbol {
+    // owned by the symbol table
+    const char *name;
+    size_t len;
+    uint32_t hash;
+    uint32_t id;
+};
+
 struct NisToken {
     int kind;
     int subkind;
@@ -67,9 +90,10 @@ struct NisToken {
         long vint;
         double vfloat;
         uint32_t vchar;
-        // owned
-        char *vatom;
-        char vinline[8];
+        // interned
+        const NisSymbol *vsym;
+        // borrowed from the source, owned if subkind is NIS_TOKEN_ESCAPED
+        NisView vstr;
     };
 };
 
@@ -79,28 +103,59 @@ struct NisTokens {
     size_t len;
 };
 
+#define NIS_LEXER_RING 8
+
+struct NisLexer {
+    // borrowed
+    const char *src;
+    size_t len;
+    size_t offset;
+    // borrowed, only set when replaying a `struct NisTokens`
+    struct NisTokens *tokens;
+    int status;
+    size_t head;
+    size_t count;
+    // owned
+    NisToken ring[NIS_LEXER_RING];
+};
+
+// a value is one tagged word: a fixnum has the low bit set, a tree is a
+// pointer with the low three bits clear, and any other immediate has
+// NIS_TAG_IMM there and its NIS_VALUE_* kind above it
+#define NIS_TAG_FIXNUM 0x1
+#define NIS_TAG_IMM 0x2
+#define NIS_TAG_MASK 0x7
+#define NIS_IMMEDIATE(kind) ((uintptr_t) (kind) << 3 | NIS_TAG_IMM)
+// a fixnum has one bit less than a long, larger ints are boxed
+#define NIS_FIXNUM_MIN (LONG_MIN >> 1)
+#define NIS_FIXNUM_MAX (LONG_MAX >> 1)
+
+struct NisValue {
+    uintptr_t bits;
+};
+
 enum {
-    NIS_STREE_FALSE = 0,
-    NIS_STREE_TRUE = 1,
+    // ints that are not fixnums, and floats
     NIS_STREE_INT,
     NIS_STREE_FLOAT,
-    NIS_STREE_NIL,
     NIS_STREE_PAIR,
     NIS_STREE_VECTOR,
     NIS_STREE_BYTE_VECTOR,
     NIS_STREE_ATOM,
+    NIS_STREE_STRING,
+    NIS_STREE_KINDS,
 };
 
 struct NisPair {
     // gc'ed
-    NisStree *car;
+    NisValue car;
     // gc'ed
-    NisStree *cdr;
+    NisValue cdr;
 };
 
 struct NisVector {
     // gc-owned
-    NisStree **ptr;
+    NisValue *ptr;
     size_t len;
     size_t cap;
 };
@@ -112,28 +167,31 @@ struct NisByteVector {
     size_t cap;
 };
 
+// a tree only takes the bytes of the union its kind uses, a pair is the
+// header word and two values
 struct NisStree {
-    int kind;
-    int flags;
-    NisStree *next;
-    NisView span;
+    unsigned char kind;
+    unsigned char flags;
     union {
+        // the copy of a forwarded nursery tree
+        NisStree *vforward;
         long vint;
         double vfloat;
         NisPair vpair;
         NisVector vvec;
         NisByteVector vbvec;
-        // gc-owned
-        const char *vatom;
-        const char vinline[24];
+        // interned
+        const NisSymbol *vsym;
+        // borrowed, gc-owned with NIS_FLAG_OWNED
+        NisView vstr;
     };
 };
 
 enum {
     NIS_VALUE_FALSE,
     NIS_VALUE_TRUE,
+    NIS_VALUE_NIL,
     NIS_VALUE_INT,
-    NIS_VALUE_FLOAT,
     NIS_VALUE_TREE,
     // special forms
     NIS_VALUE_LAMBDA,
@@ -175,40 +233,263 @@ enum {
     NIS_VALUE_SYNTAX_ERROR,
 };
 
-struct NisValue {
-    int kind;
-    int flags;
-    union {
-        long vint;
-        double vfloat;
-        // gc'ed
-        NisStree *vtree;
-    };
+static inline int nis_value_kind(NisValue value) {
+    if (value.bits & NIS_TAG_FIXNUM) {
+        return NIS_VALUE_INT;
+    } else if (!(value.bits & NIS_TAG_MASK)) {
+        return NIS_VALUE_TREE;
+    }
+    return value.bits >> 3;
+}
+
+static inline bool nis_tree_eh(NisValue value) {
+    return !(value.bits & NIS_TAG_MASK);
+}
+
+static inline bool nis_nil_eh(NisValue value) {
+    return value.bits == NIS_IMMEDIATE(NIS_VALUE_NIL);
+}
+
+// `value` must be a fixnum
+static inline long nis_value_int(NisValue value) {
+    return (intptr_t) value.bits >> 1;
+}
+
+// `value` must be a tree
+static inline NisStree *nis_value_tree(NisValue value) {
+    return (NisStree *) value.bits;
+}
+
+static inline bool nis_pair_eh(NisValue value) {
+    return nis_tree_eh(value) && nis_value_tree(value)->kind == NIS_STREE_PAIR;
+}
+
+// the heap is carved into pages, a page either holds objects of a single
+// size class or is part of a run of pages for one large object
+#define NIS_PAGE_SIZE 8192
+// 8 to 128 bytes in steps of 8, then four classes per power of two up to
+// NIS_SMALL_MAX
+#define NIS_SIZE_CLASSES 28
+#define NIS_SMALL_MAX 1024
+// new trees are bumped into the nursery, a safepoint past half of it runs
+// a minor collection
+#define NIS_NURSERY_SIZE (2 * 1024 * 1024)
+
+// trees are kept in cells of these sizes, one size per tree page
+enum {
+    NIS_CELL_16,
+    NIS_CELL_24,
+    NIS_CELL_32,
+    NIS_CELLS,
 };
 
-struct NisAllocFrame {
-    // borrowed
-    struct NisAllocFrame *next;
+enum {
+    // tree pages are NIS_PAGE_TREES + a NIS_CELL_*
+    NIS_PAGE_TREES = 0xfb,
+    NIS_PAGE_FREE = 0xfe,
+    NIS_PAGE_LARGE = 0xff,
+};
+
+// cells on a tree page, each has a bit in the chunk bitmaps, which are
+// sized for the smallest cells
+#define NIS_TREE_SLOTS (NIS_PAGE_SIZE / 16)
+#define NIS_TREE_WORDS ((NIS_TREE_SLOTS + 63) / 64)
+
+struct NisPage {
+    // a size class, a tree page, NIS_PAGE_FREE or NIS_PAGE_LARGE
+    unsigned char sizeclass;
+    // the collection a tree page was last swept after
+    unsigned char epoch;
+    // unused objects on a small page, only counted while trimming
+    uint16_t freec;
+    // pages in the run, on the first page of a large object and on the
+    // first and last page of a free run
+    uint32_t run;
+};
+
+// one mapping of the heap, the heap grows by mapping more of them
+struct NisChunk {
+    // owned
+    char *base;
     size_t len;
+    // owned, one bit per page, set on the pages of free runs
+    uint64_t *freemap;
+    size_t freepages;
+    // owned, one per page
+    struct NisPage *pages;
+    // owned, NIS_TREE_WORDS per page, one bit per cell: in use,
+    // reached by the last mark, and owning memory that dies with the tree
+    uint64_t *used;
+    uint64_t *marks;
+    uint64_t *owns;
+    // owned, one array per page indexed like the bitmaps, NULL until a
+    // tree on the page gets a span
+    NisView **spans;
 };
 
-struct NisGc {
+struct NisSizeClass {
+    // borrowed, freed objects linked through their first word
+    void *free;
+    // borrowed, the unused rest of the newest page
+    char *cursor;
+    char *limit;
+    // pages held and objects handed out
+    size_t pagec;
+    size_t live;
+};
+
+// the tree page being filled with cells of one size
+struct NisTreeClass {
+    // borrowed, the page and its `used` and `marks` bits
+    char *page;
+    uint64_t *used;
+    uint64_t *marks;
+    unsigned slot;
+    // tree pages are swept when allocation reaches them, this is the next
+    // one of this size by chunk and page
+    size_t sweepchunk;
+    size_t sweeppage;
+};
+
+// a point in the nursery to go back to, see nis_gc_mark_region
+struct NisGcMark {
+    size_t nurserylen;
+    size_t minors;
+};
+
+// `*values` holds `*len` live values whenever the collector runs
+struct NisGcRoot {
     // borrowed
-    struct NisAllocFrame *prev;
+    NisValue **values;
+    size_t *len;
+};
+
+struct NisWeakEntry {
+    uint32_t hash;
+    // NULL in an empty slot
+    NisStree *tree;
+};
+
+// a hash set of trees that does not keep them alive, the collector drops
+// the entries of trees that died.  Hashes are of the contents, so they
+// stay valid when a tree moves out of the nursery.
+struct NisWeakTable {
     // owned
-    void *buffer;
+    struct NisWeakEntry *slots;
+    size_t cap;
+    size_t count;
+    // entries whose tree is young
+    size_t young;
+};
+
+// running totals of a heap, each only an increment where it is counted
+struct NisGcCounters {
+    // trees made by kind, and nursery trees that survived a minor
+    // collection
+    size_t trees[NIS_STREE_KINDS];
+    size_t promoted;
+    // nis_alloc calls by size class, large objects last, and the bytes
+    // asked for
+    size_t allocs[NIS_SIZE_CLASSES + 1];
+    size_t allocbytes[NIS_SIZE_CLASSES + 1];
+    // the most bytes in objects and the nursery seen at a safepoint
+    size_t peak;
+    // marks completed, and how long the mutator was stopped for
+    // collections, in nanoseconds.  A major pause includes the minor
+    // collection it starts with.
+    size_t majors;
+    uint64_t minorns;
+    uint64_t minormax;
+    uint64_t majorns;
+    uint64_t majormax;
+};
+
+// a heap at one point, see nis_gc_stats
+struct NisGcStats {
+    struct NisGcCounters counters;
+    // bytes of the trees in `counters.trees`
+    size_t treebytes[NIS_STREE_KINDS];
+    size_t minors;
     size_t len;
     size_t capacity;
+    // the object size of each size class, its pages, the bytes of objects
+    // handed out from them and the objects on their free lists
+    size_t classsize[NIS_SIZE_CLASSES];
+    size_t classpages[NIS_SIZE_CLASSES];
+    size_t classbytes[NIS_SIZE_CLASSES];
+    size_t classfree[NIS_SIZE_CLASSES];
+    // each cell size, its tree pages and the cells in use on them
+    size_t cellsize[NIS_CELLS];
+    size_t cellpages[NIS_CELLS];
+    size_t cellsused[NIS_CELLS];
+    // free pages, the runs they form and the longest of those
+    size_t freepages;
+    size_t freeruns;
+    size_t longestrun;
+};
 
-    // gc'ed
-    NisStree *nil;
-    NisStree *t;
-    NisStree *f;
-    
-    // borrowed
-    NisStree *last;
+// a heap image mapped by nis_load_image, whose trees are never moved or
+// freed
+struct NisGcImage {
+    // owned, a private mapping
+    void *base;
+    size_t len;
+    // borrowed, points into `base`
+    NisStree *trees;
+    size_t treec;
+};
+
+struct NisGc {
+    // owned, ordered by address
+    struct NisChunk *chunks;
+    size_t chunkc;
+    // bytes in objects not yet freed, dead trees count until their page
+    // is swept
+    size_t len;
+    // bytes mapped in `chunks`
+    size_t capacity;
+    struct NisSizeClass classes[NIS_SIZE_CLASSES];
+
+    // owned, trees that do not own other memory start here
+    char *nursery;
+    // bytes used in `nursery`
+    size_t nurserylen;
+    // owned, the spans of young trees, one per 16 bytes of `nursery`
+    NisView *nurseryspans;
+    // minor collections so far
+    size_t minors;
+    // owned, old trees that may point into the nursery
+    NisStree **remembered;
+    size_t rememberedc;
+    size_t rememberedcap;
+
+    struct NisTreeClass cells[NIS_CELLS];
+    unsigned char epoch;
+
+    // bytes in trees outside the nursery, live at the last mark or
+    // allocated since, counted by the cells they take
     size_t allocated;
     size_t threshold;
+
+    // marks run on a background thread, see nis_gc_concurrent
+    bool concurrent;
+    // owned, the mark running in the background
+    struct NisMarkCycle *cycle;
+
+    // owned
+    struct NisGcRoot *roots;
+    size_t rootc;
+    // owned, values that do not keep their trees alive, and the tables
+    // the collector drops entries from
+    struct NisGcRoot *weaks;
+    size_t weakc;
+    NisWeakTable **tables;
+    size_t tablec;
+    // owned
+    struct NisGcImage *images;
+    size_t imagec;
+
+    struct NisGcCounters counters;
 };
 
 enum {
@@ -288,10 +569,12 @@ struct NisHlbc {
 
 struct NisHlfun {
     bool present;
-    const char *name;
+    // interned
+    const NisSymbol *name;
     size_t inss;
     size_t insc;
-    // owned
+    // owned, unless `inss` is 0: then it and the argv of its instructions
+    // are in the mapping of an image, and copied out before they change
     NisHlbc *insv;
 };
 
@@ -305,6 +588,11 @@ struct NisHlbuilder {
     // owned
     NisHlfun *funv;
     int32_t funent;
+    // owned, the funref of each present name, -1 for an empty slot.
+    // Open addressing on the symbol hash, `indexcap` is a power of two.
+    int32_t *index;
+    size_t indexcap;
+    size_t indexc;
 };
 
 struct NisHlprog {
@@ -318,9 +606,26 @@ struct NisHlprog {
 
 extern const char *TOKEN_STRINGS[];
 
+// symbols live until nis_del_symbols, equal names give equal pointers
+const NisSymbol *nis_intern(const char *name, size_t len);
+const NisSymbol *nis_intern_str(const char *name);
+void nis_del_symbols(void);
+// must be on while more than one thread may intern
+void nis_symbols_concurrent(bool on);
+
 int nis_lex(struct NisTokens *dest, const char *src, size_t len);
 void nis_del_tokens(struct NisTokens *tokens);
 
+void nis_new_lexer(struct NisLexer *dest, const char *src, size_t len);
+void nis_new_token_lexer(struct NisLexer *dest, struct NisTokens *tokens);
+void nis_del_lexer(struct NisLexer *lexer);
+// on by default, off lexes a byte at a time through the character table.
+// Both give the same tokens.  Not to be switched while lexing.
+void nis_lex_vectors(bool on);
+// the returned token stays valid until NIS_LEXER_RING - 1 more are pulled
+NisToken *nis_lexer_peek(struct NisLexer *lexer);
+NisToken *nis_lexer_next(struct NisLexer *lexer);
+
 static inline size_t nis_align_down(size_t arg, size_t align) {
     return arg & ~(align - 1);
 }
@@ -329,8 +634,84 @@ static inline size_t nis_align_up(size_t arg, size_t align) {
     return nis_align_down(arg + align - 1, align);
 }
 
+// `capacity` is only the size of the first chunk, the heap grows as needed
 void nis_new_gc(NisGc *dest, size_t capacity);
 void nis_del_gc(NisGc *dest);
+// hands the chunks of `region`, filled by another thread without locks,
+// over to `gc`, which allocates from and collects them like its own
+void nis_gc_adopt(NisGc *gc, NisGc *region);
+// objects reachable from no root are freed by nis_gc_collect, which only
+// runs when called or at a safepoint.  Values held in C locals across a
+// safepoint must be rooted, and trees may move out of the nursery, so
+// only the roots see their new address.
+void nis_gc_add_root(NisGc *gc, NisValue **values, size_t *len);
+void nis_gc_remove_root(NisGc *gc, NisValue **values);
+void nis_gc_collect(NisGc *gc);
+// moves the live trees in the nursery to the heap and empties it
+void nis_gc_minor(NisGc *gc);
+// collects once `allocated` reaches `threshold`, or runs a minor
+// collection once the nursery is half full
+void nis_gc_safepoint(NisGc *gc);
+// with `on`, a collection only stops the mutator to take the roots and,
+// at a later safepoint, to finish the mark, which runs on its own thread
+// in between.  nis_gc_collect still waits for the whole collection.
+void nis_gc_concurrent(NisGc *gc, bool on);
+// reads the counters of `gc` and walks its pages, so it
+// is meant for reports rather than for every safepoint
+void nis_gc_stats(struct NisGcStats *dest, NisGc *gc);
+// for phases that build trees which are all garbage once they end: the
+// nursery trees allocated since the mark are freed without a trace.  The
+// release still walks the remembered set, every weak root and each weak
+// table holding young trees, so it costs what those hold, not what the
+// phase built.  Trees that went to the heap meanwhile are left to the next
+// collection, and if a minor collection ran in between nothing is freed
+// and false is returned.  The phase must not store its trees into live old
+// ones.  Built with NIS_GC_VERIFY, the release checks that no tree
+// reachable from the roots points at what it frees.
+void nis_gc_mark_region(NisGc *gc, struct NisGcMark *dest);
+bool nis_gc_release_region(NisGc *gc, const struct NisGcMark *mark);
+void nis_gc_remember(NisGc *gc, NisStree *tree);
+void nis_gc_log(NisGc *gc, NisStree *owner, NisValue old);
+// the trees in `*values` are not kept alive by it: once only weak values
+// point at a tree the collector sets them to #f, and they follow a tree
+// that moves.  A value read from them while a mark runs in the background
+// must be passed to nis_gc_keep before it is stored anywhere else.
+void nis_gc_add_weak(NisGc *gc, NisValue **values, size_t *len);
+void nis_gc_remove_weak(NisGc *gc, NisValue **values);
+void nis_gc_keep(NisGc *gc, NisValue value);
+
+void nis_new_weak_table(NisWeakTable *dest, NisGc *gc);
+void nis_del_weak_table(NisWeakTable *table, NisGc *gc);
+// the tree with `hash` that `eq` accepts, NULL if there is none
+NisStree *nis_weak_find(NisGc *gc, NisWeakTable *table, uint32_t hash,
+                        bool (*eq)(const NisStree *tree, const void *arg), const void *arg);
+void nis_weak_add(NisGc *gc, NisWeakTable *table, uint32_t hash, NisStree *tree);
+// hands the mapping to `gc`, the fields of `trees` are roots from now on
+void nis_gc_add_image(NisGc *gc, void *base, size_t len, NisStree *trees, size_t treec);
+
+static inline bool nis_young_eh(NisGc *gc, const void *ptr) {
+    return (uintptr_t) ptr - (uintptr_t) gc->nursery < NIS_NURSERY_SIZE;
+}
+
+// must follow every store of `value` into a field of `owner`
+static inline void nis_gc_write(NisGc *gc, NisStree *owner, NisValue value) {
+    if (nis_tree_eh(value)
+        && nis_young_eh(gc, nis_value_tree(value))
+        && !nis_young_eh(gc, owner)
+        && !(owner->flags & NIS_FLAG_REMEMBERED)) {
+        nis_gc_remember(gc, owner);
+    }
+}
+
+// stores `value` into `*field` of `owner` once `owner` is built.  A mark
+// in the background must still see the value overwritten.
+static inline void nis_gc_store(NisGc *gc, NisStree *owner, NisValue *field, NisValue value) {
+    if (gc->cycle) {
+        nis_gc_log(gc, owner, *field);
+    }
+    __atomic_store_n(&field->bits, value.bits, __ATOMIC_RELEASE);
+    nis_gc_write(gc, owner, value);
+}
 
 void *nis_alloc(NisGc *gc, size_t size);
 void nis_dealloc(NisGc *gc, void *ptr, size_t size);
@@ -345,12 +726,27 @@ void nis_nil(NisValue *dest, NisGc *gc);
 void nis_pair(NisValue *dest, NisGc *gc, NisValue *car, NisValue *cdr);
 void nis_vector(NisValue *dest, NisGc *gc);
 void nis_byte_vector(NisValue *dest, NisGc *gc);
-void nis_atom(NisValue *dest, NisGc *gc, const char *value);
+void nis_atom(NisValue *dest, NisGc *gc, const NisSymbol *value);
+void nis_string(NisValue *dest, NisGc *gc, const char *value, size_t len);
+void nis_string_copy(NisValue *dest, NisGc *gc, const char *value, size_t len);
 void nis_special(NisValue *dest, NisGc *gc, int value);
 
-NisStree *nis_value_to_stree(NisGc *gc, NisValue *value);
+// source spans are kept beside the cells, walking the trees never loads
+// them
+void nis_set_span(NisGc *gc, NisStree *tree, const NisView *span);
+bool nis_span(NisView *dest, NisGc *gc, const NisStree *tree);
 
 int nis_parse(NisValue **dest, size_t *len, NisGc *gc, struct NisTokens *tokens);
+int nis_parse_stream(NisValue **dest, size_t *len, NisGc *gc, struct NisLexer *lexer);
+// list-heavy source takes up to about 12 heap bytes per byte once parsed,
+// strings and numbers far less
+#define NIS_HEAP_PER_BYTE 12
+#define NIS_HEAP_MIN (256 * 1024)
+
+// splits `src` at top-level forms and parses the pieces on `threads`
+// threads, each into its own heap that `gc` adopts.  Those heaps start
+// sized for their share of `src`, so `gc` itself can start small.
+int nis_parse_parallel(NisValue **dest, size_t *len, NisGc *gc, const char *src, size_t srclen, size_t threads);
 
 size_t nis_display(char *dest, size_t len, NisValue *value);
 
@@ -367,21 +763,30 @@ size_t nis_value_list_length(NisValue *value);
                                     NisValue *: nis_value_list_length)(x)
 
 static inline bool nis_tree_true_eh(NisStree *tree) {
-    return tree->kind != NIS_STREE_FALSE;
+    (void) tree;
+    return true;
 }
 
 static inline bool nis_value_true_eh(NisValue *value) {
-    return value->kind != NIS_VALUE_FALSE;
+    return value->bits != NIS_IMMEDIATE(NIS_VALUE_FALSE);
 }
 #define nis_true_eh(x) _Generic((x),                                    \
-                               NisStree *: nis_tree_list_eh,            \
-                               NisValue *: nis_value_list_eh)(x)
+                               NisStree *: nis_tree_true_eh,            \
+                               NisValue *: nis_value_true_eh)(x)
 
 void nis_new_hlbuilder(NisHlbuilder *dest, NisGc *gc);
+// for a builder that was never built, nis_build_hlbuilder moves what it
+// owns into the program
+void nis_del_hlbuilder(NisHlbuilder *b);
 void nis_build_hlbuilder(NisHlprog *dest, NisHlbuilder *b);
+void nis_del_hlprog(NisHlprog *prog);
 void nis_hlb_entry(NisHlbuilder *b, int32_t funref);
 int32_t nis_hlb_addfun(NisHlbuilder *b, const char *name);
 void nis_hlb_rmfun(NisHlbuilder *b, int32_t funref);
+// the first present function called `name`, or -1
+int32_t nis_hlb_findfun(NisHlbuilder *b, const NisSymbol *name);
+// for when `funv` was filled in directly
+void nis_hlb_reindex(NisHlbuilder *b);
 void nis_hlb_del_ins(NisHlbc *ins);
 
 void nis_hlb_build_call(NisHlarg *dest, NisHlbuilder *b, /* moved */ NisHlarg *argv, size_t argc);
@@ -401,4 +806,12 @@ void nis_hlb_make_prelude(NisHlbuilder *b);
 int nis_to_hlbc(NisHlprog *dest, NisHlbuilder *b, NisValue *program, size_t proglen);
 size_t nis_hlbc_display(char *dest, size_t len, NisHlprog *prog);
 
+// writes the functions of `b` and `values`, with all trees they reach, to
+// a file that nis_load_image maps back in a later run.  Both report their
+// errors and return nonzero on failure.
+int nis_dump_image(const char *path, NisHlbuilder *b, NisValue *values, size_t len);
+// a builder holding the dumped functions, and the dumped values in `*values`,
+// whose trees stay in the mapping for as long as `gc` lives
+int nis_load_image(NisHlbuilder *dest, NisValue **values, size_t *len, NisGc *gc, const char *path);
+
 #endif /* NISC_H */
@@ -0,0 +1,50 @@
+#ifndef NISC_PRIV_H
+#define NISC_PRIV_H 1
+
+#include "nisc.h"
+
+#if !defined(NIS_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define NIS_SIMD_WIDTH 32
+#define NIS_SIMD_FULL 0xffffffffu
+#elif !defined(NIS_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define NIS_SIMD_WIDTH 16
+#define NIS_SIMD_FULL 0xffffu
+#endif
+
+// character classes, see NIS_CHAR_CLASS
+#define NIS_CHAR_SPACE 0x1
+#define NIS_CHAR_DIGIT 0x2
+#define NIS_CHAR_IDENT_BEGIN 0x4
+#define NIS_CHAR_IDENT_CONT 0x8
+
+extern const unsigned char NIS_CHAR_CLASS[256];
+
+static inline bool nis_char_eh(int ch, int class) {
+    return NIS_CHAR_CLASS[(unsigned char) ch] & class;
+}
+
+// each returns the offset of the first byte in `src[offset..len)` that
+// does not belong to the run, or `len`
+size_t nis_scan_space(const char *src, size_t offset, size_t len);
+size_t nis_scan_digits(const char *src, size_t offset, size_t len);
+size_t nis_scan_ident(const char *src, size_t offset, size_t len);
+// stops at `"` or `\`
+size_t nis_scan_string(const char *src, size_t offset, size_t len);
+// the first byte in `src[offset..len)` that is not part of a valid UTF-8
+// sequence, or `len`
+size_t nis_scan_utf8(const char *src, size_t offset, size_t len);
+// the length of the sequence at `src[offset]`, 0 if it is invalid
+size_t nis_utf8_decode(const char *src, size_t offset, size_t len, uint32_t *code);
+// writes 1 to 4 bytes
+size_t nis_utf8_encode(char *dest, uint32_t code);
+
+// `src[offset..end)` must be all digits, false on overflow
+bool nis_parse_decimal(const char *src, size_t offset, size_t end, uint64_t *value);
+// strtod and snprintf of one `prec` and one double, with `.` as the
+// decimal point whatever LC_NUMERIC is
+double nis_c_strtod(const char *str);
+int nis_c_format(char *dest, size_t len, const char *format, int prec, double value);
+
+#endif /* NISC_PRIV_H */
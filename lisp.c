@@ -1,43 +1,31 @@
 #include "include/nisc.h"
 
 bool nis_tree_list_eh(NisStree *tree) {
-    if (tree->kind == NIS_STREE_NIL) {
-        return true;
-    }
-    if (tree->kind != NIS_STREE_PAIR) {
-        return false;
-    }
-
-    return nis_tree_list_eh(tree->vpair.cdr);
+    return tree->kind == NIS_STREE_PAIR && nis_value_list_eh(&tree->vpair.cdr);
 }
 
 bool nis_value_list_eh(NisValue *value) {
-    if (value->kind != NIS_VALUE_TREE) {
-        return false;
+    NisValue rest = *value;
+    while (nis_pair_eh(rest)) {
+        rest = nis_value_tree(rest)->vpair.cdr;
     }
-
-    return nis_tree_list_eh(value->vtree);
+    return nis_nil_eh(rest);
 }
 
-size_t nis_tree_list_length_inner(NisStree *tree, size_t acc) {
-    if (tree->kind == NIS_STREE_NIL) {
-        return acc;
-    }
+size_t nis_tree_list_length(NisStree *tree) {
     if (tree->kind != NIS_STREE_PAIR) {
         return 0;
     }
-
-    return nis_tree_list_length_inner(tree->vpair.cdr, acc + 1);
-}
-    
-size_t nis_tree_list_length(NisStree *tree) {
-    return nis_tree_list_length_inner(tree, 0);
+    size_t len = nis_value_list_length(&tree->vpair.cdr);
+    return len || nis_nil_eh(tree->vpair.cdr) ? len + 1 : 0;
 }
 
 size_t nis_value_list_length(NisValue *value) {
-    if (value->kind != NIS_VALUE_TREE) {
-        return 0;
+    size_t len = 0;
+    NisValue rest = *value;
+    while (nis_pair_eh(rest)) {
+        rest = nis_value_tree(rest)->vpair.cdr;
+        ++len;
     }
-
-    return nis_tree_list_length(value->vtree);
+    return nis_nil_eh(rest) ? len : 0;
 }
@@ -1,57 +1,277 @@
+#define _DEFAULT_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include "include/nisc.h"
 
-int main(int argc, const char **argv) {
-    if (argc != 2) {
-        fprintf(stderr, "nisc:%s:%d: error: no input file\n", __FILE__, __LINE__);
-        exit(1);
+struct Source {
+    const char *ptr;
+    size_t len;
+    bool mapped;
+};
+
+static int nis_read_source(struct Source *dest, int fd) {
+    size_t cap = 64 * 1024;
+    char *buf = malloc(cap);
+    size_t len = 0;
+    for (;;) {
+        if (len == cap) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+        }
+        ssize_t n = read(fd, buf + len, cap - len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            free(buf);
+            return errno;
+        } else if (n == 0) {
+            break;
+        }
+        len += n;
+    }
+    dest->ptr = buf;
+    dest->len = len;
+    dest->mapped = false;
+    return 0;
+}
+
+// regular files are mapped and the tokens borrow straight from the
+// mapping, anything else (stdin, pipes) is read into a growing buffer
+static int nis_load_source(struct Source *dest, const char *path) {
+    if (strcmp(path, "-") == 0) {
+        return nis_read_source(dest, STDIN_FILENO);
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return errno;
     }
 
     struct stat statbuf;
-    int status = stat(argv[1], &statbuf);
-    if (status < 0) {
-        fprintf(stderr, "nisc:%s:%d: error: %s\n", __FILE__, __LINE__, strerror(errno));
-        exit(errno);
+    if (fstat(fd, &statbuf) < 0) {
+        int err = errno;
+        close(fd);
+        return err;
     }
 
-    size_t len;
-    const char *source;
-    {
-        FILE *fsrc = fopen(argv[1], "r");
-        char *src = malloc(statbuf.st_size);
-        len = fread(src, 1, statbuf.st_size, fsrc);
-        if (len != (size_t) statbuf.st_size) {
-            int err = errno;
-            fclose(fsrc);
-            fprintf(stderr, "nisc:%s:%d: error: %s\n", __FILE__, __LINE__, strerror(err));
-            exit(errno);
+    int status = 0;
+    if (!S_ISREG(statbuf.st_mode) || statbuf.st_size == 0) {
+        status = nis_read_source(dest, fd);
+    } else {
+        void *ptr = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED) {
+            status = errno;
+        } else {
+            madvise(ptr, statbuf.st_size, MADV_SEQUENTIAL);
+            dest->ptr = ptr;
+            dest->len = statbuf.st_size;
+            dest->mapped = true;
         }
-        fclose(fsrc);
-        source = src;
     }
-    
-    struct NisTokens tokens;
+    close(fd);
+    return status;
+}
+
+// inputs below this are parsed on the calling thread unless `-j` says
+// otherwise, splitting them costs more than it saves
+#define NIS_PARALLEL_MIN (1024 * 1024)
+
+static void nis_del_source(struct Source *source) {
+    if (source->mapped) {
+        munmap((void *) source->ptr, source->len);
+    } else {
+        free((void *) source->ptr);
+    }
+}
 
-    if ((status = nis_lex(&tokens, source, len))) {
+static const char *KIND_NAMES[NIS_STREE_KINDS] = {
+    [NIS_STREE_INT] = "int",
+    [NIS_STREE_FLOAT] = "float",
+    [NIS_STREE_PAIR] = "pair",
+    [NIS_STREE_VECTOR] = "vector",
+    [NIS_STREE_BYTE_VECTOR] = "byte-vector",
+    [NIS_STREE_ATOM] = "atom",
+    [NIS_STREE_STRING] = "string",
+};
+
+static void nis_print_gc_stats(NisGc *gc) {
+    struct NisGcStats stats;
+    nis_gc_stats(&stats, gc);
+    const struct NisGcCounters *counters = &stats.counters;
+    fprintf(stderr,
+            "gc: %zu bytes in objects, %zu mapped, peak %zu\n",
+            stats.len,
+            stats.capacity,
+            counters->peak);
+    for (size_t i = 0; i < NIS_STREE_KINDS; i++) {
+        if (counters->trees[i]) {
+            fprintf(stderr,
+                    "gc: %-11s %10zu trees %12zu bytes\n",
+                    KIND_NAMES[i],
+                    counters->trees[i],
+                    stats.treebytes[i]);
+        }
+    }
+    fprintf(stderr, "gc: promoted %zu trees\n", counters->promoted);
+    for (size_t i = 0; i < NIS_CELLS; i++) {
+        if (stats.cellpages[i]) {
+            size_t cells = stats.cellpages[i] * (NIS_PAGE_SIZE / stats.cellsize[i]);
+            fprintf(stderr,
+                    "gc: cell %4zu %10zu pages %5.1f%% used\n",
+                    stats.cellsize[i],
+                    stats.cellpages[i],
+                    100.0 * stats.cellsused[i] / cells);
+        }
+    }
+    for (size_t i = 0; i < NIS_SIZE_CLASSES; i++) {
+        if (counters->allocs[i] || stats.classpages[i]) {
+            size_t bytes = stats.classpages[i] * NIS_PAGE_SIZE;
+            fprintf(stderr,
+                    "gc: class %4zu %10zu allocs %12zu bytes %6zu pages %5.1f%% used %8zu free-listed\n",
+                    stats.classsize[i],
+                    counters->allocs[i],
+                    counters->allocbytes[i],
+                    stats.classpages[i],
+                    bytes ? 100.0 * stats.classbytes[i] / bytes : 0.0,
+                    stats.classfree[i]);
+        }
+    }
+    fprintf(stderr,
+            "gc: large %10zu allocs %12zu bytes\n",
+            counters->allocs[NIS_SIZE_CLASSES],
+            counters->allocbytes[NIS_SIZE_CLASSES]);
+    fprintf(stderr,
+            "gc: %zu free pages in %zu runs, longest %zu\n",
+            stats.freepages,
+            stats.freeruns,
+            stats.longestrun);
+    fprintf(stderr,
+            "gc: %zu minor collections, %.3f ms, longest %.3f ms\n",
+            stats.minors,
+            counters->minorns / 1e6,
+            counters->minormax / 1e6);
+    fprintf(stderr,
+            "gc: %zu major collections, %.3f ms stopped, longest %.3f ms\n",
+            counters->majors,
+            counters->majorns / 1e6,
+            counters->majormax / 1e6);
+}
+
+int main(int argc, const char **argv) {
+    const char *path = NULL;
+    const char *image = NULL;
+    const char *dump = NULL;
+    long threads = 0;
+    bool concurrent = false;
+    bool gcstats = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--concurrent-gc") == 0) {
+            concurrent = true;
+        } else if (strcmp(argv[i], "--gc-stats") == 0) {
+            gcstats = true;
+        } else if (strcmp(argv[i], "--scalar-lexer") == 0) {
+            nis_lex_vectors(false);
+        } else if (strcmp(argv[i], "--image") == 0 || strcmp(argv[i], "--dump-image") == 0) {
+            if (i + 1 == argc) {
+                fprintf(stderr, "nisc:%s:%d: error: %s needs a file\n", __FILE__, __LINE__, argv[i]);
+                exit(1);
+            }
+            if (strcmp(argv[i], "--image") == 0) {
+                image = argv[++i];
+            } else {
+                dump = argv[++i];
+            }
+        } else if (strncmp(argv[i], "-j", 2) == 0) {
+            const char *arg = argv[i][2] ? argv[i] + 2 : i + 1 < argc ? argv[++i] : "";
+            char *end;
+            threads = strtol(arg, &end, 10);
+            if (*arg == '\0' || *end != '\0' || threads < 1) {
+                fprintf(stderr, "nisc:%s:%d: error: invalid thread count: %s\n", __FILE__, __LINE__, arg);
+                exit(1);
+            }
+        } else if (path) {
+            fprintf(stderr, "nisc:%s:%d: error: more than one input file\n", __FILE__, __LINE__);
+            exit(1);
+        } else {
+            path = argv[i];
+        }
+    }
+    // the prelude is built once and written out instead of compiling
+    if (dump) {
+        NisGc gc;
+        nis_new_gc(&gc, NIS_HEAP_MIN);
+        NisHlbuilder b;
+        nis_new_hlbuilder(&b, &gc);
+        nis_hlb_make_prelude(&b);
+        int status = nis_dump_image(dump, &b, NULL, 0);
+        nis_del_gc(&gc);
+        nis_del_symbols();
+        exit(status);
+    }
+    if (!path) {
+        fprintf(stderr, "nisc:%s:%d: error: no input file\n", __FILE__, __LINE__);
+        exit(1);
+    }
+
+    struct Source source;
+    int status = nis_load_source(&source, path);
+    if (status) {
+        fprintf(stderr, "nisc:%s:%d: error: %s\n", __FILE__, __LINE__, strerror(status));
         exit(status);
     }
 
+    if (threads == 0) {
+        threads = source.len < NIS_PARALLEL_MIN ? 1 : sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    // the first chunk is sized for the input, the heap grows past it when
+    // the guess is short.  A parallel parse sizes the heaps of its workers
+    // instead, and this one takes over their chunks.
     NisGc gc;
-    nis_new_gc(&gc, 1024 * 1024);
+    nis_new_gc(&gc, threads > 1 ? NIS_HEAP_MIN : NIS_HEAP_MIN + NIS_HEAP_PER_BYTE * source.len);
+    nis_gc_concurrent(&gc, concurrent);
+
+    // the prelude comes before the program, mapped from an image when
+    // there is one instead of built
+    NisHlbuilder b;
+    if (image) {
+        NisValue *values;
+        size_t len;
+        if ((status = nis_load_image(&b, &values, &len, &gc, image))) {
+            nis_del_gc(&gc);
+            nis_del_source(&source);
+            exit(status);
+        }
+        free(values);
+    } else {
+        nis_new_hlbuilder(&b, &gc);
+        nis_hlb_make_prelude(&b);
+    }
 
     NisValue *program = NULL;
     size_t proglen;
-    if ((status = nis_parse(&program, &proglen, &gc, &tokens))) {
+    if (threads > 1) {
+        status = nis_parse_parallel(&program, &proglen, &gc, source.ptr, source.len, threads);
+    } else {
+        struct NisLexer lexer;
+        nis_new_lexer(&lexer, source.ptr, source.len);
+        status = nis_parse_stream(&program, &proglen, &gc, &lexer);
+        nis_del_lexer(&lexer);
+    }
+    if (status) {
         free(program);
-        nis_del_tokens(&tokens);
-        free((void *) source);
+        nis_del_gc(&gc);
+        nis_del_source(&source);
         exit(status);
     }
-    nis_del_tokens(&tokens);
+    nis_gc_add_root(&gc, &program, &proglen);
 
     for (size_t i = 0; i < proglen; i++) {
         const int cap = 1024;
@@ -60,15 +280,15 @@ int main(int argc, const char **argv) {
         fprintf(stdout, "%.*s\n", cap, buffer);
     }
 
-    NisHlbuilder b;
-    nis_new_hlbuilder(&b, &gc);
-    nis_hlb_make_prelude(&b);
-
     NisHlprog prog;
     if ((status = nis_to_hlbc(&prog, &b, program, proglen))) {
+        nis_del_hlbuilder(&b);
+        if (gcstats) {
+            nis_print_gc_stats(&gc);
+        }
         nis_del_gc(&gc);
         free(program);
-        free((void *) source);
+        nis_del_source(&source);
         exit(1);
     }
 
@@ -77,10 +297,15 @@ int main(int argc, const char **argv) {
     nis_hlbc_display(buffer, cap, &prog);
     fprintf(stdout, "%.*s", cap, buffer);
     
+    nis_del_hlprog(&prog);
     free(program);
 
+    if (gcstats) {
+        nis_print_gc_stats(&gc);
+    }
     nis_del_gc(&gc);
-    free((void *) source);
+    nis_del_symbols();
+    nis_del_source(&source);
 
     return 0;
 }
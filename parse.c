@@ -1,7 +1,10 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include "include/nisc.h"
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "include/nisc_priv.h"
 
 const char *TOKEN_STRINGS[] = {
     [NIS_TOKEN_NONE] = "<none>",
@@ -9,6 +12,7 @@ const char *TOKEN_STRINGS[] = {
     [NIS_TOKEN_CHAR] = "<character>",
     [NIS_TOKEN_INT] = "<integer>",
     [NIS_TOKEN_FLOAT] = "<real>",
+    [NIS_TOKEN_STRING] = "<string>",
     [NIS_TOKEN_DOT] = "`.`",
     [NIS_TOKEN_SINGLE_QUOTE] = "`'`",
     [NIS_TOKEN_U8PARENL] = "`u8(`",
@@ -27,6 +31,7 @@ const char *TOKEN_STRINGS[] = {
     [NIS_TOKEN_INLINE] = "<identifier>",
     [NIS_TOKEN_LABEL] = "<integer>`=`",
     [NIS_TOKEN_REFERENCE] = "<integer>`#`",
+    [NIS_TOKEN_ESCAPED] = "<string>",
     NULL,
 };
 
@@ -34,486 +39,871 @@ enum {
     NIS_LEX_NORMAL,
     NIS_LEX_HASH,
     NIS_LEX_STRING,
+    NIS_LEX_NUMBER,
 };
 
-static bool is_ident_begin(int ch) {
-    switch (ch) {
-    case '!': case '$': case '%': case '&': case '*':
-    case '+': case '-': case '.': case '/': case ':':
-    case '<': case '=': case '>': case '?': case '@':
-    case '^': case '_': case '~':
-    case 'a': case 'b': case 'c': case 'd': case 'e':
-    case 'f': case 'g': case 'h': case 'i': case 'j':
-    case 'k': case 'l': case 'm': case 'n': case 'o':
-    case 'p': case 'q': case 'r': case 's': case 't':
-    case 'u': case 'v': case 'w': case 'x': case 'y':
-    case 'z':
-    case 'A': case 'B': case 'C': case 'D': case 'E':
-    case 'F': case 'G': case 'H': case 'I': case 'J':
-    case 'K': case 'L': case 'M': case 'N': case 'O':
-    case 'P': case 'Q': case 'R': case 'S': case 'T':
-    case 'U': case 'V': case 'W': case 'X': case 'Y':
-    case 'Z':
-        return 1;
+static const double POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static int nis_digit_value(char ch) {
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+    } else if (ch >= 'a' && ch <= 'f') {
+        return ch - 'a' + 10;
+    } else if (ch >= 'A' && ch <= 'F') {
+        return ch - 'A' + 10;
+    }
+    return 99;
+}
+
+// [+-] (digit | . digit)
+static bool nis_number_begin_eh(const char *src, size_t offset, size_t len) {
+    if (offset < len && (src[offset] == '+' || src[offset] == '-')) {
+        ++offset;
+    }
+    if (offset < len && src[offset] == '.') {
+        ++offset;
+    }
+    return offset < len && nis_char_eh(src[offset], NIS_CHAR_DIGIT);
+}
+
+// the R7RS <delimiter>, and the brackets this reader takes as parentheses
+static bool nis_delimiter_eh(const char *src, size_t offset, size_t len) {
+    if (offset >= len || nis_char_eh(src[offset], NIS_CHAR_SPACE)) {
+        return true;
+    }
+    switch (src[offset]) {
+    case '(': case ')': case '[': case ']': case '{': case '}':
+    case '"': case ';': case '|':
+        return true;
     default:
+        return false;
+    }
+}
+
+// a number must end at a delimiter, so that `1.5.5` or `#b102` is refused
+// rather than read as two
+static int nis_lex_number_end(const char *src, size_t offset, size_t len, const char *ptr) {
+    if (nis_delimiter_eh(src, offset, len)) {
         return 0;
     }
+    while (!nis_delimiter_eh(src, offset, len)) {
+        ++offset;
+    }
+    fprintf(stderr,
+            "nisc:%s:%d: error: invalid number: %.*s\n",
+            __FILE__,
+            __LINE__,
+            (int) (src + offset - ptr),
+            ptr);
+    return 1;
 }
 
-static bool is_ident_cont(int ch) {
-    switch (ch) {
-    case '!': case '$': case '%': case '&': case '*':
-    case '+': case '-': case '.': case '/': case ':':
-    case '<': case '=': case '>': case '?': case '@':
-    case '^': case '_': case '~':
-    case 'a': case 'b': case 'c': case 'd': case 'e':
-    case 'f': case 'g': case 'h': case 'i': case 'j':
-    case 'k': case 'l': case 'm': case 'n': case 'o':
-    case 'p': case 'q': case 'r': case 's': case 't':
-    case 'u': case 'v': case 'w': case 'x': case 'y':
-    case 'z':
-    case 'A': case 'B': case 'C': case 'D': case 'E':
-    case 'F': case 'G': case 'H': case 'I': case 'J':
-    case 'K': case 'L': case 'M': case 'N': case 'O':
-    case 'P': case 'Q': case 'R': case 'S': case 'T':
-    case 'U': case 'V': case 'W': case 'X': case 'Y':
-    case 'Z':
-    case '1': case '2': case '3': case '4': case '5':
-    case '6': case '7': case '8': case '9': case '0':
+static int nis_lex_int(NisToken *token, uint64_t mag, bool neg, bool overflow) {
+    if (overflow || mag > (uint64_t) LONG_MAX + neg) {
+        fprintf(stderr,
+                "nisc:%s:%d: error: integer literal out of range: %.*s\n",
+                __FILE__,
+                __LINE__,
+                (int) token->span.len,
+                token->span.ptr);
+        return 1;
+    }
+    token->kind = NIS_TOKEN_INT;
+    if (neg) {
+        token->vint = mag ? -(long) (mag - 1) - 1 : 0;
+    } else {
+        token->vint = mag;
+    }
+    return 0;
+}
+
+// Clinger's fast path: a mantissa and power of ten that are both exact
+// doubles give a correctly rounded quotient or product, everything else
+// goes through strtod in the C locale
+static void nis_lex_float(NisToken *token, const char *num, size_t len,
+                          const char *intp, size_t intlen,
+                          const char *fracp, size_t fraclen,
+                          long exp, bool neg) {
+    uint64_t intpart, fracpart;
+    if (intlen + fraclen <= 19
+        && nis_parse_decimal(intp, 0, intlen, &intpart)
+        && nis_parse_decimal(fracp, 0, fraclen, &fracpart)) {
+        uint64_t mant = intpart;
+        for (size_t i = 0; i < fraclen; i++) {
+            mant *= 10;
+        }
+        mant += fracpart;
+        exp -= (long) fraclen;
+        if (mant <= (uint64_t) 1 << 53 && exp >= -22 && exp <= 22) {
+            double value = mant;
+            if (exp < 0) {
+                value /= POWERS_OF_TEN[-exp];
+            } else {
+                value *= POWERS_OF_TEN[exp];
+            }
+            token->kind = NIS_TOKEN_FLOAT;
+            token->vfloat = neg ? -value : value;
+            return;
+        }
+    }
+
+    char buffer[64];
+    char *copy = len < sizeof(buffer) ? buffer : malloc(len + 1);
+    memcpy(copy, num, len);
+    copy[len] = '\0';
+    token->kind = NIS_TOKEN_FLOAT;
+    token->vfloat = nis_c_strtod(copy);
+    if (copy != buffer) {
+        free(copy);
+    }
+}
+
+// hex scalar value in `src[offset..end)`
+static int nis_lex_scalar(uint32_t *dest, const char *src, size_t offset, size_t end) {
+    uint32_t code = 0;
+    for (size_t i = offset; i < end; i++) {
+        unsigned digit = nis_digit_value(src[i]);
+        if (digit >= 16 || code > 0x10ffff) {
+            code = 0xffffffff;
+            break;
+        }
+        code = code * 16 + digit;
+    }
+    if (offset == end || code > 0x10ffff || (code >= 0xd800 && code < 0xe000)) {
+        fprintf(stderr,
+                "nisc:%s:%d: error: invalid scalar value: %.*s\n",
+                __FILE__,
+                __LINE__,
+                (int) (end - offset),
+                src + offset);
+        return 1;
+    }
+    *dest = code;
+    return 0;
+}
+
+// the escape after a `\\` in a string, appends at most 4 bytes to `dest`
+static int nis_lex_escape(char *dest, size_t *count, const char *src, size_t len, size_t *offsetp) {
+    size_t offset = *offsetp;
+    if (offset >= len) {
+        fprintf(stderr, "nisc:%s:%d: error: unterminated string\n", __FILE__, __LINE__);
         return 1;
+    }
+    char ch = src[offset++];
+    switch (ch) {
+    case 'a': dest[(*count)++] = '\a'; break;
+    case 'b': dest[(*count)++] = '\b'; break;
+    case 't': dest[(*count)++] = '\t'; break;
+    case 'n': dest[(*count)++] = '\n'; break;
+    case 'r': dest[(*count)++] = '\r'; break;
+    case '"': case '\\': case '|': dest[(*count)++] = ch; break;
+    case 'x': case 'X': {
+        size_t end = offset;
+        while (end < len && src[end] != ';' && src[end] != '"') {
+            ++end;
+        }
+        uint32_t code;
+        if (end >= len || src[end] != ';') {
+            fprintf(stderr, "nisc:%s:%d: error: expected `;` after hex escape\n", __FILE__, __LINE__);
+            return 1;
+        }
+        if (nis_lex_scalar(&code, src, offset, end)) {
+            return 1;
+        }
+        *count += nis_utf8_encode(dest + *count, code);
+        offset = end + 1;
+    } break;
+    case ' ': case '\t': case '\r': case '\n': {
+        // \<intraline whitespace>*<line ending><intraline whitespace>*
+        --offset;
+        while (offset < len && (src[offset] == ' ' || src[offset] == '\t')) {
+            ++offset;
+        }
+        if (offset < len && src[offset] == '\r') {
+            ++offset;
+        }
+        if (offset >= len || src[offset] != '\n') {
+            fprintf(stderr, "nisc:%s:%d: error: invalid escape\n", __FILE__, __LINE__);
+            return 1;
+        }
+        ++offset;
+        while (offset < len && (src[offset] == ' ' || src[offset] == '\t')) {
+            ++offset;
+        }
+    } break;
     default:
-        return 0;
+        fprintf(stderr, "nisc:%s:%d: error: invalid escape: \\%c\n", __FILE__, __LINE__, ch);
+        return 1;
     }
+    *offsetp = offset;
+    return 0;
 }
 
-int nis_lex(struct NisTokens *dest, const char *src, size_t len) {
-    size_t cap = 16;
-    dest->list = malloc(cap * sizeof(NisToken));
-    dest->len = 0;
+static const struct {
+    const char *name;
+    size_t len;
+    uint32_t value;
+} CHAR_NAMES[] = {
+    { "alarm", 5, 0x07 },
+    { "backspace", 9, 0x08 },
+    { "delete", 6, 0x7f },
+    { "escape", 6, 0x1b },
+    { "newline", 7, 0x0a },
+    { "null", 4, 0x00 },
+    { "return", 6, 0x0d },
+    { "space", 5, 0x20 },
+    { "tab", 3, 0x09 },
+};
 
-    int state = NIS_LEX_NORMAL;
+// `#\\a`, `#\\space` or `#\\x41`, `ptr` points at the `#`
+static int nis_lex_char(NisToken *token, const char *src, size_t len, size_t *offsetp, const char *ptr) {
+    size_t begin = *offsetp + 1;
+    if (begin >= len) {
+        fprintf(stderr, "nisc:%s:%d: error: expected a character after `#\\`\n", __FILE__, __LINE__);
+        return 1;
+    }
+    size_t end = begin + 1;
+    if (nis_char_eh(src[begin], NIS_CHAR_IDENT_BEGIN)) {
+        end = nis_scan_ident(src, end, len);
+    }
 
-    const char *ptr = src;
-    for (size_t offset = 0; offset < len; ) {
-        if (dest->len == cap) {
-            cap *= 2;
-            dest->list = realloc(dest->list, cap * sizeof(NisToken));
+    uint32_t value = 0;
+    if (end - begin == 1) {
+        value = (unsigned char) src[begin];
+    } else if ((unsigned char) src[begin] >= 0x80
+               && nis_utf8_decode(src, begin, len, &value) == end - begin) {
+        // a single non-ASCII character
+    } else if (src[begin] == 'x' || src[begin] == 'X') {
+        if (nis_lex_scalar(&value, src, begin + 1, end)) {
+            return 1;
+        }
+    } else {
+        size_t i;
+        for (i = 0; i < sizeof(CHAR_NAMES) / sizeof(*CHAR_NAMES); i++) {
+            if (CHAR_NAMES[i].len == end - begin
+                && memcmp(CHAR_NAMES[i].name, src + begin, end - begin) == 0) {
+                value = CHAR_NAMES[i].value;
+                break;
+            }
+        }
+        if (i == sizeof(CHAR_NAMES) / sizeof(*CHAR_NAMES)) {
+            fprintf(stderr,
+                    "nisc:%s:%d: error: unknown character name: %.*s\n",
+                    __FILE__,
+                    __LINE__,
+                    (int) (src + end - ptr),
+                    ptr);
+            return 1;
         }
+    }
+
+    token->kind = NIS_TOKEN_CHAR;
+    token->vchar = value;
+    token->span.ptr = ptr;
+    token->span.len = src + end - ptr;
+    *offsetp = end;
+    return 0;
+}
+
+static int nis_lex_one(NisToken *token, const char *src, size_t len, size_t *offsetp) {
+    size_t offset = *offsetp;
+    int state = NIS_LEX_NORMAL;
+    const char *ptr = NULL;
+    int radix = 10;
+
+    for (;;) {
         switch (state) {
         case NIS_LEX_NORMAL: {
+            offset = nis_scan_space(src, offset, len);
+            if (offset == len) {
+                token->kind = NIS_TOKEN_NONE;
+                token->span.ptr = src + len;
+                token->span.len = 0;
+                *offsetp = offset;
+                return 0;
+            }
             ptr = src + offset;
             char ch = src[offset++];
             switch (ch) {
             case '(': {
-                dest->list[dest->len].kind = NIS_TOKEN_PARENL;
-                dest->list[dest->len].span.ptr = ptr;
-                dest->list[dest->len].span.len = 1;
-                dest->len++;
+                token->kind = NIS_TOKEN_PARENL;
+                token->span.ptr = ptr;
+                token->span.len = 1;
             } break;
             case ')': {
-                dest->list[dest->len].kind = NIS_TOKEN_PARENR;
-                dest->list[dest->len].span.ptr = ptr;
-                dest->list[dest->len].span.len = 1;
-                dest->len++;
+                token->kind = NIS_TOKEN_PARENR;
+                token->span.ptr = ptr;
+                token->span.len = 1;
             } break;
             case '\'': {
-                dest->list[dest->len].kind = NIS_TOKEN_SINGLE_QUOTE;
-                dest->list[dest->len].span.ptr = ptr;
-                dest->list[dest->len].span.len = 1;
-                dest->len++;
+                token->kind = NIS_TOKEN_SINGLE_QUOTE;
+                token->span.ptr = ptr;
+                token->span.len = 1;
             } break;
             case '`': {
-                dest->list[dest->len].kind = NIS_TOKEN_BACKTICK;
-                dest->list[dest->len].span.ptr = ptr;
-                dest->list[dest->len].span.len = 1;
-                dest->len++;
+                token->kind = NIS_TOKEN_BACKTICK;
+                token->span.ptr = ptr;
+                token->span.len = 1;
             } break;
             case ',': {
-                if (src[offset] == '@') {
+                if (offset < len && src[offset] == '@') {
                     offset++;
-                    dest->list[dest->len].kind = NIS_TOKEN_COMMA_AT;
-                    dest->list[dest->len].span.ptr = ptr;
-                    dest->list[dest->len].span.len = 2;
+                    token->kind = NIS_TOKEN_COMMA_AT;
+                    token->span.ptr = ptr;
+                    token->span.len = 2;
                 } else {
-                    dest->list[dest->len].kind = NIS_TOKEN_COMMA;
-                    dest->list[dest->len].span.ptr = ptr;
-                    dest->list[dest->len].span.len = 1;
+                    token->kind = NIS_TOKEN_COMMA;
+                    token->span.ptr = ptr;
+                    token->span.len = 1;
                 }
-                dest->len++;
             } break;
             case '[': {
-                dest->list[dest->len].kind = NIS_TOKEN_SQUAREL;
-                dest->list[dest->len].span.ptr = ptr;
-                dest->list[dest->len].span.len = 1;
-                dest->len++;
+                token->kind = NIS_TOKEN_SQUAREL;
+                token->span.ptr = ptr;
+                token->span.len = 1;
             } break;
             case ']': {
-                dest->list[dest->len].kind = NIS_TOKEN_SQUARER;
-                dest->list[dest->len].span.ptr = ptr;
-                dest->list[dest->len].span.len = 1;
-                dest->len++;
+                token->kind = NIS_TOKEN_SQUARER;
+                token->span.ptr = ptr;
+                token->span.len = 1;
             } break;
             case '{': {
-                dest->list[dest->len].kind = NIS_TOKEN_CURLYL;
-                dest->list[dest->len].span.ptr = ptr;
-                dest->list[dest->len].span.len = 1;
-                dest->len++;
+                token->kind = NIS_TOKEN_CURLYL;
+                token->span.ptr = ptr;
+                token->span.len = 1;
             } break;
             case '}': {
-                dest->list[dest->len].kind = NIS_TOKEN_CURLYR;
-                dest->list[dest->len].span.ptr = ptr;
-                dest->list[dest->len].span.len = 1;
-                dest->len++;
-            } break;
-            case '\t': case '\n': case ' ': {
-                // nothing
+                token->kind = NIS_TOKEN_CURLYR;
+                token->span.ptr = ptr;
+                token->span.len = 1;
             } break;
             case '"': {
-                // TODO
-            } break;
-            case '\\': {
-                // TODO
-            } break;
+                state = NIS_LEX_STRING;
+            } continue;
+            case '#': {
+                state = NIS_LEX_HASH;
+            } continue;
             case '1': case '2': case '3':
             case '4': case '5': case '6':
             case '7': case '8': case '9':
             case '0': {
-                size_t len = 1;
-                long num = ch - '0';
-                for (ch = src[offset]; ch >= '0' && ch <= '9'; ch = src[offset++]) {
-                    num *= 10;
-                    num += ch;
-                    ++len;
-                }
-                dest->list[dest->len].kind = NIS_TOKEN_INT;
-                dest->list[dest->len].vint = num;
-                dest->list[dest->len].span.ptr = ptr;
-                dest->list[dest->len].span.len = len;
-                dest->len++;
-            } break;
+                --offset;
+                radix = 10;
+                state = NIS_LEX_NUMBER;
+            } continue;
             default: {
-                if (is_ident_begin(ch)) {
-                    size_t len = 1;
-                    size_t cap = 0;
-                    char vinline[8];
-                    size_t idx = 0;
-                    char *vatom = NULL;
-                    vinline[idx++] = ch;
-                    for (ch = src[offset]; is_ident_cont(ch); ch = src[offset++]) {
-                        if (idx == 7) {
-                            cap = 16;
-                            vatom = malloc(cap * sizeof(char));
-                            memcpy(vatom, vinline, 7);
-                        }
-                        if (idx >= 7) {
-                            vatom[idx++] = ch;
-                        } else {
-                            vinline[idx++] = ch;
-                        }
-                        ++len;
-                    }
-                    
-                    if (vatom) {
-                        dest->list[dest->len].kind = NIS_TOKEN_IDENT;
-                        dest->list[dest->len].subkind = NIS_TOKEN_NONE;
-                        dest->list[dest->len].vatom = vatom;
+                if ((ch == '+' || ch == '-' || ch == '.')
+                    && nis_number_begin_eh(src, offset - 1, len)) {
+                    --offset;
+                    radix = 10;
+                    state = NIS_LEX_NUMBER;
+                    continue;
+                } else if (nis_char_eh(ch, NIS_CHAR_IDENT_BEGIN)) {
+                    offset = nis_scan_ident(src, offset, len);
+                    size_t len = src + offset - ptr;
+                    if (len == 1 && ch == '.') {
+                        token->kind = NIS_TOKEN_DOT;
                     } else {
-                        vinline[len] = '\0';
-                        if (strcmp(vinline, ".") == 0) {
-                            dest->list[dest->len].kind = NIS_TOKEN_DOT;
-                        } else {
-                            dest->list[dest->len].kind = NIS_TOKEN_IDENT;
-                            dest->list[dest->len].subkind = NIS_TOKEN_INLINE;
-                            strncpy(dest->list[dest->len].vinline, vinline, 8);
-                        }
+                        token->kind = NIS_TOKEN_IDENT;
+                        token->subkind = NIS_TOKEN_NONE;
+                        token->vsym = nis_intern(ptr, len);
                     }
-                    dest->list[dest->len].span.ptr = ptr;
-                    dest->list[dest->len].span.len = len;
-                    dest->len++;
+                    token->span.ptr = ptr;
+                    token->span.len = len;
                 } else {
                     fprintf(stderr, "nisc:%s:%d: error: `%c` is not a valid character\n", __FILE__, __LINE__, ch);
                     return 1;
                 }
             } break;
             }
-        } break;
+            *offsetp = offset;
+            return 0;
+        }
         case NIS_LEX_HASH: {
+            char ch = offset < len ? src[offset] : '\0';
+            switch (ch) {
+            case 'x': case 'X': {
+                radix = 16;
+            } break;
+            case 'o': case 'O': {
+                radix = 8;
+            } break;
+            case 'b': case 'B': {
+                radix = 2;
+            } break;
+            case 'd': case 'D': {
+                radix = 10;
+            } break;
+            case '\\': {
+                *offsetp = offset;
+                return nis_lex_char(token, src, len, offsetp, ptr);
+            }
+            default: {
+                fprintf(stderr,
+                        "nisc:%s:%d: error: invalid syntax: %.*s\n",
+                        __FILE__,
+                        __LINE__,
+                        offset < len ? 2 : 1,
+                        ptr);
+                return 1;
+            }
+            }
+            ++offset;
+            state = NIS_LEX_NUMBER;
         } break;
         case NIS_LEX_STRING: {
-        } break;
+            size_t end = nis_scan_string(src, offset, len);
+            if (end < len && src[end] == '"') {
+                token->kind = NIS_TOKEN_STRING;
+                token->subkind = NIS_TOKEN_NONE;
+                token->vstr.ptr = src + offset;
+                token->vstr.len = end - offset;
+                offset = end + 1;
+            } else {
+                size_t cap = 2 * (end - offset) + 16;
+                size_t count = 0;
+                char *buffer = malloc(cap);
+                for (;;) {
+                    if (end >= len) {
+                        free(buffer);
+                        fprintf(stderr,
+                                "nisc:%s:%d: error: unterminated string\n",
+                                __FILE__,
+                                __LINE__);
+                        return 1;
+                    }
+                    if (count + (end - offset) + 4 > cap) {
+                        cap = 2 * (count + (end - offset) + 4);
+                        buffer = realloc(buffer, cap);
+                    }
+                    memcpy(buffer + count, src + offset, end - offset);
+                    count += end - offset;
+                    offset = end + 1;
+                    if (src[end] == '"') {
+                        break;
+                    }
+                    if (nis_lex_escape(buffer, &count, src, len, &offset)) {
+                        free(buffer);
+                        return 1;
+                    }
+                    end = nis_scan_string(src, offset, len);
+                }
+                token->kind = NIS_TOKEN_STRING;
+                token->subkind = NIS_TOKEN_ESCAPED;
+                token->vstr.ptr = buffer;
+                token->vstr.len = count;
+            }
+            token->span.ptr = ptr;
+            token->span.len = src + offset - ptr;
+            *offsetp = offset;
+            return 0;
+        }
+        case NIS_LEX_NUMBER: {
+            const char *num = src + offset;
+            bool neg = false;
+            if (offset < len && (src[offset] == '+' || src[offset] == '-')) {
+                neg = src[offset] == '-';
+                ++offset;
+            }
+
+            if (radix != 10) {
+                size_t begin = offset;
+                uint64_t mag = 0;
+                bool overflow = false;
+                for (; offset < len; offset++) {
+                    unsigned digit = nis_digit_value(src[offset]);
+                    if (digit >= (unsigned) radix) {
+                        break;
+                    }
+                    if (mag > (UINT64_MAX - digit) / radix) {
+                        overflow = true;
+                    }
+                    mag = mag * radix + digit;
+                }
+                token->span.ptr = ptr;
+                token->span.len = src + offset - ptr;
+                if (offset == begin) {
+                    fprintf(stderr,
+                            "nisc:%s:%d: error: expected digits: %.*s\n",
+                            __FILE__,
+                            __LINE__,
+                            (int) token->span.len,
+                            token->span.ptr);
+                    return 1;
+                }
+                if (nis_lex_number_end(src, offset, len, ptr)
+                    || nis_lex_int(token, mag, neg, overflow)) {
+                    return 1;
+                }
+                *offsetp = offset;
+                return 0;
+            }
+
+            size_t intbegin = offset;
+            size_t intend = nis_scan_digits(src, offset, len);
+            size_t fracbegin = intend;
+            size_t fracend = intend;
+            bool real = false;
+            offset = intend;
+            if (offset < len && src[offset] == '.') {
+                real = true;
+                fracbegin = offset + 1;
+                fracend = nis_scan_digits(src, fracbegin, len);
+                offset = fracend;
+            }
+
+            long exp = 0;
+            if (offset < len && (src[offset] == 'e' || src[offset] == 'E')) {
+                size_t expbegin = offset + 1;
+                bool expneg = false;
+                if (expbegin < len && (src[expbegin] == '+' || src[expbegin] == '-')) {
+                    expneg = src[expbegin] == '-';
+                    ++expbegin;
+                }
+                size_t expend = nis_scan_digits(src, expbegin, len);
+                if (expend > expbegin) {
+                    real = true;
+                    uint64_t mag;
+                    if (expend - expbegin > 6
+                        || !nis_parse_decimal(src, expbegin, expend, &mag)) {
+                        // far outside of the range of a double either way,
+                        // strtod will saturate
+                        mag = 1000000;
+                    }
+                    exp = expneg ? -(long) mag : (long) mag;
+                    offset = expend;
+                }
+            }
+
+            if (nis_lex_number_end(src, offset, len, ptr)) {
+                return 1;
+            }
+            token->span.ptr = ptr;
+            token->span.len = src + offset - ptr;
+            if (real) {
+                nis_lex_float(token, num, src + offset - num,
+                              src + intbegin, intend - intbegin,
+                              src + fracbegin, fracend - fracbegin,
+                              exp, neg);
+            } else {
+                uint64_t mag;
+                bool overflow = !nis_parse_decimal(src, intbegin, intend, &mag);
+                if (nis_lex_int(token, mag, neg, overflow)) {
+                    return 1;
+                }
+            }
+            *offsetp = offset;
+            return 0;
+        }
         }
     }
-    return 0;
 }
 
-void nis_del_tokens(struct NisTokens *tokens) {
-    for (size_t i = 0; i < tokens->len; i++) {
-        NisToken *token = tokens->list + i;
-        if (token->kind == NIS_TOKEN_IDENT
-            && token->subkind == NIS_TOKEN_NONE) {
-            free(token->vatom);
+static int nis_check_utf8(const char *src, size_t len) {
+    size_t offset = nis_scan_utf8(src, 0, len);
+    if (offset != len) {
+        size_t line = 1;
+        for (size_t i = 0; i < offset; i++) {
+            line += src[i] == '\n';
         }
+        fprintf(stderr,
+                "nisc:%s:%d: error: invalid UTF-8 on line %zu, byte %zu\n",
+                __FILE__,
+                __LINE__,
+                line,
+                offset);
+        return 1;
     }
-    free(tokens->list);
+    return 0;
 }
 
-static int nis_parse_one(NisValue *dest, NisGc *gc, struct NisTokens *tokens, size_t *idx) {
-    NisToken *token = &tokens->list[*idx];
-    ++*idx;
-    switch (token->kind) {
-    case NIS_TOKEN_IDENT: {
-        const char *atom;
-        if (token->subkind == NIS_TOKEN_INLINE) {
-            atom = token->vinline;
-        } else {
-            atom = token->vatom;
+int nis_lex(struct NisTokens *dest, const char *src, size_t len) {
+    size_t cap = 16;
+    dest->list = malloc(cap * sizeof(NisToken));
+    dest->len = 0;
+    if (nis_check_utf8(src, len)) {
+        return 1;
+    }
+
+    size_t offset = 0;
+    for (;;) {
+        if (dest->len == cap) {
+            cap *= 2;
+            dest->list = realloc(dest->list, cap * sizeof(NisToken));
         }
-        if (strcmp(atom, "lambda") == 0) {
-            nis_special(dest, gc, NIS_VALUE_LAMBDA);
-        } else if (strcmp(atom, "if") == 0) {
-            nis_special(dest, gc, NIS_VALUE_IF);
-        } else if (strcmp(atom, "set!") == 0) {
-            nis_special(dest, gc, NIS_VALUE_SET);
-        } else if (strcmp(atom, "include") == 0) {
-            nis_special(dest, gc, NIS_VALUE_INCLUDE);
-        } else if (strcmp(atom, "include-ci") == 0) {
-            nis_special(dest, gc, NIS_VALUE_INCLUDE_CI);
-        } else if (strcmp(atom, "cond") == 0) {
-            nis_special(dest, gc, NIS_VALUE_COND);
-        } else if (strcmp(atom, "case") == 0) {
-            nis_special(dest, gc, NIS_VALUE_CASE);
-        } else if (strcmp(atom, "else") == 0) {
-            nis_special(dest, gc, NIS_VALUE_ELSE);
-        } else if (strcmp(atom, "and") == 0) {
-            nis_special(dest, gc, NIS_VALUE_AND);
-        } else if (strcmp(atom, "or") == 0) {
-            nis_special(dest, gc, NIS_VALUE_OR);
-        } else if (strcmp(atom, "unless") == 0) {
-            nis_special(dest, gc, NIS_VALUE_UNLESS);
-        } else if (strcmp(atom, "cond-expand") == 0) {
-            nis_special(dest, gc, NIS_VALUE_COND_EXPAND);
-        } else if (strcmp(atom, "let") == 0) {
-            nis_special(dest, gc, NIS_VALUE_LET);
-        } else if (strcmp(atom, "let*") == 0) {
-            nis_special(dest, gc, NIS_VALUE_LET_STAR);
-        } else if (strcmp(atom, "letrec") == 0) {
-            nis_special(dest, gc, NIS_VALUE_LETREC);
-        } else if (strcmp(atom, "letrec*") == 0) {
-            nis_special(dest, gc, NIS_VALUE_LETREC_STAR);
-        } else if (strcmp(atom, "let-values") == 0) {
-            nis_special(dest, gc, NIS_VALUE_LET_VALUES);
-        } else if (strcmp(atom, "let*-values") == 0) {
-            nis_special(dest, gc, NIS_VALUE_LET_VALUES_STAR);
-        } else if (strcmp(atom, "begin") == 0) {
-            nis_special(dest, gc, NIS_VALUE_BEGIN);
-        } else if (strcmp(atom, "do") == 0) {
-            nis_special(dest, gc, NIS_VALUE_DO);
-        } else if (strcmp(atom, "delay") == 0) {
-            nis_special(dest, gc, NIS_VALUE_DELAY);
-        } else if (strcmp(atom, "delay-force") == 0) {
-            nis_special(dest, gc, NIS_VALUE_DELAY_FORCE);
-        } else if (strcmp(atom, "force") == 0) {
-            nis_special(dest, gc, NIS_VALUE_FORCE);
-        } else if (strcmp(atom, "make-promise") == 0) {
-            nis_special(dest, gc, NIS_VALUE_MAKE_PROMISE);
-        } else if (strcmp(atom, "make-parameter") == 0) {
-            nis_special(dest, gc, NIS_VALUE_MAKE_PARAMETER);
-        } else if (strcmp(atom, "parameterize") == 0) {
-            nis_special(dest, gc, NIS_VALUE_PARAMETERIZE);
-        } else if (strcmp(atom, "guard") == 0) {
-            nis_special(dest, gc, NIS_VALUE_GUARD);
-        } else if (strcmp(atom, "quasiquote") == 0) {
-            nis_special(dest, gc, NIS_VALUE_QUASIQUOTE);
-        } else if (strcmp(atom, "unquote") == 0) {
-            nis_special(dest, gc, NIS_VALUE_UNQUOTE);
-        } else if (strcmp(atom, "unquote-splicing") == 0) {
-            nis_special(dest, gc, NIS_VALUE_UNQUOTE_SPLICING);
-        } else if (strcmp(atom, "case-lambda") == 0) {
-            nis_special(dest, gc, NIS_VALUE_CASE_LAMBDA);
-        } else if (strcmp(atom, "let-syntax") == 0) {
-            nis_special(dest, gc, NIS_VALUE_LET_SYNTAX);
-        } else if (strcmp(atom, "letrec-syntax") == 0) {
-            nis_special(dest, gc, NIS_VALUE_LETREC_SYNTAX);
-        } else if (strcmp(atom, "syntax-rules") == 0) {
-            nis_special(dest, gc, NIS_VALUE_SYNTAX_RULES);
-        } else if (strcmp(atom, "syntax-error") == 0) {
-            nis_special(dest, gc, NIS_VALUE_SYNTAX_ERROR);
-        } else {
-            nis_atom(dest, gc, atom);
-            dest->vtree->span = token->span;
+        NisToken *token = dest->list + dest->len;
+        if (nis_lex_one(token, src, len, &offset)) {
+            return 1;
         }
-        return 0;
-    }
-    case NIS_TOKEN_CHAR: {
-        nis_int(dest, gc, token->vchar);
-        return 0;
-    }
-    case NIS_TOKEN_INT: {
-        nis_int(dest, gc, token->vint);
-        return 0;
+        if (token->kind == NIS_TOKEN_NONE) {
+            return 0;
+        }
+        dest->len++;
     }
-    case NIS_TOKEN_FLOAT: {
-        nis_float(dest, gc, token->vfloat);
-        return 0;
+}
+
+static void nis_del_token(NisToken *token) {
+    if (token->kind == NIS_TOKEN_STRING
+        && token->subkind == NIS_TOKEN_ESCAPED) {
+        free((char *) token->vstr.ptr);
     }
-    case NIS_TOKEN_PARENL: {
-        size_t len = token->span.len;
+}
 
-        NisToken *token2 = &tokens->list[*idx];
-        
-        if (token2->kind == NIS_TOKEN_PARENR) {
-            ++*idx;
-            nis_nil(dest, gc);
-            return 0;
-        }
+void nis_del_tokens(struct NisTokens *tokens) {
+    for (size_t i = 0; i < tokens->len; i++) {
+        nis_del_token(tokens->list + i);
+    }
+    free(tokens->list);
+}
 
-        NisValue fst;
-        nis_parse_one(&fst, gc, tokens, idx);
-        
-        token2 = &tokens->list[*idx];
-
-        if (token2->kind == NIS_TOKEN_PARENR) {
-            ++*idx;
-            NisValue nil;
-            nis_nil(&nil, gc);
-            nis_pair(dest, gc, &fst, &nil);
-            
-            len += (token2->span.ptr - (token->span.ptr + len)) + token2->span.len;
-            dest->vtree->span.ptr = token->span.ptr;
-            dest->vtree->span.len = len;
+// `src` must already be valid UTF-8
+static void nis_init_lexer(struct NisLexer *dest, const char *src, size_t len) {
+    dest->src = src;
+    dest->len = len;
+    dest->offset = 0;
+    dest->tokens = NULL;
+    dest->status = 0;
+    dest->head = 0;
+    dest->count = 0;
+    for (size_t i = 0; i < NIS_LEXER_RING; i++) {
+        dest->ring[i].kind = NIS_TOKEN_NONE;
+    }
+}
 
-            return 0;
-        } else if (token2->kind == NIS_TOKEN_DOT) {
-            ++*idx;
-            NisValue snd;
-            nis_parse_one(&snd, gc, tokens, idx);
-            nis_pair(dest, gc, &fst, &snd);
-            
-            token2 = &tokens->list[*idx];
-
-            if (token2->kind != NIS_TOKEN_PARENR) {
-                fprintf(stderr,
-                        "nisc:%s:%d: error: unexpected token: %s\n",
-                        __FILE__,
-                        __LINE__,
-                        TOKEN_STRINGS[token2->kind]);
-                return 1;
-            }
-            
-            len += (token2->span.ptr - (token->span.ptr + len)) + token2->span.len;
-            dest->vtree->span.ptr = token->span.ptr;
-            dest->vtree->span.len = len;
-            
-            return 0;
-        }
+void nis_new_lexer(struct NisLexer *dest, const char *src, size_t len) {
+    nis_init_lexer(dest, src, len);
+    // validated up front so that the lexer can take any byte above 0x7f
+    // as part of an identifier
+    dest->status = nis_check_utf8(src, len);
+}
 
-        NisValue nil;
-        nis_nil(&nil, gc);
-        nis_pair(dest, gc, &fst, &nil);
+void nis_new_token_lexer(struct NisLexer *dest, struct NisTokens *tokens) {
+    const char *end = NULL;
+    if (tokens->len) {
+        NisToken *last = tokens->list + tokens->len - 1;
+        end = last->span.ptr + last->span.len;
+    }
+    nis_new_lexer(dest, end, 0);
+    dest->tokens = tokens;
+}
 
-        NisStree *list = dest->vtree;
-        
-        token2 = &tokens->list[*idx];
+void nis_del_lexer(struct NisLexer *lexer) {
+    if (lexer->tokens) {
+        return;
+    }
+    for (size_t i = 0; i < NIS_LEXER_RING; i++) {
+        nis_del_token(lexer->ring + i);
+    }
+}
 
-        while (token2->kind != NIS_TOKEN_PARENR) {
-            if (token2->kind == NIS_TOKEN_DOT) {
-                ++*idx;
-                NisValue last;
-                nis_parse_one(&last, gc, tokens, idx);
-                list->vpair.cdr = nis_value_to_stree(gc, &last);
-                break;
-            } else {
-                NisValue next;
-                nis_parse_one(&next, gc, tokens, idx);
-                NisValue newlist;
-                nis_pair(&newlist, gc, &next, &nil);
-                list->vpair.cdr = newlist.vtree;
-                list = list->vpair.cdr;
-            }
-            token2 = &tokens->list[*idx];
-        }
-        
-        token2 = &tokens->list[*idx];
+static void nis_lexer_fill(struct NisLexer *lexer) {
+    NisToken *token = lexer->ring + (lexer->head + lexer->count) % NIS_LEXER_RING;
+    ++lexer->count;
 
-        if (token2->kind != NIS_TOKEN_PARENR) {
-            fprintf(stderr,
-                    "nisc:%s:%d: error: unexpected token: %s\n",
-                    __FILE__,
-                    __LINE__,
-                    TOKEN_STRINGS[token2->kind]);
-            return 1;
+    if (lexer->tokens) {
+        if (lexer->offset < lexer->tokens->len) {
+            *token = lexer->tokens->list[lexer->offset++];
+        } else {
+            token->kind = NIS_TOKEN_NONE;
+            token->span.ptr = lexer->src;
+            token->span.len = 0;
         }
+        return;
+    }
 
-        ++*idx;
-        
-        len += (token2->span.ptr - (token->span.ptr + len)) + token2->span.len;
-        dest->vtree->span.ptr = token->span.ptr;
-        dest->vtree->span.len = len;
+    nis_del_token(token);
+    if (lexer->status) {
+        token->kind = NIS_TOKEN_NONE;
+    } else if (nis_lex_one(token, lexer->src, lexer->len, &lexer->offset)) {
+        lexer->status = 1;
+        token->kind = NIS_TOKEN_NONE;
+    }
+    if (token->kind == NIS_TOKEN_NONE) {
+        token->span.ptr = lexer->src + lexer->offset;
+        token->span.len = 0;
+    }
+}
 
-        return 0;
+NisToken *nis_lexer_peek(struct NisLexer *lexer) {
+    if (lexer->count == 0) {
+        nis_lexer_fill(lexer);
     }
-    case NIS_TOKEN_SINGLE_QUOTE: {
-        NisValue expr;
-        nis_parse_one(&expr, gc, tokens, idx);
+    return lexer->ring + lexer->head;
+}
 
-        NisValue nil;
-        nis_nil(&nil, gc);
-        
-        NisValue list;
-        nis_pair(&list, gc, &expr, &nil);
+NisToken *nis_lexer_next(struct NisLexer *lexer) {
+    NisToken *token = nis_lexer_peek(lexer);
+    lexer->head = (lexer->head + 1) % NIS_LEXER_RING;
+    --lexer->count;
+    return token;
+}
 
-        NisValue quote;
-        nis_special(&quote, gc, NIS_VALUE_QUOTE);
+// special forms are found with a perfect hash over the length, the first
+// two and the last character.  The slots are computed by the compiler from
+// the KEYWORD entries, -Woverride-init reports a collision if a keyword is
+// ever added that needs a new multiplier.  The key characters are written
+// out because C cannot index a string literal in a constant expression,
+// test/keyword.c catches an entry whose key does not match its name.
+#define NIS_KEYWORD_BITS 6
+#define NIS_KEYWORD_HASH(len, c0, c1, cn)                                \
+    ((uint32_t) (((uint32_t) (unsigned char) (len)                      \
+                  | (uint32_t) (unsigned char) (c0) << 8                \
+                  | (uint32_t) (unsigned char) (c1) << 16               \
+                  | (uint32_t) (unsigned char) (cn) << 24)              \
+                 * 0xcbf2a747u) >> (32 - NIS_KEYWORD_BITS))
 
-        nis_pair(dest, gc, &quote, &list);
-        return 0;
-    }
-    case NIS_TOKEN_BACKTICK: {
-        NisValue expr;
-        nis_parse_one(&expr, gc, tokens, idx);
+struct Keyword {
+    const char *name;
+    size_t len;
+    int value;
+};
 
-        NisValue nil;
-        nis_nil(&nil, gc);
-        
-        NisValue list;
-        nis_pair(&list, gc, &expr, &nil);
+#define KEYWORD(name, len, c0, c1, cn, value)                           \
+    [NIS_KEYWORD_HASH(len, c0, c1, cn)] = { name, len, value }
 
-        NisValue quote;
-        nis_special(&quote, gc, NIS_VALUE_QUASIQUOTE);
+static const struct Keyword KEYWORDS[1 << NIS_KEYWORD_BITS] = {
+    KEYWORD("lambda", 6, 'l', 'a', 'a', NIS_VALUE_LAMBDA),
+    KEYWORD("if", 2, 'i', 'f', 'f', NIS_VALUE_IF),
+    KEYWORD("set!", 4, 's', 'e', '!', NIS_VALUE_SET),
+    KEYWORD("include", 7, 'i', 'n', 'e', NIS_VALUE_INCLUDE),
+    KEYWORD("include-ci", 10, 'i', 'n', 'i', NIS_VALUE_INCLUDE_CI),
+    KEYWORD("cond", 4, 'c', 'o', 'd', NIS_VALUE_COND),
+    KEYWORD("case", 4, 'c', 'a', 'e', NIS_VALUE_CASE),
+    KEYWORD("else", 4, 'e', 'l', 'e', NIS_VALUE_ELSE),
+    KEYWORD("and", 3, 'a', 'n', 'd', NIS_VALUE_AND),
+    KEYWORD("or", 2, 'o', 'r', 'r', NIS_VALUE_OR),
+    KEYWORD("unless", 6, 'u', 'n', 's', NIS_VALUE_UNLESS),
+    KEYWORD("cond-expand", 11, 'c', 'o', 'd', NIS_VALUE_COND_EXPAND),
+    KEYWORD("let", 3, 'l', 'e', 't', NIS_VALUE_LET),
+    KEYWORD("let*", 4, 'l', 'e', '*', NIS_VALUE_LET_STAR),
+    KEYWORD("letrec", 6, 'l', 'e', 'c', NIS_VALUE_LETREC),
+    KEYWORD("letrec*", 7, 'l', 'e', '*', NIS_VALUE_LETREC_STAR),
+    KEYWORD("let-values", 10, 'l', 'e', 's', NIS_VALUE_LET_VALUES),
+    KEYWORD("let*-values", 11, 'l', 'e', 's', NIS_VALUE_LET_VALUES_STAR),
+    KEYWORD("begin", 5, 'b', 'e', 'n', NIS_VALUE_BEGIN),
+    KEYWORD("do", 2, 'd', 'o', 'o', NIS_VALUE_DO),
+    KEYWORD("delay", 5, 'd', 'e', 'y', NIS_VALUE_DELAY),
+    KEYWORD("delay-force", 11, 'd', 'e', 'e', NIS_VALUE_DELAY_FORCE),
+    KEYWORD("force", 5, 'f', 'o', 'e', NIS_VALUE_FORCE),
+    KEYWORD("make-promise", 12, 'm', 'a', 'e', NIS_VALUE_MAKE_PROMISE),
+    KEYWORD("make-parameter", 14, 'm', 'a', 'r', NIS_VALUE_MAKE_PARAMETER),
+    KEYWORD("parameterize", 12, 'p', 'a', 'e', NIS_VALUE_PARAMETERIZE),
+    KEYWORD("guard", 5, 'g', 'u', 'd', NIS_VALUE_GUARD),
+    KEYWORD("quasiquote", 10, 'q', 'u', 'e', NIS_VALUE_QUASIQUOTE),
+    KEYWORD("unquote", 7, 'u', 'n', 'e', NIS_VALUE_UNQUOTE),
+    KEYWORD("unquote-splicing", 16, 'u', 'n', 'g', NIS_VALUE_UNQUOTE_SPLICING),
+    KEYWORD("case-lambda", 11, 'c', 'a', 'a', NIS_VALUE_CASE_LAMBDA),
+    KEYWORD("let-syntax", 10, 'l', 'e', 'x', NIS_VALUE_LET_SYNTAX),
+    KEYWORD("letrec-syntax", 13, 'l', 'e', 'x', NIS_VALUE_LETREC_SYNTAX),
+    KEYWORD("syntax-rules", 12, 's', 'y', 's', NIS_VALUE_SYNTAX_RULES),
+    KEYWORD("syntax-error", 12, 's', 'y', 'r', NIS_VALUE_SYNTAX_ERROR),
+};
 
-        nis_pair(dest, gc, &quote, &list);
-        return 0;
+#undef KEYWORD
+
+static int nis_keyword(const NisSymbol *sym) {
+    if (sym->len < 2) {
+        return NIS_VALUE_TREE;
     }
-    case NIS_TOKEN_COMMA: {
-        NisValue expr;
-        nis_parse_one(&expr, gc, tokens, idx);
+    const char *name = sym->name;
+    const struct Keyword *keyword =
+        KEYWORDS + NIS_KEYWORD_HASH(sym->len, name[0], name[1], name[sym->len - 1]);
+    if (keyword->len == sym->len && memcmp(keyword->name, name, sym->len) == 0) {
+        return keyword->value;
+    }
+    return NIS_VALUE_TREE;
+}
 
-        NisValue nil;
-        nis_nil(&nil, gc);
-        
-        NisValue list;
-        nis_pair(&list, gc, &expr, &nil);
+// a number that needs a tree, floats and ints past the fixnums.  These
+// carry no span, so a parse shares one tree between equal numbers.  Every
+// minor collection rebuilds a table that took young trees, so it starts
+// over when full, which keeps that bounded on inputs of distinct numbers.
+#define NIS_CONSTANTS_MAX 1024
 
-        NisValue unquote;
-        nis_special(&unquote, gc, NIS_VALUE_UNQUOTE);
+struct Constant {
+    int kind;
+    uint64_t bits;
+};
 
-        nis_pair(dest, gc, &unquote, &list);
-        return 0;
-    }
-    case NIS_TOKEN_COMMA_AT: {
-        NisValue expr;
-        nis_parse_one(&expr, gc, tokens, idx);
+static inline uint32_t nis_constant_hash(const struct Constant *constant) {
+    return (uint32_t) ((constant->bits + constant->kind) * 0x9e3779b97f4a7c15 >> 32);
+}
 
-        NisValue nil;
-        nis_nil(&nil, gc);
-        
-        NisValue list;
-        nis_pair(&list, gc, &expr, &nil);
+static bool nis_constant_eq(const NisStree *tree, const void *arg) {
+    const struct Constant *constant = arg;
+    uint64_t bits;
+    if (tree->kind != constant->kind) {
+        return false;
+    } else if (tree->kind == NIS_STREE_FLOAT) {
+        memcpy(&bits, &tree->vfloat, sizeof bits);
+    } else {
+        bits = (uint64_t) tree->vint;
+    }
+    return bits == constant->bits;
+}
 
-        NisValue unquote;
-        nis_special(&unquote, gc, NIS_VALUE_UNQUOTE_SPLICING);
+static void nis_parse_constant(NisValue *dest, NisGc *gc, NisWeakTable *constants, NisToken *token) {
+    struct Constant constant;
+    if (token->kind == NIS_TOKEN_FLOAT) {
+        constant.kind = NIS_STREE_FLOAT;
+        memcpy(&constant.bits, &token->vfloat, sizeof constant.bits);
+    } else if (token->vint < NIS_FIXNUM_MIN || token->vint > NIS_FIXNUM_MAX) {
+        constant.kind = NIS_STREE_INT;
+        constant.bits = (uint64_t) token->vint;
+    } else {
+        nis_int(dest, gc, token->vint);
+        return;
+    }
+    uint32_t hash = nis_constant_hash(&constant);
+    NisStree *tree = nis_weak_find(gc, constants, hash, nis_constant_eq, &constant);
+    if (tree) {
+        nis_stree(dest, gc, tree);
+        return;
+    }
+    if (token->kind == NIS_TOKEN_FLOAT) {
+        nis_float(dest, gc, token->vfloat);
+    } else {
+        nis_int(dest, gc, token->vint);
+    }
+    if (constants->count == NIS_CONSTANTS_MAX) {
+        nis_del_weak_table(constants, gc);
+        nis_new_weak_table(constants, gc);
+    }
+    nis_weak_add(gc, constants, hash, nis_value_tree(*dest));
+}
 
-        nis_pair(dest, gc, &unquote, &list);
+// a datum that contains no other data
+static int nis_parse_atom(NisValue *dest, NisGc *gc, NisWeakTable *constants, NisToken *token) {
+    switch (token->kind) {
+    case NIS_TOKEN_IDENT: {
+        int special = nis_keyword(token->vsym);
+        if (special != NIS_VALUE_TREE) {
+            nis_special(dest, gc, special);
+        } else {
+            nis_atom(dest, gc, token->vsym);
+            nis_set_span(gc, nis_value_tree(*dest), &token->span);
+        }
+        return 0;
+    }
+    case NIS_TOKEN_STRING: {
+        if (token->subkind == NIS_TOKEN_ESCAPED) {
+            nis_string_copy(dest, gc, token->vstr.ptr, token->vstr.len);
+        } else {
+            nis_string(dest, gc, token->vstr.ptr, token->vstr.len);
+        }
+        nis_set_span(gc, nis_value_tree(*dest), &token->span);
+        return 0;
+    }
+    case NIS_TOKEN_CHAR: {
+        nis_int(dest, gc, token->vchar);
+        return 0;
+    }
+    case NIS_TOKEN_INT:
+    case NIS_TOKEN_FLOAT: {
+        nis_parse_constant(dest, gc, constants, token);
         return 0;
     }
     default:
@@ -526,23 +916,350 @@ static int nis_parse_one(NisValue *dest, NisGc *gc, struct NisTokens *tokens, si
     }
 }
 
-int nis_parse(NisValue **dest, size_t *len, NisGc *gc, struct NisTokens *tokens) {
+enum {
+    NIS_READ_LIST,
+    NIS_READ_DOTTED,
+    NIS_READ_QUOTE,
+};
+
+// a list or quotation that is still missing elements
+struct ReadFrame {
+    int kind;
+    // the special form of a NIS_READ_QUOTE
+    int special;
+    NisView open;
+    // gc'ed, NULL until the first element is read
+    NisStree *head;
+    NisStree *tail;
+};
+
+struct ReadStack {
+    // owned
+    struct ReadFrame *frames;
+    size_t len;
+    size_t cap;
+    // the numbers read so far, see struct Constant
+    NisWeakTable constants;
+};
+
+static struct ReadFrame *nis_read_push(struct ReadStack *stack) {
+    if (stack->len == stack->cap) {
+        stack->cap = stack->cap ? 2 * stack->cap : 32;
+        stack->frames = realloc(stack->frames, stack->cap * sizeof(struct ReadFrame));
+    }
+    return stack->frames + stack->len++;
+}
+
+// iterative, nesting is bounded by the heap and not by the C stack
+static int nis_parse_one(NisValue *dest, NisGc *gc, struct NisLexer *lexer, struct ReadStack *stack) {
+    stack->len = 0;
+    NisValue value;
+    for (;;) {
+        NisToken *token = nis_lexer_next(lexer);
+        switch (token->kind) {
+        case NIS_TOKEN_PARENL: {
+            if (nis_lexer_peek(lexer)->kind == NIS_TOKEN_PARENR) {
+                nis_lexer_next(lexer);
+                nis_nil(&value, gc);
+                break;
+            }
+            struct ReadFrame *frame = nis_read_push(stack);
+            frame->kind = NIS_READ_LIST;
+            frame->open = token->span;
+            frame->head = NULL;
+            frame->tail = NULL;
+        } continue;
+        case NIS_TOKEN_SINGLE_QUOTE: {
+            struct ReadFrame *frame = nis_read_push(stack);
+            frame->kind = NIS_READ_QUOTE;
+            frame->special = NIS_VALUE_QUOTE;
+        } continue;
+        case NIS_TOKEN_BACKTICK: {
+            struct ReadFrame *frame = nis_read_push(stack);
+            frame->kind = NIS_READ_QUOTE;
+            frame->special = NIS_VALUE_QUASIQUOTE;
+        } continue;
+        case NIS_TOKEN_COMMA: {
+            struct ReadFrame *frame = nis_read_push(stack);
+            frame->kind = NIS_READ_QUOTE;
+            frame->special = NIS_VALUE_UNQUOTE;
+        } continue;
+        case NIS_TOKEN_COMMA_AT: {
+            struct ReadFrame *frame = nis_read_push(stack);
+            frame->kind = NIS_READ_QUOTE;
+            frame->special = NIS_VALUE_UNQUOTE_SPLICING;
+        } continue;
+        default: {
+            if (nis_parse_atom(&value, gc, &stack->constants, token)) {
+                return 1;
+            }
+        } break;
+        }
+
+        // `value` is complete, hand it to the innermost open frame and
+        // close every frame that it completes
+        for (;;) {
+            if (stack->len == 0) {
+                *dest = value;
+                return 0;
+            }
+            struct ReadFrame *frame = stack->frames + stack->len - 1;
+            if (frame->kind == NIS_READ_QUOTE) {
+                NisValue nil;
+                nis_nil(&nil, gc);
+
+                NisValue list;
+                nis_pair(&list, gc, &value, &nil);
+
+                NisValue quote;
+                nis_special(&quote, gc, frame->special);
+
+                nis_pair(&value, gc, &quote, &list);
+                --stack->len;
+                continue;
+            }
+
+            NisToken *close;
+            if (frame->kind == NIS_READ_DOTTED) {
+                nis_gc_store(gc, frame->tail, &frame->tail->vpair.cdr, value);
+                close = nis_lexer_next(lexer);
+                if (close->kind != NIS_TOKEN_PARENR) {
+                    fprintf(stderr,
+                            "nisc:%s:%d: error: unexpected token: %s\n",
+                            __FILE__,
+                            __LINE__,
+                            TOKEN_STRINGS[close->kind]);
+                    return 1;
+                }
+            } else {
+                NisValue nil;
+                nis_nil(&nil, gc);
+                NisValue pair;
+                nis_pair(&pair, gc, &value, &nil);
+                if (frame->tail) {
+                    nis_gc_store(gc, frame->tail, &frame->tail->vpair.cdr, pair);
+                } else {
+                    frame->head = nis_value_tree(pair);
+                }
+                frame->tail = nis_value_tree(pair);
+
+                close = nis_lexer_peek(lexer);
+                if (close->kind == NIS_TOKEN_DOT) {
+                    nis_lexer_next(lexer);
+                    frame->kind = NIS_READ_DOTTED;
+                    break;
+                } else if (close->kind != NIS_TOKEN_PARENR) {
+                    break;
+                }
+                nis_lexer_next(lexer);
+            }
+
+            NisView span;
+            span.ptr = frame->open.ptr;
+            span.len = close->span.ptr + close->span.len - frame->open.ptr;
+            nis_set_span(gc, frame->head, &span);
+            nis_stree(&value, gc, frame->head);
+            --stack->len;
+        }
+    }
+}
+
+int nis_parse_stream(NisValue **dest, size_t *len, NisGc *gc, struct NisLexer *lexer) {
     int status = 0;
-    size_t offset = 0;
     size_t capacity = 64;
     *dest = malloc(capacity * sizeof(NisValue));
     *len = 0;
-    size_t i = 0;
-    while (i < tokens->len) {
-        if (offset == capacity) {
+    struct ReadStack stack = { NULL, 0, 0, { 0 } };
+    nis_new_weak_table(&stack.constants, gc);
+    // the forms read so far are the only live data between two forms
+    nis_gc_add_root(gc, dest, len);
+    while (nis_lexer_peek(lexer)->kind != NIS_TOKEN_NONE) {
+        nis_gc_safepoint(gc);
+        if (*len == capacity) {
             capacity *= 2;
             *dest = realloc(*dest, capacity * sizeof(NisValue));
         }
-        int s = nis_parse_one(*dest + offset++, gc, tokens, &i);
+        int s = nis_parse_one(*dest + *len, gc, lexer, &stack);
         if (!s) {
             ++*len;
         }
         status |= s;
     }
+    nis_gc_remove_root(gc, dest);
+    nis_del_weak_table(&stack.constants, gc);
+    free(stack.frames);
+    return status | lexer->status;
+}
+
+int nis_parse(NisValue **dest, size_t *len, NisGc *gc, struct NisTokens *tokens) {
+    struct NisLexer lexer;
+    nis_new_token_lexer(&lexer, tokens);
+    int status = nis_parse_stream(dest, len, gc, &lexer);
+    nis_del_lexer(&lexer);
+    return status;
+}
+
+// pieces per thread, more than one so that a thread that drew short
+// pieces picks up more work instead of idling
+#define NIS_PARSE_PIECES 4
+
+struct ParsePiece {
+    // borrowed
+    const char *src;
+    size_t len;
+    // owned
+    NisValue *values;
+    size_t count;
+    int status;
+    // borrowed, the heap of the worker that parsed it and roots `values`
+    NisGc *region;
+};
+
+struct ParseJob {
+    // borrowed
+    struct ParsePiece *pieces;
+    size_t piecec;
+    _Atomic size_t next;
+};
+
+struct ParseWorker {
+    // borrowed
+    struct ParseJob *job;
+    // owned
+    NisGc region;
+    pthread_t thread;
+};
+
+// splits `src` after the closing parenthesis of a top-level form, the
+// first one at or past each of the `piecec - 1` evenly spaced targets.
+// Strings and `#\\` characters are skipped so that their parentheses are
+// not counted, everything else is left to the lexer.  Returns the number
+// of pieces, fewer when the forms are too large or too few to split.
+static size_t nis_split_toplevel(struct ParsePiece *pieces, size_t piecec, const char *src, size_t len) {
+    size_t count = 0;
+    size_t begin = 0;
+    size_t target = len / piecec;
+    size_t depth = 0;
+    size_t offset = 0;
+    while (offset < len && count + 1 < piecec) {
+        switch (src[offset++]) {
+        case '(': {
+            ++depth;
+        } break;
+        case ')': {
+            if (depth > 0 && --depth == 0 && offset >= target) {
+                pieces[count].src = src + begin;
+                pieces[count].len = offset - begin;
+                ++count;
+                begin = offset;
+                target = len / piecec * (count + 1);
+            }
+        } break;
+        case '"': {
+            for (;;) {
+                offset = nis_scan_string(src, offset, len);
+                if (offset >= len || src[offset] == '"') {
+                    break;
+                }
+                offset += 2;
+            }
+            ++offset;
+        } break;
+        case '#': {
+            if (offset < len && src[offset] == '\\') {
+                offset += 2;
+            }
+        } break;
+        }
+    }
+    if (begin < len || count == 0) {
+        pieces[count].src = src + begin;
+        pieces[count].len = len - begin;
+        ++count;
+    }
+    return count;
+}
+
+static void *nis_parse_worker(void *arg) {
+    struct ParseWorker *worker = arg;
+    struct ParseJob *job = worker->job;
+    for (;;) {
+        size_t i = atomic_fetch_add(&job->next, 1);
+        if (i >= job->piecec) {
+            return NULL;
+        }
+        struct ParsePiece *piece = job->pieces + i;
+        struct NisLexer lexer;
+        nis_init_lexer(&lexer, piece->src, piece->len);
+        piece->status = nis_parse_stream(&piece->values, &piece->count, &worker->region, &lexer);
+        nis_del_lexer(&lexer);
+        // keeps the piece alive while the worker parses its next one
+        piece->region = &worker->region;
+        nis_gc_add_root(&worker->region, &piece->values, &piece->count);
+    }
+}
+
+int nis_parse_parallel(NisValue **dest, size_t *len, NisGc *gc, const char *src, size_t srclen, size_t threads) {
+    if (nis_check_utf8(src, srclen)) {
+        *dest = NULL;
+        *len = 0;
+        return 1;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    struct ParseJob job;
+    job.pieces = malloc(threads * NIS_PARSE_PIECES * sizeof(struct ParsePiece));
+    job.piecec = nis_split_toplevel(job.pieces, threads * NIS_PARSE_PIECES, src, srclen);
+    atomic_init(&job.next, 0);
+    if (threads > job.piecec) {
+        threads = job.piecec;
+    }
+
+    struct ParseWorker *workers = malloc(threads * sizeof(struct ParseWorker));
+    nis_symbols_concurrent(threads > 1);
+    for (size_t i = 0; i < threads; i++) {
+        workers[i].job = &job;
+        nis_new_gc(&workers[i].region, NIS_HEAP_MIN + NIS_HEAP_PER_BYTE * srclen / threads);
+        if (i > 0) {
+            pthread_create(&workers[i].thread, NULL, nis_parse_worker, workers + i);
+        }
+    }
+    // the calling thread is the first worker
+    nis_parse_worker(workers);
+    for (size_t i = 1; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    nis_symbols_concurrent(false);
+
+    // the pieces are still rooted in their regions, so their values see
+    // the trees moved out of the nurseries
+    for (size_t i = 0; i < threads; i++) {
+        nis_gc_minor(&workers[i].region);
+    }
+
+    int status = 0;
+    size_t total = 0;
+    for (size_t i = 0; i < job.piecec; i++) {
+        status |= job.pieces[i].status;
+        total += job.pieces[i].count;
+    }
+    *dest = malloc((total ? total : 1) * sizeof(NisValue));
+    *len = 0;
+    for (size_t i = 0; i < job.piecec; i++) {
+        struct ParsePiece *piece = job.pieces + i;
+        memcpy(*dest + *len, piece->values, piece->count * sizeof(NisValue));
+        *len += piece->count;
+        // `dest` is up to the caller to root
+        nis_gc_remove_root(piece->region, &piece->values);
+        free(piece->values);
+    }
+    for (size_t i = 0; i < threads; i++) {
+        nis_gc_adopt(gc, &workers[i].region);
+    }
+
+    free(workers);
+    free(job.pieces);
     return status;
 }
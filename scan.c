@@ -0,0 +1,515 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <locale.h>
+#include <pthread.h>
+#include "include/nisc_priv.h"
+
+#define SPACE NIS_CHAR_SPACE
+#define DIGIT (NIS_CHAR_DIGIT | NIS_CHAR_IDENT_CONT)
+#define IDENT (NIS_CHAR_IDENT_BEGIN | NIS_CHAR_IDENT_CONT)
+
+const unsigned char NIS_CHAR_CLASS[256] = {
+    ['\t'] = SPACE, ['\n'] = SPACE, ['\r'] = SPACE, [' '] = SPACE,
+
+    ['!'] = IDENT, ['$'] = IDENT, ['%'] = IDENT, ['&'] = IDENT, ['*'] = IDENT,
+    ['+'] = IDENT, ['-'] = IDENT, ['.'] = IDENT, ['/'] = IDENT, [':'] = IDENT,
+    ['<'] = IDENT, ['='] = IDENT, ['>'] = IDENT, ['?'] = IDENT, ['@'] = IDENT,
+    ['^'] = IDENT, ['_'] = IDENT, ['~'] = IDENT,
+
+    ['a'] = IDENT, ['b'] = IDENT, ['c'] = IDENT, ['d'] = IDENT, ['e'] = IDENT,
+    ['f'] = IDENT, ['g'] = IDENT, ['h'] = IDENT, ['i'] = IDENT, ['j'] = IDENT,
+    ['k'] = IDENT, ['l'] = IDENT, ['m'] = IDENT, ['n'] = IDENT, ['o'] = IDENT,
+    ['p'] = IDENT, ['q'] = IDENT, ['r'] = IDENT, ['s'] = IDENT, ['t'] = IDENT,
+    ['u'] = IDENT, ['v'] = IDENT, ['w'] = IDENT, ['x'] = IDENT, ['y'] = IDENT,
+    ['z'] = IDENT,
+
+    ['A'] = IDENT, ['B'] = IDENT, ['C'] = IDENT, ['D'] = IDENT, ['E'] = IDENT,
+    ['F'] = IDENT, ['G'] = IDENT, ['H'] = IDENT, ['I'] = IDENT, ['J'] = IDENT,
+    ['K'] = IDENT, ['L'] = IDENT, ['M'] = IDENT, ['N'] = IDENT, ['O'] = IDENT,
+    ['P'] = IDENT, ['Q'] = IDENT, ['R'] = IDENT, ['S'] = IDENT, ['T'] = IDENT,
+    ['U'] = IDENT, ['V'] = IDENT, ['W'] = IDENT, ['X'] = IDENT, ['Y'] = IDENT,
+    ['Z'] = IDENT,
+
+    ['1'] = DIGIT, ['2'] = DIGIT, ['3'] = DIGIT, ['4'] = DIGIT, ['5'] = DIGIT,
+    ['6'] = DIGIT, ['7'] = DIGIT, ['8'] = DIGIT, ['9'] = DIGIT, ['0'] = DIGIT,
+
+    // any UTF-8 lead or continuation byte, the source is validated before
+    // it is lexed
+#define ROW IDENT, IDENT, IDENT, IDENT, IDENT, IDENT, IDENT, IDENT, \
+            IDENT, IDENT, IDENT, IDENT, IDENT, IDENT, IDENT, IDENT
+    [0x80] = ROW, ROW, ROW, ROW, ROW, ROW, ROW, ROW,
+#undef ROW
+};
+
+#undef SPACE
+#undef DIGIT
+#undef IDENT
+
+// off, every run is scanned a byte at a time through the table
+static bool scan_vectors = true;
+
+void nis_lex_vectors(bool on) {
+    scan_vectors = on;
+}
+
+#ifdef NIS_SIMD_WIDTH
+
+#if NIS_SIMD_WIDTH == 32
+typedef __m256i NisVec;
+#define nis_vload(p) _mm256_loadu_si256((const __m256i *) (p))
+#define nis_vset1(x) _mm256_set1_epi8(x)
+#define nis_vor(a, b) _mm256_or_si256(a, b)
+#define nis_vadd(a, b) _mm256_add_epi8(a, b)
+#define nis_veq(a, b) _mm256_cmpeq_epi8(a, b)
+#define nis_vlt(a, b) _mm256_cmpgt_epi8(b, a)
+#define nis_vmask(a) ((uint32_t) _mm256_movemask_epi8(a))
+#define nis_vand(a, b) _mm256_and_si256(a, b)
+#define nis_vxor(a, b) _mm256_xor_si256(a, b)
+#define nis_vzero() _mm256_setzero_si256()
+#define nis_vsubs(a, b) _mm256_subs_epu8(a, b)
+#define nis_vsrl4(a) _mm256_and_si256(_mm256_srli_epi16(a, 4), nis_vset1(0x0f))
+#define nis_vlookup(table, idx) _mm256_shuffle_epi8(table, idx)
+#define nis_vtable(p) _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) (p)))
+// the last `n` bytes of `prev` followed by `cur`
+#define nis_vprev(cur, prev, n) \
+    _mm256_alignr_epi8(cur, _mm256_permute2x128_si256(prev, cur, 0x21), 16 - (n))
+#define NIS_SIMD_SHUFFLE 1
+#else
+typedef __m128i NisVec;
+#define nis_vload(p) _mm_loadu_si128((const __m128i *) (p))
+#define nis_vset1(x) _mm_set1_epi8(x)
+#define nis_vor(a, b) _mm_or_si128(a, b)
+#define nis_vadd(a, b) _mm_add_epi8(a, b)
+#define nis_veq(a, b) _mm_cmpeq_epi8(a, b)
+#define nis_vlt(a, b) _mm_cmplt_epi8(a, b)
+#define nis_vmask(a) ((uint32_t) _mm_movemask_epi8(a))
+#define nis_vand(a, b) _mm_and_si128(a, b)
+#define nis_vxor(a, b) _mm_xor_si128(a, b)
+#define nis_vzero() _mm_setzero_si128()
+#define nis_vsubs(a, b) _mm_subs_epu8(a, b)
+#define nis_vsrl4(a) _mm_and_si128(_mm_srli_epi16(a, 4), nis_vset1(0x0f))
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#define nis_vlookup(table, idx) _mm_shuffle_epi8(table, idx)
+#define nis_vtable(p) nis_vload(p)
+#define nis_vprev(cur, prev, n) _mm_alignr_epi8(cur, prev, 16 - (n))
+#define NIS_SIMD_SHUFFLE 1
+#endif
+#endif
+
+// bytes in [lo, hi], there is no unsigned byte compare so the range is
+// shifted down to start at -128
+static inline NisVec nis_vrange(NisVec v, char lo, char hi) {
+    NisVec x = nis_vadd(v, nis_vset1((char) (0x80 - lo)));
+    return nis_vlt(x, nis_vset1((char) (0x80 + (hi - lo) + 1)));
+}
+
+static inline uint32_t nis_space_mask(const char *ptr) {
+    NisVec v = nis_vload(ptr);
+    NisVec m = nis_vor(nis_vor(nis_veq(v, nis_vset1(' ')),
+                               nis_veq(v, nis_vset1('\n'))),
+                       nis_vor(nis_veq(v, nis_vset1('\t')),
+                               nis_veq(v, nis_vset1('\r'))));
+    return nis_vmask(m);
+}
+
+static inline uint32_t nis_digit_mask(const char *ptr) {
+    NisVec v = nis_vload(ptr);
+    return nis_vmask(nis_vrange(v, '0', '9'));
+}
+
+// only the common identifier characters and non-ASCII bytes, everything
+// else is left to the table so that the vector path never decides what an
+// identifier is
+static inline uint32_t nis_ident_mask(const char *ptr) {
+    NisVec v = nis_vload(ptr);
+    NisVec m = nis_vor(nis_vor(nis_vrange(nis_vor(v, nis_vset1(0x20)), 'a', 'z'),
+                               nis_vrange(v, '0', '9')),
+                       nis_vor(nis_veq(v, nis_vset1('-')),
+                               nis_vlt(v, nis_vzero())));
+    return nis_vmask(m);
+}
+
+static inline uint32_t nis_string_mask(const char *ptr) {
+    NisVec v = nis_vload(ptr);
+    return nis_vmask(nis_vor(nis_veq(v, nis_vset1('"')), nis_veq(v, nis_vset1('\\'))));
+}
+
+#endif /* NIS_SIMD_WIDTH */
+
+size_t nis_scan_space(const char *src, size_t offset, size_t len) {
+#ifdef NIS_SIMD_WIDTH
+    while (scan_vectors && offset + NIS_SIMD_WIDTH <= len) {
+        uint32_t mask = ~nis_space_mask(src + offset) & NIS_SIMD_FULL;
+        if (mask) {
+            return offset + __builtin_ctz(mask);
+        }
+        offset += NIS_SIMD_WIDTH;
+    }
+#endif
+    while (offset < len && nis_char_eh(src[offset], NIS_CHAR_SPACE)) {
+        ++offset;
+    }
+    return offset;
+}
+
+size_t nis_scan_digits(const char *src, size_t offset, size_t len) {
+#ifdef NIS_SIMD_WIDTH
+    while (scan_vectors && offset + NIS_SIMD_WIDTH <= len) {
+        uint32_t mask = ~nis_digit_mask(src + offset) & NIS_SIMD_FULL;
+        if (mask) {
+            return offset + __builtin_ctz(mask);
+        }
+        offset += NIS_SIMD_WIDTH;
+    }
+#endif
+    while (offset < len && nis_char_eh(src[offset], NIS_CHAR_DIGIT)) {
+        ++offset;
+    }
+    return offset;
+}
+
+size_t nis_scan_ident(const char *src, size_t offset, size_t len) {
+    for (;;) {
+#ifdef NIS_SIMD_WIDTH
+        while (scan_vectors && offset + NIS_SIMD_WIDTH <= len) {
+            uint32_t mask = ~nis_ident_mask(src + offset) & NIS_SIMD_FULL;
+            if (mask) {
+                offset += __builtin_ctz(mask);
+                break;
+            }
+            offset += NIS_SIMD_WIDTH;
+        }
+#endif
+        if (offset < len && nis_char_eh(src[offset], NIS_CHAR_IDENT_CONT)) {
+            ++offset;
+        } else {
+            return offset;
+        }
+    }
+}
+
+size_t nis_scan_string(const char *src, size_t offset, size_t len) {
+#ifdef NIS_SIMD_WIDTH
+    while (scan_vectors && offset + NIS_SIMD_WIDTH <= len) {
+        uint32_t mask = nis_string_mask(src + offset);
+        if (mask) {
+            return offset + __builtin_ctz(mask);
+        }
+        offset += NIS_SIMD_WIDTH;
+    }
+#endif
+    while (offset < len && src[offset] != '"' && src[offset] != '\\') {
+        ++offset;
+    }
+    return offset;
+}
+
+size_t nis_utf8_decode(const char *src, size_t offset, size_t len, uint32_t *code) {
+    const unsigned char *ptr = (const unsigned char *) src + offset;
+    size_t n;
+    if (ptr[0] < 0x80) {
+        *code = ptr[0];
+        return 1;
+    } else if (ptr[0] >= 0xc2 && ptr[0] <= 0xdf) {
+        n = 2;
+    } else if (ptr[0] >= 0xe0 && ptr[0] <= 0xef) {
+        n = 3;
+    } else if (ptr[0] >= 0xf0 && ptr[0] <= 0xf4) {
+        n = 4;
+    } else {
+        return 0;
+    }
+    if (len - offset < n) {
+        return 0;
+    }
+
+    uint32_t value = ptr[0] & (0x7f >> n);
+    for (size_t i = 1; i < n; i++) {
+        if ((ptr[i] & 0xc0) != 0x80) {
+            return 0;
+        }
+        value = (value << 6) | (ptr[i] & 0x3f);
+    }
+    if ((n == 3 && (value < 0x800 || (value >= 0xd800 && value < 0xe000)))
+        || (n == 4 && (value < 0x10000 || value > 0x10ffff))) {
+        return 0;
+    }
+    *code = value;
+    return n;
+}
+
+size_t nis_utf8_encode(char *dest, uint32_t code) {
+    if (code < 0x80) {
+        dest[0] = code;
+        return 1;
+    } else if (code < 0x800) {
+        dest[0] = 0xc0 | (code >> 6);
+        dest[1] = 0x80 | (code & 0x3f);
+        return 2;
+    } else if (code < 0x10000) {
+        dest[0] = 0xe0 | (code >> 12);
+        dest[1] = 0x80 | ((code >> 6) & 0x3f);
+        dest[2] = 0x80 | (code & 0x3f);
+        return 3;
+    } else {
+        dest[0] = 0xf0 | (code >> 18);
+        dest[1] = 0x80 | ((code >> 12) & 0x3f);
+        dest[2] = 0x80 | ((code >> 6) & 0x3f);
+        dest[3] = 0x80 | (code & 0x3f);
+        return 4;
+    }
+}
+
+#ifdef NIS_SIMD_SHUFFLE
+
+// Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction Per
+// Byte".  Every byte is classified by the high nibble of the byte before
+// it, its low nibble and the high nibble of the byte itself, an error is
+// a bit set in all three lookups.
+#define TOO_SHORT (1 << 0)
+#define TOO_LONG (1 << 1)
+#define OVERLONG_3 (1 << 2)
+#define TOO_LARGE (1 << 3)
+#define SURROGATE (1 << 4)
+#define OVERLONG_2 (1 << 5)
+#define TOO_LARGE_1000 (1 << 6)
+#define OVERLONG_4 (1 << 6)
+#define TWO_CONTS (1 << 7)
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+static const unsigned char UTF8_BYTE_1_HIGH[16] = {
+    // ascii
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    // continuation
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    // 110_
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    // 1110
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    // 1111
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+
+static const unsigned char UTF8_BYTE_1_LOW[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+};
+
+static const unsigned char UTF8_BYTE_2_HIGH[16] = {
+    // ascii
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    // 1000
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    // 1001
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    // 101_
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    // 11__
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+};
+
+#undef TOO_SHORT
+#undef TOO_LONG
+#undef OVERLONG_3
+#undef TOO_LARGE
+#undef SURROGATE
+#undef OVERLONG_2
+#undef TOO_LARGE_1000
+#undef OVERLONG_4
+#undef TWO_CONTS
+#undef CARRY
+
+// nonzero in the last three lanes if a sequence is cut off at the end
+static const unsigned char UTF8_MAX_TAIL[32] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xef, 0xdf, 0xbf,
+};
+
+static inline NisVec nis_utf8_errors(NisVec input, NisVec prev) {
+    NisVec prev1 = nis_vprev(input, prev, 1);
+    NisVec special = nis_vand(nis_vand(nis_vlookup(nis_vtable(UTF8_BYTE_1_HIGH), nis_vsrl4(prev1)),
+                                       nis_vlookup(nis_vtable(UTF8_BYTE_1_LOW),
+                                                   nis_vand(prev1, nis_vset1(0x0f)))),
+                              nis_vlookup(nis_vtable(UTF8_BYTE_2_HIGH), nis_vsrl4(input)));
+    // the third and fourth byte of a sequence are only caught by looking
+    // further back
+    NisVec prev2 = nis_vprev(input, prev, 2);
+    NisVec prev3 = nis_vprev(input, prev, 3);
+    NisVec must23 = nis_vor(nis_vsubs(prev2, nis_vset1((char) (0xe0 - 0x80))),
+                            nis_vsubs(prev3, nis_vset1((char) (0xf0 - 0x80))));
+    return nis_vxor(nis_vand(must23, nis_vset1((char) 0x80)), special);
+}
+
+#endif /* NIS_SIMD_SHUFFLE */
+
+size_t nis_scan_utf8(const char *src, size_t offset, size_t len) {
+#if defined(NIS_SIMD_SHUFFLE)
+    size_t begin = offset;
+    NisVec prev = nis_vzero();
+    NisVec incomplete = nis_vzero();
+    NisVec max = nis_vload(UTF8_MAX_TAIL + 32 - NIS_SIMD_WIDTH);
+    while (scan_vectors && offset + 64 <= len) {
+        NisVec error;
+        NisVec v[64 / NIS_SIMD_WIDTH];
+        NisVec any = nis_vzero();
+        for (size_t i = 0; i < 64 / NIS_SIMD_WIDTH; i++) {
+            v[i] = nis_vload(src + offset + i * NIS_SIMD_WIDTH);
+            any = nis_vor(any, v[i]);
+        }
+        if (nis_vmask(any) == 0) {
+            error = incomplete;
+            incomplete = nis_vzero();
+            prev = nis_vzero();
+        } else {
+            error = nis_vzero();
+            for (size_t i = 0; i < 64 / NIS_SIMD_WIDTH; i++) {
+                error = nis_vor(error, nis_utf8_errors(v[i], prev));
+                prev = v[i];
+            }
+            incomplete = nis_vsubs(prev, max);
+        }
+        if (nis_vmask(nis_veq(error, nis_vzero())) != NIS_SIMD_FULL) {
+            break;
+        }
+        offset += 64;
+    }
+    // the scalar loop below finds the exact offset of an error and checks
+    // the tail, both start at the beginning of a sequence that may cross
+    // the block boundary
+    for (size_t i = 1; i <= 3 && offset - begin >= i; i++) {
+        unsigned char ch = src[offset - i];
+        if (ch >= 0xc0) {
+            offset -= i;
+            break;
+        } else if (ch < 0x80) {
+            break;
+        }
+    }
+#elif defined(NIS_SIMD_WIDTH)
+    // without a byte shuffle only the ASCII blocks are skipped
+    while (scan_vectors && offset + NIS_SIMD_WIDTH <= len) {
+        if (nis_vmask(nis_vload(src + offset)) == 0) {
+            offset += NIS_SIMD_WIDTH;
+            continue;
+        }
+        size_t end = offset + NIS_SIMD_WIDTH;
+        while (offset < end) {
+            uint32_t code;
+            size_t n = nis_utf8_decode(src, offset, len, &code);
+            if (n == 0) {
+                return offset;
+            }
+            offset += n;
+        }
+    }
+#endif
+    while (offset < len) {
+        uint32_t code;
+        size_t n = nis_utf8_decode(src, offset, len, &code);
+        if (n == 0) {
+            return offset;
+        }
+        offset += n;
+    }
+    return len;
+}
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+// eight ASCII digits, first digit in the lowest byte
+static inline uint64_t nis_swar_eight(uint64_t chunk) {
+    chunk -= 0x3030303030303030;
+    chunk = chunk * 10 + (chunk >> 8);
+    chunk = ((chunk & 0x000000ff000000ff) * (100 + (1000000ull << 32))
+             + ((chunk >> 16) & 0x000000ff000000ff) * (1 + (10000ull << 32))) >> 32;
+    return chunk;
+}
+#endif
+
+bool nis_parse_decimal(const char *src, size_t offset, size_t end, uint64_t *value) {
+    uint64_t acc = 0;
+    // up to 19 digits always fit
+    bool checked = end - offset > 19;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (end - offset >= 8) {
+        uint64_t chunk;
+        memcpy(&chunk, src + offset, 8);
+        uint64_t digits = nis_swar_eight(chunk);
+        if (checked && acc > (UINT64_MAX - digits) / 100000000) {
+            return false;
+        }
+        acc = acc * 100000000 + digits;
+        offset += 8;
+    }
+    if (!checked && offset < end && end >= 8) {
+        // the bytes before the tail are readable too, overwrite them with
+        // leading zeros
+        static const uint32_t scale[8] = {
+            1, 10, 100, 1000, 10000, 100000, 1000000, 10000000,
+        };
+        size_t n = end - offset;
+        uint64_t mask = ((uint64_t) 1 << (8 * (8 - n))) - 1;
+        uint64_t chunk;
+        memcpy(&chunk, src + end - 8, 8);
+        chunk = (chunk & ~mask) | (0x3030303030303030 & mask);
+        *value = acc * scale[n] + nis_swar_eight(chunk);
+        return true;
+    }
+#endif
+    for (; offset < end; offset++) {
+        unsigned digit = src[offset] - '0';
+        if (checked && acc > (UINT64_MAX - digit) / 10) {
+            return false;
+        }
+        acc = acc * 10 + digit;
+    }
+    *value = acc;
+    return true;
+}
+
+// the literal syntax does not follow LC_NUMERIC, whatever the host set it to
+static locale_t c_locale;
+static pthread_once_t c_locale_once = PTHREAD_ONCE_INIT;
+
+static void nis_new_c_locale(void) {
+    c_locale = newlocale(LC_NUMERIC_MASK, "C", (locale_t) 0);
+    if (!c_locale) {
+        fprintf(stderr, "nisc:%s:%d: error: out of memory\n", __FILE__, __LINE__);
+        exit(1);
+    }
+}
+
+double nis_c_strtod(const char *str) {
+    pthread_once(&c_locale_once, nis_new_c_locale);
+    return strtod_l(str, NULL, c_locale);
+}
+
+int nis_c_format(char *dest, size_t len, const char *format, int prec, double value) {
+    pthread_once(&c_locale_once, nis_new_c_locale);
+    locale_t old = uselocale(c_locale);
+    int count = snprintf(dest, len, format, prec, value);
+    uselocale(old);
+    return count;
+}
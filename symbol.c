@@ -0,0 +1,162 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "include/nisc.h"
+
+#define SYMBOL_BLOCK_SIZE (64 * 1024)
+
+struct SymbolBlock {
+    // owned
+    struct SymbolBlock *next;
+    size_t len;
+    size_t cap;
+    _Alignas(NisSymbol) char buffer[];
+};
+
+struct SymbolTable {
+    // borrowed, points into `blocks`
+    const NisSymbol **slots;
+    size_t cap;
+    size_t count;
+    // owned
+    struct SymbolBlock *blocks;
+};
+
+#define SYMBOL_CACHE_SIZE 1024
+
+// per-thread, direct-mapped in front of the shared table so that threads
+// only take the lock for names they have not seen yet
+struct SymbolCache {
+    size_t epoch;
+    // borrowed
+    const NisSymbol *slots[SYMBOL_CACHE_SIZE];
+};
+
+static struct SymbolTable symbols;
+static pthread_mutex_t symbols_lock = PTHREAD_MUTEX_INITIALIZER;
+// only set while parser threads run, the single-threaded path never locks
+static bool symbols_concurrent;
+// bumped by nis_del_symbols, invalidates every cache
+static size_t symbols_epoch = 1;
+static _Thread_local struct SymbolCache symbol_cache;
+
+static uint32_t nis_symbol_hash(const char *name, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static NisSymbol *nis_symbol_alloc(size_t len) {
+    size_t size = nis_align_up(sizeof(NisSymbol) + len + 1, _Alignof(NisSymbol));
+    struct SymbolBlock *block = symbols.blocks;
+    if (!block || block->len + size > block->cap) {
+        size_t cap = size > SYMBOL_BLOCK_SIZE ? size : SYMBOL_BLOCK_SIZE;
+        block = malloc(sizeof(struct SymbolBlock) + cap);
+        block->next = symbols.blocks;
+        block->len = 0;
+        block->cap = cap;
+        symbols.blocks = block;
+    }
+    NisSymbol *symbol = (NisSymbol *) (block->buffer + block->len);
+    block->len += size;
+    return symbol;
+}
+
+static void nis_symbols_grow(void) {
+    size_t cap = symbols.cap ? symbols.cap * 2 : 1024;
+    const NisSymbol **slots = calloc(cap, sizeof(NisSymbol *));
+    for (size_t i = 0; i < symbols.cap; i++) {
+        const NisSymbol *symbol = symbols.slots[i];
+        if (symbol) {
+            size_t j = symbol->hash & (cap - 1);
+            while (slots[j]) {
+                j = (j + 1) & (cap - 1);
+            }
+            slots[j] = symbol;
+        }
+    }
+    free(symbols.slots);
+    symbols.slots = slots;
+    symbols.cap = cap;
+}
+
+static const NisSymbol *nis_intern_unsync(const char *name, size_t len, uint32_t hash) {
+    if (2 * (symbols.count + 1) > symbols.cap) {
+        nis_symbols_grow();
+    }
+    size_t i = hash & (symbols.cap - 1);
+    while (symbols.slots[i]) {
+        const NisSymbol *symbol = symbols.slots[i];
+        if (symbol->hash == hash
+            && symbol->len == len
+            && memcmp(symbol->name, name, len) == 0) {
+            return symbol;
+        }
+        i = (i + 1) & (symbols.cap - 1);
+    }
+
+    NisSymbol *symbol = nis_symbol_alloc(len);
+    char *copy = (char *) (symbol + 1);
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+    symbol->name = copy;
+    symbol->len = len;
+    symbol->hash = hash;
+    symbol->id = symbols.count;
+    symbols.slots[i] = symbol;
+    ++symbols.count;
+    return symbol;
+}
+
+const NisSymbol *nis_intern(const char *name, size_t len) {
+    uint32_t hash = nis_symbol_hash(name, len);
+    if (!symbols_concurrent) {
+        return nis_intern_unsync(name, len, hash);
+    }
+
+    struct SymbolCache *cache = &symbol_cache;
+    if (cache->epoch != symbols_epoch) {
+        memset(cache->slots, 0, sizeof(cache->slots));
+        cache->epoch = symbols_epoch;
+    }
+    const NisSymbol **slot = cache->slots + (hash & (SYMBOL_CACHE_SIZE - 1));
+    const NisSymbol *symbol = *slot;
+    if (symbol
+        && symbol->hash == hash
+        && symbol->len == len
+        && memcmp(symbol->name, name, len) == 0) {
+        return symbol;
+    }
+
+    pthread_mutex_lock(&symbols_lock);
+    symbol = nis_intern_unsync(name, len, hash);
+    pthread_mutex_unlock(&symbols_lock);
+    *slot = symbol;
+    return symbol;
+}
+
+void nis_symbols_concurrent(bool on) {
+    symbols_concurrent = on;
+}
+
+const NisSymbol *nis_intern_str(const char *name) {
+    return nis_intern(name, strlen(name));
+}
+
+void nis_del_symbols(void) {
+    struct SymbolBlock *block = symbols.blocks;
+    while (block) {
+        struct SymbolBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(symbols.slots);
+    symbols.slots = NULL;
+    symbols.cap = 0;
+    symbols.count = 0;
+    symbols.blocks = NULL;
+    ++symbols_epoch;
+}
@@ -0,0 +1,133 @@
+#include "check.h"
+
+// an adopted heap keeps its trees and registrations, including a heap
+// that registered nothing, and the parallel parse that adopts its worker
+// heaps reads the same program as one thread does
+
+static const char *FORMS[] = {
+    "(define (f x) (+ x 1))", "(f '(a b c))", "\"str\"", "(1 (2 (3 4.5)))",
+    "(let ((y 9000000000000000000)) (* y 2))", "#\\a", "'sym",
+};
+
+#define FORMC (sizeof FORMS / sizeof *FORMS)
+
+static NisValue nis_build_list(NisGc *gc, size_t len) {
+    NisValue list;
+    NisValue value;
+    nis_nil(&list, gc);
+    for (size_t i = 0; i < len; i++) {
+        nis_int(&value, gc, i);
+        nis_pair(&list, gc, &value, &list);
+    }
+    return list;
+}
+
+static void nis_display_all(char *dest, size_t cap, NisValue *program, size_t len) {
+    size_t used = 0;
+    for (size_t i = 0; i < len && used < cap; i++) {
+        used += nis_display(dest + used, cap - used, program + i);
+    }
+}
+
+static void check_regions(void) {
+    NisGc gc;
+    nis_new_gc(&gc, 1 << 20);
+
+    // no roots, weak values, tables or images on either side
+    NisGc empty;
+    nis_new_gc(&empty, 1 << 16);
+    nis_gc_adopt(&gc, &empty);
+    CHECK(gc.rootc == 0 && gc.weakc == 0 && gc.tablec == 0 && gc.imagec == 0);
+
+    // a rooted list and a weak value move across with their heap
+    NisGc region;
+    nis_new_gc(&region, 1 << 16);
+    NisValue *lists = malloc(2 * sizeof(NisValue));
+    size_t listc = 2;
+    lists[0] = nis_build_list(&region, 1000);
+    lists[1] = nis_build_list(&region, 10);
+    nis_gc_add_root(&region, &lists, &listc);
+    NisValue *weaks = malloc(sizeof(NisValue));
+    size_t weakc = 1;
+    weaks[0] = lists[1];
+    nis_gc_add_weak(&region, &weaks, &weakc);
+    nis_gc_minor(&region);
+    nis_gc_adopt(&gc, &region);
+    CHECK(gc.rootc == 1 && gc.weakc == 1);
+
+    // allocated over the adopted free lists, then collected with them
+    for (int i = 0; i < 50; i++) {
+        nis_build_list(&gc, 1000);
+    }
+    nis_gc_collect(&gc);
+    CHECK(nis_list_length(lists) == 1000);
+    CHECK(weaks[0].bits == lists[1].bits);
+    listc = 1;
+    nis_gc_collect(&gc);
+    NisValue no;
+    nis_false(&no, &gc);
+    CHECK(weaks[0].bits == no.bits);
+
+    nis_gc_remove_weak(&gc, &weaks);
+    nis_gc_remove_root(&gc, &lists);
+    free(weaks);
+    free(lists);
+    nis_del_gc(&gc);
+}
+
+static void check_parallel(void) {
+    char *src = malloc(1 << 20);
+    size_t len = 0;
+    uint64_t state = 0x510e527fade682d1;
+    while (len < (1 << 20) - 64) {
+        const char *form = FORMS[check_random(&state) % FORMC];
+        len += sprintf(src + len, "%s\n", form);
+    }
+
+    NisGc gc;
+    nis_new_gc(&gc, 4 << 20);
+    NisValue *expected;
+    size_t expectedc;
+    struct NisLexer lexer;
+    nis_new_lexer(&lexer, src, len);
+    CHECK(nis_parse_stream(&expected, &expectedc, &gc, &lexer) == 0);
+    nis_del_lexer(&lexer);
+    nis_gc_add_root(&gc, &expected, &expectedc);
+
+    static char want[1 << 12];
+    static char got[1 << 12];
+    // the tail too, which comes from the last worker
+    nis_display_all(want, sizeof want, expected + expectedc - 100, 100);
+
+    // the dropped programs leave the adopted heaps to the next parse
+    for (int round = 0; round < 4; round++) {
+        NisValue *program;
+        size_t programc;
+        size_t rootc = gc.rootc;
+        CHECK(nis_parse_parallel(&program, &programc, &gc, src, len, 4) == 0);
+        // the workers drop the roots of their pieces before the adopt
+        CHECK(gc.rootc == rootc);
+        nis_gc_add_root(&gc, &program, &programc);
+        nis_gc_collect(&gc);
+        CHECK(programc == expectedc);
+        if (programc == expectedc) {
+            nis_display_all(got, sizeof got, program + programc - 100, 100);
+            CHECK(strcmp(want, got) == 0);
+        }
+        nis_gc_remove_root(&gc, &program);
+        free(program);
+        nis_gc_collect(&gc);
+    }
+
+    nis_gc_remove_root(&gc, &expected);
+    free(expected);
+    nis_del_gc(&gc);
+    free(src);
+}
+
+int main(void) {
+    check_regions();
+    check_parallel();
+    nis_del_symbols();
+    return check_status();
+}
@@ -0,0 +1,31 @@
+#ifndef NISC_TEST_CHECK_H
+#define NISC_TEST_CHECK_H 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/nisc.h"
+
+// each test is its own program, main returns check_status()
+static int check_failures;
+
+#define CHECK(cond) do {                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            ++check_failures;                                           \
+        }                                                               \
+    } while (0)
+
+static inline int check_status(void) {
+    return check_failures ? 1 : 0;
+}
+
+// fixed seeds, so that a failure reproduces
+static inline uint64_t check_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+#endif /* NISC_TEST_CHECK_H */
@@ -0,0 +1,161 @@
+#define _DEFAULT_SOURCE
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include "check.h"
+
+// the builder's function list and index against a plain scan for the
+// first present function of each name, and instructions appended and
+// inserted past the first allocation
+
+#define NAMEC 300
+
+static const NisSymbol *nis_test_name(size_t i) {
+    char name[32];
+    snprintf(name, sizeof name, "g%zu", i);
+    return nis_intern_str(name);
+}
+
+// what nis_expr_to_hlbc did before the index
+static int32_t nis_scan_fun(const NisHlbuilder *b, const NisSymbol *name) {
+    for (size_t i = 0; i < b->func; i++) {
+        if (b->funv[i].present && b->funv[i].name == name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool nis_index_matches(NisHlbuilder *b) {
+    for (size_t i = 0; i < NAMEC; i++) {
+        const NisSymbol *name = nis_test_name(i);
+        if (nis_hlb_findfun(b, name) != nis_scan_fun(b, name)) {
+            fprintf(stderr, "%s: index %d, scan %d\n", name->name, nis_hlb_findfun(b, name), nis_scan_fun(b, name));
+            return false;
+        }
+    }
+    return true;
+}
+
+// the bounds check exits, so it runs in a child
+static int nis_rmfun_status(NisHlbuilder *b, int32_t funref) {
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDERR_FILENO);
+        nis_hlb_rmfun(b, funref);
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static void check_functions(NisGc *gc) {
+    NisHlbuilder b;
+    nis_new_hlbuilder(&b, gc);
+    // three of each name, far past the first 16 entries
+    for (size_t i = 0; i < 3 * NAMEC; i++) {
+        char name[32];
+        snprintf(name, sizeof name, "g%zu", i % NAMEC);
+        CHECK(nis_hlb_addfun(&b, name) == (int32_t) i);
+    }
+    CHECK(b.func == 3 * NAMEC && b.funs >= b.func);
+    CHECK(nis_index_matches(&b));
+
+    CHECK(nis_rmfun_status(&b, b.func) == 1);
+    CHECK(nis_rmfun_status(&b, -1) == 1);
+    CHECK(nis_rmfun_status(&b, b.func - 1) == 0);
+
+    // removing the first of a name falls back to the next one, in order
+    nis_hlb_rmfun(&b, 7);
+    CHECK(!b.funv[7].present && b.funv[7].insv == NULL);
+    CHECK(nis_hlb_findfun(&b, nis_test_name(7)) == NAMEC + 7);
+    nis_hlb_rmfun(&b, 7);
+    CHECK(nis_hlb_findfun(&b, nis_test_name(7)) == NAMEC + 7);
+    nis_hlb_rmfun(&b, 2 * NAMEC + 7);
+    CHECK(nis_hlb_findfun(&b, nis_test_name(7)) == NAMEC + 7);
+    nis_hlb_rmfun(&b, NAMEC + 7);
+    CHECK(nis_hlb_findfun(&b, nis_test_name(7)) == -1);
+
+    // removals in any order keep every probe run whole
+    uint64_t state = 0xbb67ae8584caa73b;
+    for (int round = 0; round < 2000; round++) {
+        uint64_t pick = check_random(&state);
+        if (pick % 3) {
+            nis_hlb_rmfun(&b, pick / 3 % b.func);
+        } else {
+            char name[32];
+            snprintf(name, sizeof name, "g%zu", (size_t) (pick / 3 % NAMEC));
+            nis_hlb_addfun(&b, name);
+        }
+        if (round % 100 == 0 && !nis_index_matches(&b)) {
+            CHECK(false);
+            break;
+        }
+    }
+    CHECK(nis_index_matches(&b));
+
+    // funv changed behind the index's back, as the image loader does
+    for (size_t i = 0; i < b.func; i += 5) {
+        if (b.funv[i].present) {
+            for (size_t j = 0; j < b.funv[i].insc; j++) {
+                nis_hlb_del_ins(b.funv[i].insv + j);
+            }
+            free(b.funv[i].insv);
+            b.funv[i].insv = NULL;
+            b.funv[i].present = 0;
+        }
+    }
+    nis_hlb_reindex(&b);
+    CHECK(nis_index_matches(&b));
+    nis_del_hlbuilder(&b);
+}
+
+static void check_instructions(NisGc *gc) {
+    NisHlbuilder b;
+    nis_new_hlbuilder(&b, gc);
+    b.funref = nis_hlb_addfun(&b, "f");
+    b.insref = 0;
+    NisHlarg lhs = { .kind = NIS_HLBC_ARG_VALUE };
+    NisHlarg rhs = { .kind = NIS_HLBC_ARG_VALUE };
+    NisHlarg dest;
+    nis_int(&lhs.value, gc, 1);
+    nis_int(&rhs.value, gc, 2);
+    // appended past the 16 instructions a function starts with
+    for (int i = 0; i < 100; i++) {
+        nis_hlb_build_add(&dest, &b, &lhs, &rhs);
+    }
+    NisHlfun *fun = b.funv + b.funref;
+    CHECK(fun->insc == 100 && fun->inss >= 100);
+    for (size_t i = 0; i < fun->insc; i++) {
+        CHECK(fun->insv[i].opcode == NIS_HLBC_ADD && fun->insv[i].target == (int32_t) i);
+    }
+
+    // inserted in the middle, the rest moves up by whole instructions
+    b.insref = 40;
+    nis_hlb_build_sub(&dest, &b, &lhs, &rhs);
+    nis_hlb_build_imul(&dest, &b, &lhs, &rhs);
+    CHECK(fun->insc == 102 && b.insref == 42);
+    CHECK(fun->insv[40].opcode == NIS_HLBC_SUB && fun->insv[40].target == 100);
+    CHECK(fun->insv[41].opcode == NIS_HLBC_IMUL && fun->insv[41].target == 101);
+    for (size_t i = 0; i < fun->insc; i++) {
+        if (i < 40 || i > 41) {
+            int32_t target = i < 40 ? (int32_t) i : (int32_t) i - 2;
+            CHECK(fun->insv[i].opcode == NIS_HLBC_ADD && fun->insv[i].target == target);
+            CHECK(fun->insv[i].argc == 2 && fun->insv[i].argv[1].value.bits == rhs.value.bits);
+        }
+    }
+    nis_del_hlbuilder(&b);
+}
+
+int main(void) {
+    NisGc gc;
+    nis_new_gc(&gc, 1 << 20);
+    check_functions(&gc);
+    check_instructions(&gc);
+    nis_del_gc(&gc);
+    nis_del_symbols();
+    return check_status();
+}
@@ -0,0 +1,262 @@
+#define _DEFAULT_SOURCE
+#include <unistd.h>
+#include <fcntl.h>
+#include "check.h"
+
+// an image loads back into the builder it was dumped from, and a damaged
+// one is refused instead of followed
+
+static const char *VALUES = "(1 2.5 \"str\" (a . b) -9000000000000000000 sym)";
+static const char *PROGRAM = "(+ 1 (* 2 (- 7 3)))";
+
+// the header as image.c writes it, for the damage below
+struct Header {
+    char magic[8];
+    uint32_t layout;
+    int32_t funent;
+    uint64_t len;
+    uint64_t trees;
+    uint64_t treec;
+    uint64_t fieldc;
+    uint64_t values;
+    uint64_t valuec;
+    uint64_t funv;
+    uint64_t func;
+    int64_t regcnt;
+    uint64_t relocs;
+    uint64_t relocc;
+};
+
+static void nis_parse_str(NisValue **dest, size_t *len, NisGc *gc, const char *src) {
+    struct NisLexer lexer;
+    nis_new_lexer(&lexer, src, strlen(src));
+    CHECK(nis_parse_stream(dest, len, gc, &lexer) == 0);
+    nis_del_lexer(&lexer);
+}
+
+// lowers PROGRAM after the prelude in `b`
+static void nis_lower(char *dest, size_t cap, NisHlbuilder *b) {
+    NisValue *program;
+    size_t len;
+    nis_parse_str(&program, &len, b->gc, PROGRAM);
+    nis_gc_add_root(b->gc, &program, &len);
+    NisHlprog prog;
+    CHECK(nis_to_hlbc(&prog, b, program, len) == 0);
+    nis_hlbc_display(dest, cap, &prog);
+    nis_gc_remove_root(b->gc, &program);
+    free(program);
+    nis_del_hlprog(&prog);
+}
+
+static void nis_write_file(const char *path, const char *bytes, size_t len) {
+    FILE *file = fopen(path, "wb");
+    CHECK(file && fwrite(bytes, 1, len, file) == len);
+    fclose(file);
+}
+
+static char *nis_read_file(const char *path, size_t *len) {
+    FILE *file = fopen(path, "rb");
+    fseek(file, 0, SEEK_END);
+    *len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *bytes = malloc(*len);
+    CHECK(fread(bytes, 1, *len, file) == *len);
+    fclose(file);
+    return bytes;
+}
+
+// loads `path`, and when that works collects with it mapped, the refusals
+// are expected so their messages are kept out of the log
+static int nis_try_load(const char *path) {
+    fflush(stderr);
+    int saved = dup(STDERR_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDERR_FILENO);
+    close(null);
+    NisGc gc;
+    nis_new_gc(&gc, 1 << 20);
+    NisHlbuilder b;
+    NisValue *values;
+    size_t len;
+    int status = nis_load_image(&b, &values, &len, &gc, path);
+    if (!status) {
+        nis_gc_add_root(&gc, &values, &len);
+        nis_gc_collect(&gc);
+        nis_gc_remove_root(&gc, &values);
+        free(values);
+        nis_del_hlbuilder(&b);
+    }
+    nis_del_gc(&gc);
+    fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+    return status;
+}
+
+static void nis_set_word(char *bytes, uint64_t offset, uint64_t word) {
+    memcpy(bytes + offset, &word, sizeof word);
+}
+
+static uint64_t nis_get_word(const char *bytes, uint64_t offset) {
+    uint64_t word;
+    memcpy(&word, bytes + offset, sizeof word);
+    return word;
+}
+
+// each of these must be refused
+static void check_damage(const char *path, const char *good, size_t len) {
+    struct Header head;
+    memcpy(&head, good, sizeof head);
+    char *bytes = malloc(len);
+    char *damaged = malloc(strlen(path) + 3);
+    sprintf(damaged, "%s.d", path);
+    uint64_t fun = head.funv;
+    // the first function with instructions, and its first instruction
+    while (nis_get_word(good, fun + offsetof(NisHlfun, insc)) == 0) {
+        fun += sizeof(NisHlfun);
+    }
+    uint64_t ins = nis_get_word(good, fun + offsetof(NisHlfun, insv));
+
+    for (int what = 0; what < 8; what++) {
+        memcpy(bytes, good, len);
+        size_t size = len;
+        switch (what) {
+        case 0:
+            size = sizeof head - 8;
+            break;
+        case 1:
+            bytes[0] ^= 1;
+            break;
+        case 2:
+            // a relocation that points past the end
+            nis_set_word(bytes, nis_get_word(bytes, head.relocs), len + 64);
+            break;
+        case 3:
+            nis_set_word(bytes, offsetof(struct Header, func), head.func + (1 << 20));
+            break;
+        case 4:
+            nis_set_word(bytes, fun + offsetof(NisHlfun, insc), 1 << 24);
+            break;
+        case 5:
+            nis_set_word(bytes, ins + offsetof(NisHlbc, argc), 1 << 24);
+            break;
+        case 6:
+            // a value between two trees
+            nis_set_word(bytes, head.values, head.trees + 8);
+            break;
+        case 7:
+            nis_set_word(bytes, offsetof(struct Header, funent), head.func);
+            break;
+        }
+        nis_write_file(damaged, bytes, size);
+        if (!nis_try_load(damaged)) {
+            fprintf(stderr, "damage %d was not refused\n", what);
+            CHECK(false);
+        }
+    }
+
+    // random bytes changed, which is either refused or loads something
+    // the collector can walk
+    uint64_t state = 0x6a09e667f3bcc908;
+    for (int round = 0; round < 300; round++) {
+        memcpy(bytes, good, len);
+        for (int i = 0; i < 4; i++) {
+            bytes[check_random(&state) % len] ^= 1 << check_random(&state) % 8;
+        }
+        nis_write_file(damaged, bytes, len);
+        nis_try_load(damaged);
+    }
+    unlink(damaged);
+    free(damaged);
+    free(bytes);
+}
+
+int main(void) {
+    char path[] = "/tmp/nisc-image-XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    close(fd);
+
+    static char built[4096];
+    static char loaded[4096];
+    static char shown[2][256];
+    {
+        NisGc gc;
+        nis_new_gc(&gc, 1 << 20);
+        NisValue *values;
+        size_t len;
+        nis_parse_str(&values, &len, &gc, VALUES);
+        nis_display(shown[0], sizeof shown[0], values);
+        NisHlbuilder b;
+        nis_new_hlbuilder(&b, &gc);
+        nis_hlb_make_prelude(&b);
+        CHECK(nis_dump_image(path, &b, values, len) == 0);
+        free(values);
+        nis_lower(built, sizeof built, &b);
+        nis_del_gc(&gc);
+    }
+    {
+        NisGc gc;
+        nis_new_gc(&gc, 1 << 20);
+        NisHlbuilder b;
+        NisValue *values;
+        size_t len;
+        CHECK(nis_load_image(&b, &values, &len, &gc, path) == 0);
+        CHECK(len == 1);
+        nis_display(shown[1], sizeof shown[1], values);
+        CHECK(strcmp(shown[0], shown[1]) == 0);
+        // loaded functions point into the mapping until they change
+        int32_t sub = nis_hlb_findfun(&b, nis_intern_str("-"));
+        CHECK(sub >= 0 && b.funv[sub].inss == 0);
+        nis_lower(loaded, sizeof loaded, &b);
+        CHECK(strcmp(built, loaded) == 0);
+        free(values);
+        nis_gc_collect(&gc);
+        nis_del_gc(&gc);
+    }
+    {
+        NisGc gc;
+        nis_new_gc(&gc, 1 << 20);
+        NisHlbuilder b;
+        NisValue *values;
+        size_t len;
+        CHECK(nis_load_image(&b, &values, &len, &gc, path) == 0);
+        free(values);
+        // building into a loaded function copies it out first
+        int32_t mul = nis_hlb_findfun(&b, nis_intern_str("*"));
+        NisHlfun *fun = b.funv + mul;
+        const NisHlbc *mapped = fun->insv;
+        size_t insc = fun->insc;
+        b.funref = mul;
+        b.insref = 0;
+        NisHlarg lhs = { .kind = NIS_HLBC_ARG_PROPER, .ssarg = 0 };
+        NisHlarg result;
+        nis_hlb_build_add(&result, &b, &lhs, &lhs);
+        CHECK(fun->inss >= insc + 1);
+        CHECK(fun->insc == insc + 1);
+        CHECK(fun->insv != mapped);
+        CHECK(fun->insv[0].opcode == NIS_HLBC_ADD);
+        CHECK(fun->insv[1].opcode == mapped[0].opcode);
+        CHECK(fun->insv[1].argv != mapped[0].argv);
+        CHECK(fun->insv[1].argc == mapped[0].argc);
+        nis_hlb_rmfun(&b, mul);
+        // and removing one still in the mapping leaves it there
+        int32_t rem = nis_hlb_findfun(&b, nis_intern_str("%"));
+        mapped = b.funv[rem].insv;
+        NisHlbc copy = mapped[0];
+        nis_hlb_rmfun(&b, rem);
+        CHECK(!b.funv[rem].present);
+        CHECK(memcmp(&copy, mapped, sizeof copy) == 0);
+        nis_del_hlbuilder(&b);
+        nis_del_gc(&gc);
+    }
+
+    size_t len;
+    char *good = nis_read_file(path, &len);
+    CHECK(nis_try_load(path) == 0);
+    check_damage(path, good, len);
+    free(good);
+    unlink(path);
+    nis_del_symbols();
+    return check_status();
+}
@@ -0,0 +1,109 @@
+#include "check.h"
+
+// every special form reads as its value through the perfect hash, whose
+// slots are written out by hand in parse.c, and near misses stay atoms
+
+static const struct {
+    const char *name;
+    int value;
+} SPECIAL[] = {
+    { "lambda", NIS_VALUE_LAMBDA },
+    { "if", NIS_VALUE_IF },
+    { "set!", NIS_VALUE_SET },
+    { "include", NIS_VALUE_INCLUDE },
+    { "include-ci", NIS_VALUE_INCLUDE_CI },
+    { "cond", NIS_VALUE_COND },
+    { "case", NIS_VALUE_CASE },
+    { "else", NIS_VALUE_ELSE },
+    { "and", NIS_VALUE_AND },
+    { "or", NIS_VALUE_OR },
+    { "unless", NIS_VALUE_UNLESS },
+    { "cond-expand", NIS_VALUE_COND_EXPAND },
+    { "let", NIS_VALUE_LET },
+    { "let*", NIS_VALUE_LET_STAR },
+    { "letrec", NIS_VALUE_LETREC },
+    { "letrec*", NIS_VALUE_LETREC_STAR },
+    { "let-values", NIS_VALUE_LET_VALUES },
+    { "let*-values", NIS_VALUE_LET_VALUES_STAR },
+    { "begin", NIS_VALUE_BEGIN },
+    { "do", NIS_VALUE_DO },
+    { "delay", NIS_VALUE_DELAY },
+    { "delay-force", NIS_VALUE_DELAY_FORCE },
+    { "force", NIS_VALUE_FORCE },
+    { "make-promise", NIS_VALUE_MAKE_PROMISE },
+    { "make-parameter", NIS_VALUE_MAKE_PARAMETER },
+    { "parameterize", NIS_VALUE_PARAMETERIZE },
+    { "guard", NIS_VALUE_GUARD },
+    { "quasiquote", NIS_VALUE_QUASIQUOTE },
+    { "unquote", NIS_VALUE_UNQUOTE },
+    { "unquote-splicing", NIS_VALUE_UNQUOTE_SPLICING },
+    { "case-lambda", NIS_VALUE_CASE_LAMBDA },
+    { "let-syntax", NIS_VALUE_LET_SYNTAX },
+    { "letrec-syntax", NIS_VALUE_LETREC_SYNTAX },
+    { "syntax-rules", NIS_VALUE_SYNTAX_RULES },
+    { "syntax-error", NIS_VALUE_SYNTAX_ERROR },
+};
+
+#define SPECIALC (sizeof SPECIAL / sizeof *SPECIAL)
+
+// one character off, and ones that share the length, the first two and
+// the last character of a special form, so that they land in its slot
+static const char *NEAR[] = {
+    "iff", "lambdas", "let**", "lambd", "i", "f", "set", "Lambda", "LET",
+    "laxxxa", "ix", "lex", "lett", "letrec**", "delay-forc", "cose",
+    "syntax-rulesyntax-rules", "unquote-splicin", "d", "dodo",
+};
+
+#define NEARC (sizeof NEAR / sizeof *NEAR)
+
+static NisValue *nis_read_all(size_t *len, NisGc *gc, const char *src) {
+    NisValue *program;
+    struct NisLexer lexer;
+    nis_new_lexer(&lexer, src, strlen(src));
+    CHECK(nis_parse_stream(&program, len, gc, &lexer) == 0);
+    nis_del_lexer(&lexer);
+    return program;
+}
+
+int main(void) {
+    NisGc gc;
+    nis_new_gc(&gc, 1 << 20);
+
+    static char src[4096];
+    size_t used = 0;
+    for (size_t i = 0; i < SPECIALC; i++) {
+        used += snprintf(src + used, sizeof src - used, "%s\n", SPECIAL[i].name);
+    }
+    size_t len;
+    NisValue *program = nis_read_all(&len, &gc, src);
+    CHECK(len == SPECIALC);
+    for (size_t i = 0; i < len && i < SPECIALC; i++) {
+        NisValue expected;
+        nis_special(&expected, &gc, SPECIAL[i].value);
+        if (program[i].bits != expected.bits) {
+            fprintf(stderr, "%s is not its special form\n", SPECIAL[i].name);
+            CHECK(false);
+        }
+    }
+    free(program);
+
+    used = 0;
+    for (size_t i = 0; i < NEARC; i++) {
+        used += snprintf(src + used, sizeof src - used, "%s\n", NEAR[i]);
+    }
+    program = nis_read_all(&len, &gc, src);
+    CHECK(len == NEARC);
+    for (size_t i = 0; i < len && i < NEARC; i++) {
+        if (nis_value_kind(program[i]) != NIS_VALUE_TREE
+            || nis_value_tree(program[i])->kind != NIS_STREE_ATOM
+            || strcmp(nis_value_tree(program[i])->vsym->name, NEAR[i]) != 0) {
+            fprintf(stderr, "%s is not an atom\n", NEAR[i]);
+            CHECK(false);
+        }
+    }
+    free(program);
+
+    nis_del_gc(&gc);
+    nis_del_symbols();
+    return check_status();
+}
@@ -0,0 +1,209 @@
+#define _DEFAULT_SOURCE
+#include <unistd.h>
+#include <fcntl.h>
+#include "check.h"
+
+// what the byte-at-a-time lexer before the table gave for the inputs it
+// handled, single character atoms and small numbers
+static const struct {
+    const char *src;
+    struct {
+        int kind;
+        size_t offset;
+        size_t len;
+        long vint;
+    } tokens[8];
+} CLASSIC[] = {
+    { "(+ 1 2)", {
+            { NIS_TOKEN_PARENL, 0, 1, 0 },
+            { NIS_TOKEN_IDENT, 1, 1, 0 },
+            { NIS_TOKEN_INT, 3, 1, 1 },
+            { NIS_TOKEN_INT, 5, 1, 2 },
+            { NIS_TOKEN_PARENR, 6, 1, 0 },
+        } },
+    { "'(a b)", {
+            { NIS_TOKEN_SINGLE_QUOTE, 0, 1, 0 },
+            { NIS_TOKEN_PARENL, 1, 1, 0 },
+            { NIS_TOKEN_IDENT, 2, 1, 0 },
+            { NIS_TOKEN_IDENT, 4, 1, 0 },
+            { NIS_TOKEN_PARENR, 5, 1, 0 },
+        } },
+    { "`(x ,y ,@z)", {
+            { NIS_TOKEN_BACKTICK, 0, 1, 0 },
+            { NIS_TOKEN_PARENL, 1, 1, 0 },
+            { NIS_TOKEN_IDENT, 2, 1, 0 },
+            { NIS_TOKEN_COMMA, 4, 1, 0 },
+            { NIS_TOKEN_IDENT, 5, 1, 0 },
+            { NIS_TOKEN_COMMA_AT, 7, 2, 0 },
+            { NIS_TOKEN_IDENT, 9, 1, 0 },
+            { NIS_TOKEN_PARENR, 10, 1, 0 },
+        } },
+    { "[\t{7}\n]", {
+            { NIS_TOKEN_SQUAREL, 0, 1, 0 },
+            { NIS_TOKEN_CURLYL, 2, 1, 0 },
+            { NIS_TOKEN_INT, 3, 1, 7 },
+            { NIS_TOKEN_CURLYR, 4, 1, 0 },
+            { NIS_TOKEN_SQUARER, 6, 1, 0 },
+        } },
+};
+
+// a number ends at a delimiter, what runs on past it is refused
+static const char *BAD_NUMBERS[] = {
+    "#b102", "1.5.5", "#xfg", "1/2", "1e", "-3a", "12abc", "#o8", "1.5e3x",
+};
+
+static const struct {
+    const char *src;
+    size_t len;
+} GOOD_NUMBERS[] = {
+    { "(1)", 3 }, { "[#b101]", 3 }, { "{#x1F}", 3 }, { "1.5\"s\"", 2 },
+    { "-3(", 2 }, { "#d12)", 2 }, { "2.5e3\n", 1 },
+};
+
+static const char *FRAGMENTS[] = {
+    "(", ")", "'", "`", ",", ",@", "[", "]", "{", "}", ".",
+    " ", "  ", "\t", "\n", "\r\n", "                                                  ",
+    "a", "x1", "foo-bar", "set!", "<=?", "->", "...", "+", "-", "lambda",
+    "a-really-long-identifier-that-spans-more-than-one-vector-width",
+    "λ", "日本語", "naïve-ünïcode-identifier-with-several-multibyte-bytes",
+    "0", "7", "42", "-3", "+4", "9223372036854775807",
+    "1.5", ".5", "-.5e2", "1.5e300", "1e400", "5e-324", "3.14159", "1.",
+    "#x1F", "#b-101", "#o17", "#d12",
+    "#\\a", "#\\space", "#\\x41", "#\\λ",
+    "\"\"", "\"short\"", "\"with \\\"escapes\\\" and \\\\ and \\n\"",
+    "\"a string long enough to take several vector loads before its end\"",
+    "\"\\x41;\\x3bb;\"",
+};
+
+#define FRAGMENTC (sizeof FRAGMENTS / sizeof *FRAGMENTS)
+
+static bool nis_same_token(const NisToken *a, const NisToken *b) {
+    if (a->kind != b->kind || a->span.ptr != b->span.ptr || a->span.len != b->span.len) {
+        return false;
+    }
+    switch (a->kind) {
+    case NIS_TOKEN_IDENT:
+        return a->vsym == b->vsym;
+    case NIS_TOKEN_INT:
+        return a->vint == b->vint;
+    case NIS_TOKEN_FLOAT:
+        return memcmp(&a->vfloat, &b->vfloat, sizeof(double)) == 0;
+    case NIS_TOKEN_CHAR:
+        return a->vchar == b->vchar;
+    case NIS_TOKEN_STRING:
+        return a->subkind == b->subkind
+            && a->vstr.len == b->vstr.len
+            && memcmp(a->vstr.ptr, b->vstr.ptr, a->vstr.len) == 0;
+    default:
+        return true;
+    }
+}
+
+static void check_classic(void) {
+    for (size_t i = 0; i < sizeof CLASSIC / sizeof *CLASSIC; i++) {
+        const char *src = CLASSIC[i].src;
+        struct NisTokens tokens;
+        CHECK(nis_lex(&tokens, src, strlen(src)) == 0);
+        size_t len = 0;
+        while (len < 8 && CLASSIC[i].tokens[len].kind != NIS_TOKEN_NONE) {
+            ++len;
+        }
+        CHECK(tokens.len == len);
+        for (size_t j = 0; j < len && j < tokens.len; j++) {
+            NisToken *token = tokens.list + j;
+            CHECK(token->kind == CLASSIC[i].tokens[j].kind);
+            CHECK(token->span.ptr == src + CLASSIC[i].tokens[j].offset);
+            CHECK(token->span.len == CLASSIC[i].tokens[j].len);
+            if (token->kind == NIS_TOKEN_INT) {
+                CHECK(token->vint == CLASSIC[i].tokens[j].vint);
+            }
+        }
+        nis_del_tokens(&tokens);
+    }
+}
+
+static void check_delimiters(void) {
+    for (size_t i = 0; i < sizeof GOOD_NUMBERS / sizeof *GOOD_NUMBERS; i++) {
+        const char *src = GOOD_NUMBERS[i].src;
+        struct NisTokens tokens;
+        CHECK(nis_lex(&tokens, src, strlen(src)) == 0);
+        CHECK(tokens.len == GOOD_NUMBERS[i].len);
+        nis_del_tokens(&tokens);
+    }
+    // the refusals are expected, so their messages are kept out of the log
+    fflush(stderr);
+    int saved = dup(STDERR_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDERR_FILENO);
+    close(null);
+    bool refused[sizeof BAD_NUMBERS / sizeof *BAD_NUMBERS];
+    for (size_t i = 0; i < sizeof BAD_NUMBERS / sizeof *BAD_NUMBERS; i++) {
+        char src[32];
+        struct NisTokens tokens;
+        // alone, and in a list where the bytes after it look like a token
+        int alone = nis_lex(&tokens, BAD_NUMBERS[i], strlen(BAD_NUMBERS[i]));
+        nis_del_tokens(&tokens);
+        int listed = nis_lex(&tokens, src, snprintf(src, sizeof src, "'(%s)", BAD_NUMBERS[i]));
+        nis_del_tokens(&tokens);
+        refused[i] = alone != 0 && listed != 0;
+    }
+    fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+    for (size_t i = 0; i < sizeof BAD_NUMBERS / sizeof *BAD_NUMBERS; i++) {
+        if (!refused[i]) {
+            fprintf(stderr, "%s was not refused\n", BAD_NUMBERS[i]);
+            CHECK(false);
+        }
+    }
+}
+
+// the vector scans must stop exactly where the table does, at any offset
+// from a block boundary
+static void check_modes(void) {
+    uint64_t state = 0x9e3779b97f4a7c15;
+    char *src = malloc(1 << 16);
+    for (int round = 0; round < 2000; round++) {
+        size_t len = 0;
+        size_t count = check_random(&state) % 64;
+        for (size_t i = 0; i < count; i++) {
+            const char *fragment = FRAGMENTS[check_random(&state) % FRAGMENTC];
+            size_t n = strlen(fragment);
+            memcpy(src + len, fragment, n);
+            len += n;
+            // most fragments need a delimiter after them
+            src[len++] = check_random(&state) % 4 ? ' ' : '\n';
+        }
+
+        struct NisTokens vector;
+        struct NisTokens scalar;
+        nis_lex_vectors(true);
+        int vstatus = nis_lex(&vector, src, len);
+        nis_lex_vectors(false);
+        int sstatus = nis_lex(&scalar, src, len);
+        nis_lex_vectors(true);
+
+        CHECK(vstatus == 0);
+        CHECK(vstatus == sstatus);
+        CHECK(vector.len == scalar.len);
+        for (size_t i = 0; i < vector.len && i < scalar.len; i++) {
+            if (!nis_same_token(vector.list + i, scalar.list + i)) {
+                fprintf(stderr, "round %d: token %zu differs: %.*s\n",
+                        round, i, (int) scalar.list[i].span.len, scalar.list[i].span.ptr);
+                CHECK(false);
+                break;
+            }
+        }
+        nis_del_tokens(&vector);
+        nis_del_tokens(&scalar);
+    }
+    free(src);
+}
+
+int main(void) {
+    check_classic();
+    check_delimiters();
+    check_modes();
+    nis_del_symbols();
+    return check_status();
+}
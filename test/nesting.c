@@ -0,0 +1,71 @@
+#include "check.h"
+
+// nesting as deep as 10^6 must not recurse on the C stack anywhere
+
+#define DEPTH 1000000
+
+static NisValue *nis_parse_text(NisGc *gc, const char *src, size_t len, size_t *count) {
+    NisValue *program = NULL;
+    struct NisLexer lexer;
+    nis_new_lexer(&lexer, src, len);
+    CHECK(nis_parse_stream(&program, count, gc, &lexer) == 0);
+    nis_del_lexer(&lexer);
+    return program;
+}
+
+static void check_deep(void) {
+    char *src = malloc(2 * DEPTH + 1);
+    memset(src, '(', DEPTH);
+    src[DEPTH] = 'x';
+    memset(src + DEPTH + 1, ')', DEPTH);
+
+    NisGc gc;
+    nis_new_gc(&gc, 1 << 20);
+    size_t len;
+    NisValue *program = nis_parse_text(&gc, src, 2 * DEPTH + 1, &len);
+    CHECK(len == 1);
+    nis_gc_add_root(&gc, &program, &len);
+    // a collection marks all of it too
+    nis_gc_collect(&gc);
+
+    size_t depth = 0;
+    for (NisValue value = program[0]; nis_pair_eh(value); value = nis_value_tree(value)->vpair.car) {
+        CHECK(nis_list_length(&value) == 1);
+        ++depth;
+    }
+    CHECK(depth == DEPTH);
+
+    char buffer[64];
+    nis_display(buffer, sizeof buffer, program);
+    // cut off at the end of the buffer
+    CHECK(strspn(buffer, "(") >= 32);
+
+    nis_gc_remove_root(&gc, &program);
+    free(program);
+    nis_del_gc(&gc);
+    free(src);
+}
+
+static void check_improper(void) {
+    const char *src = "(1 2 3 . x) (1 (2 . 3) . y)";
+    NisGc gc;
+    nis_new_gc(&gc, 1 << 20);
+    size_t len;
+    NisValue *program = nis_parse_text(&gc, src, strlen(src), &len);
+    CHECK(len == 2);
+    char buffer[64];
+    nis_display(buffer, sizeof buffer, program);
+    CHECK(strcmp(buffer, "(1 . (2 . (3 . x)))") == 0);
+    CHECK(nis_list_length(program) == 0);
+    nis_display(buffer, sizeof buffer, program + 1);
+    CHECK(strcmp(buffer, "(1 . ((2 . 3) . y))") == 0);
+    free(program);
+    nis_del_gc(&gc);
+}
+
+int main(void) {
+    check_deep();
+    check_improper();
+    nis_del_symbols();
+    return check_status();
+}
@@ -0,0 +1,101 @@
+#define _DEFAULT_SOURCE
+#include <locale.h>
+#include "check.h"
+
+// reals must read and print the same whatever LC_NUMERIC is, the program
+// starts in the C locale and compares against strtod there
+
+#define REALC 20000
+
+static const char *COMMA_LOCALES[] = {
+    "de_DE.UTF-8", "de_DE.utf8", "fr_FR.UTF-8", "fr_FR.utf8", "ru_RU.UTF-8",
+};
+
+static size_t nis_random_real(char *dest, uint64_t *state) {
+    uint64_t pick = check_random(state);
+    size_t count = 0;
+    if (pick & 1) {
+        dest[count++] = '-';
+    }
+    // long mantissas and large exponents miss the fast path
+    size_t intc = 1 + (pick >> 1) % 12;
+    size_t fracc = (pick >> 5) % 25;
+    for (size_t i = 0; i < intc; i++) {
+        dest[count++] = '0' + check_random(state) % 10;
+    }
+    dest[count++] = '.';
+    for (size_t i = 0; i < fracc; i++) {
+        dest[count++] = '0' + check_random(state) % 10;
+    }
+    if (pick >> 10 & 1) {
+        count += sprintf(dest + count, "e%d", (int) ((pick >> 11) % 600) - 300);
+    }
+    dest[count] = '\0';
+    return count;
+}
+
+static bool nis_lex_real(double *dest, const char *src) {
+    struct NisTokens tokens;
+    bool ok = nis_lex(&tokens, src, strlen(src)) == 0
+        && tokens.len == 1
+        && tokens.list[0].kind == NIS_TOKEN_FLOAT;
+    if (ok) {
+        *dest = tokens.list[0].vfloat;
+    }
+    nis_del_tokens(&tokens);
+    return ok;
+}
+
+static void check_reals(char (*reals)[64], const double *expected) {
+    size_t bad = 0;
+    for (size_t i = 0; i < REALC; i++) {
+        double value;
+        if (!nis_lex_real(&value, reals[i]) || value != expected[i]) {
+            if (bad++ < 5) {
+                fprintf(stderr, "misread %s\n", reals[i]);
+            }
+        }
+    }
+    CHECK(bad == 0);
+}
+
+static void check_display(void) {
+    NisGc gc;
+    nis_new_gc(&gc, 1 << 20);
+    NisValue value;
+    char buffer[64];
+    nis_float(&value, &gc, 1.5);
+    nis_display(buffer, sizeof buffer, &value);
+    CHECK(strcmp(buffer, "1.5") == 0);
+    nis_float(&value, &gc, 1.5e300);
+    nis_display(buffer, sizeof buffer, &value);
+    CHECK(strcmp(buffer, "1.5e+300") == 0);
+    nis_del_gc(&gc);
+}
+
+int main(void) {
+    static char reals[REALC][64];
+    static double expected[REALC];
+    uint64_t state = 0x2545f4914f6cdd1d;
+    for (size_t i = 0; i < REALC; i++) {
+        nis_random_real(reals[i], &state);
+        expected[i] = strtod(reals[i], NULL);
+    }
+    check_reals(reals, expected);
+    check_display();
+
+    const char *name = getenv("NIS_TEST_LOCALE");
+    for (size_t i = 0; !name && i < sizeof COMMA_LOCALES / sizeof *COMMA_LOCALES; i++) {
+        if (setlocale(LC_NUMERIC, COMMA_LOCALES[i])) {
+            name = COMMA_LOCALES[i];
+        }
+    }
+    if (name && setlocale(LC_NUMERIC, name) && strcmp(localeconv()->decimal_point, ",") == 0) {
+        check_reals(reals, expected);
+        check_display();
+    } else {
+        fprintf(stderr, "no locale with a decimal comma, set NIS_TEST_LOCALE to check one\n");
+    }
+    nis_del_symbols();
+    return check_status();
+}
@@ -0,0 +1,111 @@
+#include "check.h"
+
+// a released region gives back exactly the nursery trees built since its
+// mark, and leaves the rooted trees as they were
+
+static const char *SOURCE = "(define (f x) (+ x 1)) (f '(a b c)) \"str\" (1 (2 (3 4.5)))";
+
+static NisValue nis_build_list(NisGc *gc, size_t len) {
+    NisValue list;
+    NisValue value;
+    nis_nil(&list, gc);
+    for (size_t i = 0; i < len; i++) {
+        nis_int(&value, gc, i);
+        nis_pair(&list, gc, &value, &list);
+    }
+    return list;
+}
+
+static void nis_display_all(char *dest, size_t cap, NisValue *program, size_t len) {
+    size_t used = 0;
+    for (size_t i = 0; i < len && used < cap; i++) {
+        used += nis_display(dest + used, cap - used, program + i);
+    }
+}
+
+int main(void) {
+    NisGc gc;
+    nis_new_gc(&gc, 1 << 20);
+    NisValue *program;
+    size_t len;
+    struct NisLexer lexer;
+    nis_new_lexer(&lexer, SOURCE, strlen(SOURCE));
+    CHECK(nis_parse_stream(&program, &len, &gc, &lexer) == 0);
+    nis_del_lexer(&lexer);
+    nis_gc_add_root(&gc, &program, &len);
+    static char before[4096];
+    static char after[4096];
+    nis_display_all(before, sizeof before, program, len);
+
+    // phases back to back, none of them reaching a minor collection
+    size_t minors = gc.minors;
+    for (int phase = 0; phase < 1000; phase++) {
+        struct NisGcMark mark;
+        nis_gc_mark_region(&gc, &mark);
+        NisValue list = nis_build_list(&gc, 1000);
+        CHECK(nis_list_length(&list) == 1000);
+        CHECK(nis_gc_release_region(&gc, &mark));
+        CHECK(gc.nurserylen == mark.nurserylen);
+    }
+    CHECK(gc.minors == minors);
+    nis_display_all(after, sizeof after, program, len);
+    CHECK(strcmp(before, after) == 0);
+
+    // a weak value into the region goes to #f, one outside it stays
+    NisValue *weaks = malloc(2 * sizeof(NisValue));
+    size_t weakc = 2;
+    weaks[0] = program[0];
+    nis_gc_add_weak(&gc, &weaks, &weakc);
+    struct NisGcMark mark;
+    nis_gc_mark_region(&gc, &mark);
+    weaks[1] = nis_build_list(&gc, 10);
+    CHECK(nis_gc_release_region(&gc, &mark));
+    NisValue no;
+    nis_false(&no, &gc);
+    CHECK(weaks[0].bits == program[0].bits);
+    CHECK(weaks[1].bits == no.bits);
+    nis_gc_remove_weak(&gc, &weaks);
+    free(weaks);
+
+    // nothing is freed across a minor collection
+    nis_gc_mark_region(&gc, &mark);
+    nis_build_list(&gc, 10);
+    nis_gc_minor(&gc);
+    CHECK(!nis_gc_release_region(&gc, &mark));
+
+    // a phase that fills the nursery goes on in the heap, and the old
+    // pairs it builds there are its own garbage, not escapes
+    nis_gc_mark_region(&gc, &mark);
+    NisValue big = nis_build_list(&gc, 400000);
+    CHECK(nis_list_length(&big) == 400000);
+    CHECK(gc.minors == mark.minors);
+    CHECK(nis_gc_release_region(&gc, &mark));
+    nis_gc_minor(&gc);
+
+#ifndef NIS_GC_VERIFY
+    // an old pair that took a region tree must not lead the next minor
+    // collection into released memory, verify builds stop on this instead
+    NisValue old = nis_build_list(&gc, 1);
+    size_t oldc = 1;
+    NisValue *olds = &old;
+    nis_gc_add_root(&gc, &olds, &oldc);
+    nis_gc_minor(&gc);
+    CHECK(!nis_young_eh(&gc, nis_value_tree(old)));
+    nis_gc_mark_region(&gc, &mark);
+    NisValue young = nis_build_list(&gc, 3);
+    nis_gc_store(&gc, nis_value_tree(old), &nis_value_tree(old)->vpair.cdr, young);
+    CHECK(nis_gc_release_region(&gc, &mark));
+    CHECK(nis_nil_eh(nis_value_tree(old)->vpair.cdr));
+    nis_gc_minor(&gc);
+    nis_gc_remove_root(&gc, &olds);
+#endif
+
+    nis_gc_collect(&gc);
+    nis_display_all(after, sizeof after, program, len);
+    CHECK(strcmp(before, after) == 0);
+    nis_gc_remove_root(&gc, &program);
+    free(program);
+    nis_del_gc(&gc);
+    nis_del_symbols();
+    return check_status();
+}
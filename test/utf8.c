@@ -0,0 +1,97 @@
+#include "check.h"
+#include "../include/nisc_priv.h"
+
+// the vector validator must report the same first invalid byte as the
+// scalar decoder, wherever it falls in a block
+
+static const struct {
+    const char *src;
+    size_t len;
+    size_t error;
+} CASES[] = {
+    { "plain ascii", 11, 11 },
+    { "\xce\xbb \xe6\x97\xa5 \xf0\x9f\x98\x80", 11, 11 },
+    // overlong
+    { "a\xc0\x80", 3, 1 },
+    { "a\xe0\x80\xaf", 4, 1 },
+    { "a\xf0\x80\x80\xaf", 5, 1 },
+    // surrogate
+    { "ab\xed\xa0\x80", 5, 2 },
+    // past U+10FFFF
+    { "\xf4\x90\x80\x80", 4, 0 },
+    // stray continuation and cut off sequences
+    { "ab\x80", 3, 2 },
+    { "ab\xe6\x97", 4, 2 },
+    { "\xe6\x97x", 3, 0 },
+    { "\xff", 1, 0 },
+};
+
+static const char *PIECES[] = {
+    "a", "abc ", "(define x 1)\n", "\xce\xbb", "\xe6\x97\xa5", "\xf0\x9f\x98\x80",
+    "\xc2\xa0", "\xef\xbf\xbd", "\xf4\x8f\xbf\xbf",
+};
+
+static const char *BAD[] = {
+    "\xc0\x80", "\xc1\xbf", "\xe0\x80\x80", "\xed\xa0\x80", "\xed\xbf\xbf",
+    "\xf0\x80\x80\x80", "\xf4\x90\x80\x80", "\xf5\x80\x80\x80", "\x80", "\xbf",
+    "\xc2", "\xe6\x97", "\xf0\x9f\x98", "\xfe", "\xff",
+};
+
+#define PIECEC (sizeof PIECES / sizeof *PIECES)
+#define BADC (sizeof BAD / sizeof *BAD)
+
+static size_t nis_scan_both(const char *src, size_t len) {
+    nis_lex_vectors(false);
+    size_t scalar = nis_scan_utf8(src, 0, len);
+    nis_lex_vectors(true);
+    size_t vector = nis_scan_utf8(src, 0, len);
+    if (scalar != vector) {
+        fprintf(stderr, "scalar stops at %zu, vectors at %zu of %zu\n", scalar, vector, len);
+        CHECK(false);
+    }
+    return vector;
+}
+
+int main(void) {
+    for (size_t i = 0; i < sizeof CASES / sizeof *CASES; i++) {
+        CHECK(nis_scan_both(CASES[i].src, CASES[i].len) == CASES[i].error);
+    }
+
+    uint64_t state = 0x853c49e6748fea9b;
+    char *src = malloc(4096);
+    for (int round = 0; round < 20000; round++) {
+        size_t len = 0;
+        size_t target = check_random(&state) % 400;
+        while (len < target) {
+            const char *piece = PIECES[check_random(&state) % PIECEC];
+            size_t n = strlen(piece);
+            memcpy(src + len, piece, n);
+            len += n;
+        }
+        size_t error = len;
+        // some rounds stay valid to cover long runs of good blocks
+        if (round % 4) {
+            const char *bad = BAD[check_random(&state) % BADC];
+            size_t n = strlen(bad);
+            // cut at a piece boundary, so that the error is where it went in
+            size_t at = len;
+            while (at > 0 && check_random(&state) % 8) {
+                --at;
+                while (at > 0 && ((unsigned char) src[at] & 0xc0) == 0x80) {
+                    --at;
+                }
+            }
+            memmove(src + at + n, src + at, len - at);
+            memcpy(src + at, bad, n);
+            len += n;
+            error = at;
+        }
+        size_t found = nis_scan_both(src, len);
+        CHECK(found == error);
+        if (found != error) {
+            fprintf(stderr, "round %d: expected %zu, got %zu\n", round, error, found);
+        }
+    }
+    free(src);
+    return check_status();
+}
@@ -0,0 +1,146 @@
+#include "check.h"
+
+// weak values and weak tables through minor and major collections and a
+// region release, and the parser sharing its number trees through one
+
+#define TREEC 2000
+
+static bool nis_float_eq(const NisStree *tree, const void *arg) {
+    return tree->kind == NIS_STREE_FLOAT && tree->vfloat == *(const double *) arg;
+}
+
+static uint32_t nis_float_hash(double value) {
+    return (uint32_t) (value * 2654435761.0);
+}
+
+// the even trees are rooted, the odd ones only weak
+static void check_survivors(NisGc *gc, NisWeakTable *table, NisValue *weaks, const NisValue *strong) {
+    NisValue no;
+    nis_false(&no, gc);
+    size_t found = 0;
+    for (size_t i = 0; i < TREEC; i++) {
+        double value = i + 0.5;
+        NisStree *tree = nis_weak_find(gc, table, nis_float_hash(value), nis_float_eq, &value);
+        if (i % 2 == 0) {
+            CHECK(tree == nis_value_tree(strong[i / 2]));
+            CHECK(weaks[i].bits == strong[i / 2].bits);
+        } else {
+            CHECK(weaks[i].bits == no.bits);
+        }
+        found += tree != NULL;
+    }
+    CHECK(found == TREEC / 2);
+    CHECK(table->count == TREEC / 2);
+}
+
+static void check_table(bool major) {
+    NisGc gc;
+    nis_new_gc(&gc, 1 << 20);
+    NisWeakTable table;
+    nis_new_weak_table(&table, &gc);
+    NisValue *weaks = malloc(TREEC * sizeof(NisValue));
+    NisValue *strong = malloc(TREEC / 2 * sizeof(NisValue));
+    size_t weakc = TREEC;
+    size_t strongc = TREEC / 2;
+    for (size_t i = 0; i < TREEC; i++) {
+        nis_float(weaks + i, &gc, i + 0.5);
+        nis_weak_add(&gc, &table, nis_float_hash(i + 0.5), nis_value_tree(weaks[i]));
+        if (i % 2 == 0) {
+            strong[i / 2] = weaks[i];
+        }
+    }
+    nis_gc_add_weak(&gc, &weaks, &weakc);
+    nis_gc_add_root(&gc, &strong, &strongc);
+    if (major) {
+        nis_gc_collect(&gc);
+    } else {
+        nis_gc_minor(&gc);
+        CHECK(!nis_young_eh(&gc, nis_value_tree(strong[0])));
+    }
+    check_survivors(&gc, &table, weaks, strong);
+    // the survivors are old now, so a major collection finds them again
+    nis_gc_collect(&gc);
+    check_survivors(&gc, &table, weaks, strong);
+
+    // a released region takes its entries with it
+    struct NisGcMark mark;
+    nis_gc_mark_region(&gc, &mark);
+    NisValue young;
+    double value = -1.5;
+    nis_float(&young, &gc, value);
+    nis_weak_add(&gc, &table, nis_float_hash(value), nis_value_tree(young));
+    CHECK(nis_weak_find(&gc, &table, nis_float_hash(value), nis_float_eq, &value));
+    CHECK(nis_gc_release_region(&gc, &mark));
+    CHECK(!nis_weak_find(&gc, &table, nis_float_hash(value), nis_float_eq, &value));
+    CHECK(table.count == TREEC / 2);
+
+    nis_gc_remove_weak(&gc, &weaks);
+    nis_gc_remove_root(&gc, &strong);
+    nis_del_weak_table(&table, &gc);
+    free(weaks);
+    free(strong);
+    nis_del_gc(&gc);
+}
+
+static NisStree *nis_nth_tree(NisValue list, size_t n) {
+    while (n--) {
+        list = nis_value_tree(list)->vpair.cdr;
+    }
+    return nis_value_tree(nis_value_tree(list)->vpair.car);
+}
+
+// equal numbers that need a tree share one across forms and the minor
+// collections between them, until distinct numbers fill the table
+static void check_constants(void) {
+    static char src[1 << 20];
+    size_t len = 0;
+    for (int i = 0; i < 2000; i++) {
+        len += snprintf(src + len, sizeof src - len, "(%d.25 1.5 -9000000000000000000", i);
+        for (int j = 0; j < 100; j++) {
+            len += snprintf(src + len, sizeof src - len, " %d", j);
+        }
+        len += snprintf(src + len, sizeof src - len, ")\n");
+    }
+    NisGc gc;
+    nis_new_gc(&gc, 1 << 20);
+    NisValue *program;
+    size_t proglen;
+    struct NisLexer lexer;
+    nis_new_lexer(&lexer, src, len);
+    int status = nis_parse_stream(&program, &proglen, &gc, &lexer);
+    nis_del_lexer(&lexer);
+    CHECK(status == 0 && proglen == 2000);
+    if (status || proglen != 2000) {
+        return;
+    }
+    CHECK(gc.minors > 0);
+    nis_gc_add_root(&gc, &program, &proglen);
+    nis_gc_collect(&gc);
+    // a new tree each time the table starts over, about every 1000 forms
+    size_t reals = 1;
+    size_t bigs = 1;
+    for (size_t i = 0; i < proglen; i++) {
+        NisStree *real = nis_nth_tree(program[i], 1);
+        NisStree *big = nis_nth_tree(program[i], 2);
+        CHECK(real->kind == NIS_STREE_FLOAT && real->vfloat == 1.5);
+        CHECK(big->kind == NIS_STREE_INT && big->vint == -9000000000000000000);
+        CHECK(nis_nth_tree(program[i], 0)->vfloat == i + 0.25);
+        if (i > 0) {
+            reals += real != nis_nth_tree(program[i - 1], 1);
+            bigs += big != nis_nth_tree(program[i - 1], 2);
+        }
+    }
+    CHECK(reals <= 3);
+    CHECK(bigs <= 3);
+    nis_gc_remove_root(&gc, &program);
+    free(program);
+    nis_del_gc(&gc);
+}
+
+int main(void) {
+    check_table(false);
+    check_table(true);
+    check_constants();
+    nis_del_symbols();
+    return check_status();
+}